@@ -0,0 +1,199 @@
+#include "blake3.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <thread>
+
+namespace blake3 {
+
+namespace {
+
+constexpr size_t BLOCK_LEN = 64;
+constexpr size_t CHUNK_LEN = 1024;
+
+constexpr uint32_t CHUNK_START = 1 << 0;
+constexpr uint32_t CHUNK_END = 1 << 1;
+constexpr uint32_t PARENT = 1 << 2;
+constexpr uint32_t ROOT = 1 << 3;
+
+const uint32_t IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+const uint8_t MSG_PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline void g(uint32_t state[16], int a, int b, int c, int d, uint32_t x, uint32_t y) {
+    state[a] = state[a] + state[b] + x;
+    state[d] = rotr(state[d] ^ state[a], 16);
+    state[c] = state[c] + state[d];
+    state[b] = rotr(state[b] ^ state[c], 12);
+    state[a] = state[a] + state[b] + y;
+    state[d] = rotr(state[d] ^ state[a], 8);
+    state[c] = state[c] + state[d];
+    state[b] = rotr(state[b] ^ state[c], 7);
+}
+
+// The compression function; out receives the full 16-word state
+void compress(const uint32_t cv[8], const uint8_t block[BLOCK_LEN], uint32_t blockLen,
+              uint64_t counter, uint32_t flags, uint32_t out[16]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = uint32_t(block[4 * i]) | (uint32_t(block[4 * i + 1]) << 8) |
+               (uint32_t(block[4 * i + 2]) << 16) | (uint32_t(block[4 * i + 3]) << 24);
+    }
+    uint32_t state[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        IV[0], IV[1], IV[2], IV[3],
+        static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), blockLen, flags,
+    };
+    for (int round = 0; round < 7; ++round) {
+        g(state, 0, 4, 8, 12, m[0], m[1]);
+        g(state, 1, 5, 9, 13, m[2], m[3]);
+        g(state, 2, 6, 10, 14, m[4], m[5]);
+        g(state, 3, 7, 11, 15, m[6], m[7]);
+        g(state, 0, 5, 10, 15, m[8], m[9]);
+        g(state, 1, 6, 11, 12, m[10], m[11]);
+        g(state, 2, 7, 8, 13, m[12], m[13]);
+        g(state, 3, 4, 9, 14, m[14], m[15]);
+        if (round < 6) {
+            uint32_t permuted[16];
+            for (int i = 0; i < 16; ++i) {
+                permuted[i] = m[MSG_PERMUTATION[i]];
+            }
+            std::memcpy(m, permuted, sizeof(m));
+        }
+    }
+    for (int i = 0; i < 8; ++i) {
+        out[i] = state[i] ^ state[i + 8];
+        out[i + 8] = state[i + 8] ^ cv[i];
+    }
+}
+
+// Logical input made of a prefix (the object header) and a body
+struct Input {
+    std::string_view prefix;
+    std::string_view body;
+
+    size_t size() const { return prefix.size() + body.size(); }
+
+    // Pointer to len bytes at offset; copies into scratch when the range
+    // straddles the prefix
+    const uint8_t* bytes(size_t offset, size_t len, uint8_t* scratch) const {
+        if (offset >= prefix.size()) {
+            return reinterpret_cast<const uint8_t*>(body.data()) + (offset - prefix.size());
+        }
+        size_t fromPrefix = std::min(len, prefix.size() - offset);
+        std::memcpy(scratch, prefix.data() + offset, fromPrefix);
+        std::memcpy(scratch + fromPrefix, body.data(), len - fromPrefix);
+        return scratch;
+    }
+};
+
+// Chaining value of one chunk; with root set, out gets the root output state instead
+void hashChunk(const Input& input, size_t offset, size_t len, uint64_t chunkIndex, bool root, uint32_t out[16]) {
+    uint8_t scratch[CHUNK_LEN];
+    const uint8_t* data = input.bytes(offset, len, scratch);
+
+    uint32_t cv[8];
+    std::memcpy(cv, IV, sizeof(cv));
+    size_t blocks = len == 0 ? 1 : (len + BLOCK_LEN - 1) / BLOCK_LEN;
+    for (size_t b = 0; b < blocks; ++b) {
+        uint8_t block[BLOCK_LEN] = {};
+        size_t blockLen = std::min(BLOCK_LEN, len - b * BLOCK_LEN);
+        std::memcpy(block, data + b * BLOCK_LEN, blockLen);
+
+        uint32_t flags = 0;
+        if (b == 0) {
+            flags |= CHUNK_START;
+        }
+        if (b == blocks - 1) {
+            flags |= CHUNK_END;
+            if (root) {
+                flags |= ROOT;
+            }
+        }
+        uint32_t state[16];
+        compress(cv, block, static_cast<uint32_t>(blockLen), chunkIndex, flags, state);
+        if (b == blocks - 1) {
+            std::memcpy(out, state, sizeof(state));
+        } else {
+            std::memcpy(cv, state, sizeof(cv));
+        }
+    }
+}
+
+void hashParent(const uint32_t left[8], const uint32_t right[8], bool root, uint32_t out[16]) {
+    uint8_t block[BLOCK_LEN];
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            block[4 * i + j] = static_cast<uint8_t>(left[i] >> (8 * j));
+            block[32 + 4 * i + j] = static_cast<uint8_t>(right[i] >> (8 * j));
+        }
+    }
+    compress(IV, block, BLOCK_LEN, 0, PARENT | (root ? ROOT : 0), out);
+}
+
+// Bytes in the left subtree: the largest power-of-two number of chunks
+// that still leaves at least one byte for the right subtree
+size_t leftLength(size_t len) {
+    size_t chunks = (len - 1) / CHUNK_LEN;
+    size_t power = 1;
+    while (power * 2 <= chunks) {
+        power *= 2;
+    }
+    return power * CHUNK_LEN;
+}
+
+// Hashes the subtree covering [offset, offset + len). threads is the number
+// of threads this subtree may use; the left half is forked while it is above one.
+void hashSubtree(const Input& input, size_t offset, size_t len, uint64_t chunkIndex,
+                 bool root, unsigned threads, uint32_t out[16]) {
+    if (len <= CHUNK_LEN) {
+        hashChunk(input, offset, len, chunkIndex, root, out);
+        return;
+    }
+
+    size_t left = leftLength(len);
+    uint32_t leftOut[16];
+    uint32_t rightOut[16];
+    if (threads > 1 && len >= PARALLEL_THRESHOLD) {
+        unsigned leftThreads = threads / 2;
+        auto leftTask = std::async(std::launch::async, [&] {
+            hashSubtree(input, offset, left, chunkIndex, false, leftThreads, leftOut);
+        });
+        hashSubtree(input, offset + left, len - left, chunkIndex + left / CHUNK_LEN, false,
+                    threads - leftThreads, rightOut);
+        leftTask.get();
+    } else {
+        hashSubtree(input, offset, left, chunkIndex, false, 1, leftOut);
+        hashSubtree(input, offset + left, len - left, chunkIndex + left / CHUNK_LEN, false, 1, rightOut);
+    }
+    hashParent(leftOut, rightOut, root, out);
+}
+
+} // namespace
+
+hashing::Digest hash(std::string_view prefix, std::string_view body, unsigned maxThreads) {
+    Input input{prefix, body};
+    static const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned threads = maxThreads ? maxThreads : hardwareThreads;
+
+    uint32_t out[16];
+    hashSubtree(input, 0, input.size(), 0, true, threads, out);
+
+    hashing::Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            digest[4 * i + j] = static_cast<uint8_t>(out[i] >> (8 * j));
+        }
+    }
+    return digest;
+}
+
+} // namespace blake3
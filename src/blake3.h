@@ -0,0 +1,27 @@
+#ifndef CODEBIRD_BLAKE3_H
+#define CODEBIRD_BLAKE3_H
+
+#include <cstddef>
+#include <string_view>
+
+#include "hash.h"
+
+// BLAKE3 (32-byte output, unkeyed). Inputs are split into 1 KiB chunks that
+// form a binary Merkle tree, so large inputs are hashed as independent
+// subtrees on several threads and joined by parent nodes.
+namespace blake3 {
+
+// Inputs smaller than this are always hashed on the calling thread
+constexpr size_t PARALLEL_THRESHOLD = 256 * 1024;
+
+// Hashes prefix followed by body without concatenating them. maxThreads of 0
+// uses the hardware concurrency.
+hashing::Digest hash(std::string_view prefix, std::string_view body, unsigned maxThreads = 0);
+
+inline hashing::Digest hash(std::string_view data, unsigned maxThreads = 0) {
+    return hash(std::string_view(), data, maxThreads);
+}
+
+} // namespace blake3
+
+#endif // CODEBIRD_BLAKE3_H
@@ -0,0 +1,185 @@
+#ifndef CODEBIRD_BLAME_H
+#define CODEBIRD_BLAME_H
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_util.h"
+#include "pack.h"
+
+// Lines of a file; a final line without a newline still counts
+inline std::vector<std::string_view> splitLines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+constexpr size_t NO_LINE = SIZE_MAX;
+
+// For each line of after, the index of the line of before it was kept from,
+// or NO_LINE for lines the change added. The common prefix and suffix are
+// matched directly and the rest with Myers' O(ND) diff, so the cost grows
+// with the size of the change rather than of the file.
+inline std::vector<size_t> matchLines(const std::vector<std::string_view>& before,
+                                      const std::vector<std::string_view>& after) {
+    std::vector<size_t> match(after.size(), NO_LINE);
+    size_t prefix = 0;
+    while (prefix < before.size() && prefix < after.size() && before[prefix] == after[prefix]) {
+        match[prefix] = prefix;
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < before.size() - prefix && suffix < after.size() - prefix &&
+           before[before.size() - 1 - suffix] == after[after.size() - 1 - suffix]) {
+        match[after.size() - 1 - suffix] = before.size() - 1 - suffix;
+        suffix++;
+    }
+
+    // Myers on the middle part: trace[d] holds the furthest x reached on each
+    // diagonal k = x - y before step d, offset by max
+    const long n = static_cast<long>(before.size() - prefix - suffix);
+    const long m = static_cast<long>(after.size() - prefix - suffix);
+    if (n == 0 || m == 0) {
+        return match;
+    }
+    auto same = [&](long x, long y) { return before[prefix + x] == after[prefix + y]; };
+    const long max = n + m;
+    std::vector<long> v(2 * max + 2, 0);
+    std::vector<std::vector<long>> trace;
+    long finalD = 0;
+    for (long d = 0; d <= max; ++d) {
+        trace.push_back(v);
+        bool done = false;
+        for (long k = -d; k <= d; k += 2) {
+            long x = (k == -d || (k != d && v[max + k - 1] < v[max + k + 1])) ? v[max + k + 1] : v[max + k - 1] + 1;
+            long y = x - k;
+            while (x < n && y < m && same(x, y)) {
+                x++;
+                y++;
+            }
+            v[max + k] = x;
+            if (x >= n && y >= m) {
+                done = true;
+                break;
+            }
+        }
+        if (done) {
+            finalD = d;
+            break;
+        }
+    }
+    long x = n, y = m;
+    for (long d = finalD; d >= 0; --d) {
+        const std::vector<long>& previous = trace[d];
+        long k = x - y;
+        long prevK = (k == -d || (k != d && previous[max + k - 1] < previous[max + k + 1])) ? k + 1 : k - 1;
+        long prevX = d == 0 ? 0 : previous[max + prevK];
+        long prevY = d == 0 ? 0 : prevX - prevK;
+        while (x > prevX && y > prevY) {
+            x--;
+            y--;
+            match[prefix + y] = prefix + x;
+        }
+        x = prevX;
+        y = prevY;
+    }
+    return match;
+}
+
+// The commit each line of a file came from, as computed for one commit that
+// changed the file, cached so the next blame starts from it.
+//
+// File (.cbird/objects/info/blame/xx/rest, named by a hash of commit and
+// path): "CBBL" v1, the 32-byte hash of the blob the lines belong to, the
+// number of distinct origin commits (u32) and their hashes, then the number
+// of runs (u32) and per run its length in lines and its origin (u32 each).
+struct LineOrigins {
+    std::string blob;
+    std::vector<std::string> lines; // Origin commit of each line
+
+    bool load(const std::filesystem::path& path, const std::string& expectedBlob) {
+        std::string data;
+        if (!readFile(path, data) || data.size() < 44 || data.compare(0, 4, "CBBL") != 0 ||
+            getU32(data.data() + 4) != 1 || binaryToHex(data.data() + 8) != expectedBlob) {
+            return false;
+        }
+        size_t pos = 40;
+        uint32_t originCount = getU32(data.data() + pos);
+        pos += 4;
+        if (data.size() < pos + size_t(originCount) * 32 + 4) {
+            return false;
+        }
+        std::vector<std::string> origins;
+        for (uint32_t i = 0; i < originCount; ++i, pos += 32) {
+            origins.push_back(binaryToHex(data.data() + pos));
+        }
+        uint32_t runs = getU32(data.data() + pos);
+        pos += 4;
+        if (data.size() < pos + size_t(runs) * 8) {
+            return false;
+        }
+        lines.clear();
+        for (uint32_t i = 0; i < runs; ++i, pos += 8) {
+            uint32_t length = getU32(data.data() + pos);
+            uint32_t origin = getU32(data.data() + pos + 4);
+            if (origin >= originCount) {
+                return false;
+            }
+            lines.insert(lines.end(), length, origins[origin]);
+        }
+        blob = expectedBlob;
+        return true;
+    }
+
+    bool save(const std::filesystem::path& path) const {
+        std::string binary;
+        if (!hexToBinary(blob, binary)) {
+            return false;
+        }
+        std::string out = "CBBL";
+        putU32(out, 1);
+        out += binary;
+        std::vector<std::string> origins;
+        std::unordered_map<std::string, uint32_t> originIndex;
+        std::string runs;
+        uint32_t runCount = 0;
+        for (size_t i = 0; i < lines.size();) {
+            size_t end = i;
+            while (end < lines.size() && lines[end] == lines[i]) {
+                end++;
+            }
+            auto [it, inserted] = originIndex.try_emplace(lines[i], static_cast<uint32_t>(origins.size()));
+            if (inserted) {
+                origins.push_back(lines[i]);
+            }
+            putU32(runs, static_cast<uint32_t>(end - i));
+            putU32(runs, it->second);
+            runCount++;
+            i = end;
+        }
+        putU32(out, static_cast<uint32_t>(origins.size()));
+        for (const auto& origin : origins) {
+            hexToBinary(origin, binary);
+            out += binary;
+        }
+        putU32(out, runCount);
+        out += runs;
+        std::filesystem::create_directories(path.parent_path());
+        return writeFileAtomic(path, out);
+    }
+};
+
+#endif // CODEBIRD_BLAME_H
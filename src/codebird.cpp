@@ -1,205 +1,28 @@
-#include <iostream>
-#include <vector>
-#include <string>
-#include <ctime>
-#include <fstream>
-#include <filesystem>
-#include <sstream>
-#include <map>
-#include <unordered_set>
-
-// Simple structure for Commit
-struct Commit {
-    std::string commitHash;
-    std::string message;
-    std::string timestamp;
-    std::string changes; // Simple change description
-    std::string branchName; // Branch this commit belongs to
-
-    Commit(std::string msg, std::string changes, std::string branch)
-        : message(msg), changes(changes), branchName(branch) {
-        // Generate timestamp for commit
-        time_t now = time(0);
-        timestamp = ctime(&now);
-
-        // Simple hash for commit (could be a proper hash like SHA1, for now just using timestamp)
-        commitHash = std::to_string(std::hash<std::string>{}(timestamp + message));
-    }
-};
-
-// Repository manager class
-class RepoManager {
-private:
-    std::map<std::string, std::vector<Commit>> branches; // Branches and their commits
-    std::string currentBranch = "main";  // Default branch
-    std::unordered_set<std::string> files; // Set of files in the repo
-    std::string repoDirectory;
-
-    // Utility function to generate commit message from modified files
-    std::string generateCommitMessage(const std::vector<std::string>& modifiedFiles) {
-        std::stringstream message;
-        message << "Modified files: ";
-        for (const auto& file : modifiedFiles) {
-            message << file << " ";
-        }
-        return message.str();
-    }
-
-    // Utility function to join a list of strings with commas
-    std::string join(const std::vector<std::string>& list, const std::string& delimiter) {
-        std::stringstream ss;
-        for (size_t i = 0; i < list.size(); ++i) {
-            ss << list[i];
-            if (i != list.size() - 1) ss << delimiter;
-        }
-        return ss.str();
-    }
-
-    // Simple conflict detection between two sets of changes (just for demonstration)
-    bool hasConflict(const std::vector<std::string>& changes1, const std::vector<std::string>& changes2) {
-        std::unordered_set<std::string> set1(changes1.begin(), changes1.end());
-        std::unordered_set<std::string> set2(changes2.begin(), changes2.end());
-
-        for (const auto& change : changes1) {
-            if (set2.find(change) != set2.end()) {
-                return true; // Conflict found
-            }
-        }
-        return false;
-    }
-
-public:
-    RepoManager() : repoDirectory(".cbird") {
-        if (!std::filesystem::exists(repoDirectory)) {
-            std::filesystem::create_directory(repoDirectory);
-        }
-
-        // Create a default 'main' branch
-        branches["main"] = std::vector<Commit>();
-    }
-
-    void initRepo() {
-        if (std::filesystem::exists(".cbird")) {
-            std::cerr << "Error: Repository already initialized!" << std::endl;
-            return;
-        }
-
-        std::ofstream cbirdFile(".cbird");
-        if (cbirdFile.is_open()) {
-            cbirdFile << "CodeBird Repository\n";
-            cbirdFile.close();
-            std::cout << "Repository initialized! .cbird file created." << std::endl;
-        } else {
-            std::cerr << "Error: Failed to create .cbird file!" << std::endl;
-        }
-    }
-
-    void addFile(std::string filename) {
-        files.insert(filename);
-        std::cout << "File added: " << filename << std::endl;
-    }
-
-    void commitChanges(std::vector<std::string> modifiedFiles) {
-        if (modifiedFiles.empty()) {
-            std::cerr << "Error: No files modified to commit." << std::endl;
-            return;
-        }
-
-        std::string message = generateCommitMessage(modifiedFiles);
-        Commit newCommit(message, "Modified " + join(modifiedFiles, ", "), currentBranch);
-        branches[currentBranch].push_back(newCommit);
-
-        std::cout << "Commit made on branch " << currentBranch << " with message: " << message << std::endl;
-    }
-
-    void showCommitHistory() {
-        std::cout << "Commit History for branch " << currentBranch << ":\n";
-        for (auto& commit : branches[currentBranch]) {
-            std::cout << "Commit Hash: " << commit.commitHash << "\n";
-            std::cout << "Message: " << commit.message << "\n";
-            std::cout << "Timestamp: " << commit.timestamp;
-            std::cout << "Changes: " << commit.changes << "\n\n";
-        }
-    }
-
-    void showStatus() {
-        std::cout << "Currently on branch: " << currentBranch << std::endl;
-    }
-
-    void createBranch(std::string branchName) {
-        if (branches.find(branchName) != branches.end()) {
-            std::cerr << "Error: Branch already exists!" << std::endl;
-            return;
-        }
-        branches[branchName] = std::vector<Commit>();
-        std::cout << "Branch " << branchName << " created." << std::endl;
-    }
-
-    void switchBranch(std::string branchName) {
-        if (branches.find(branchName) == branches.end()) {
-            std::cerr << "Error: Branch does not exist!" << std::endl;
-            return;
+#include "codebird.h"
+
+#include <cstdlib>
+
+// Parses a date given as YYYY-MM-DD [HH:MM[:SS]] in local time or @<seconds since the epoch>
+static bool parseDate(const std::string& text, time_t& time) {
+    if (!text.empty() && text[0] == '@') {
+        try {
+            time = static_cast<time_t>(std::stoll(text.substr(1)));
+            return true;
+        } catch (const std::exception&) {
+            return false;
         }
-        currentBranch = branchName;
-        std::cout << "Switched to branch " << branchName << std::endl;
     }
-
-    void mergeBranch(std::string branchName) {
-        if (branches.find(branchName) == branches.end()) {
-            std::cerr << "Error: Branch does not exist!" << std::endl;
-            return;
-        }
-
-        std::cout << "Merging branch " << branchName << " into " << currentBranch << std::endl;
-
-        std::vector<std::string> changesCurrentBranch;
-        std::vector<std::string> changesOtherBranch;
-
-        // Collect the changes (for simplicity, let's assume each commit has a simple list of changed files)
-        for (const auto& commit : branches[currentBranch]) {
-            changesCurrentBranch.push_back(commit.changes);
+    for (const char* format : {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d"}) {
+        std::tm parts = {};
+        const char* end = strptime(text.c_str(), format, &parts);
+        if (end && *end == '\0') {
+            parts.tm_isdst = -1;
+            time = mktime(&parts);
+            return true;
         }
-
-        for (const auto& commit : branches[branchName]) {
-            changesOtherBranch.push_back(commit.changes);
-        }
-
-        // Check for conflicts
-        if (hasConflict(changesCurrentBranch, changesOtherBranch)) {
-            std::cout << "Conflict detected! Merge cannot be completed automatically." << std::endl;
-            std::cout << "Please resolve conflicts manually in the following files: ";
-            for (const auto& file : files) {
-                std::cout << file << " ";
-            }
-            std::cout << "\nMerge aborted." << std::endl;
-            return;
-        }
-
-        // If no conflicts, perform the merge (basic logic: append commits from the other branch)
-        branches[currentBranch].insert(branches[currentBranch].end(),
-                                       branches[branchName].begin(), branches[branchName].end());
-
-        std::cout << "Merge completed successfully!" << std::endl;
     }
-
-    // Help function to show available commands
-    void showHelp() {
-        std::cout << "CodeBird - A simple version control system\n\n";
-        std::cout << "Usage:\n";
-        std::cout << "  codebird <command> <repo_name> [options]\n\n";
-        std::cout << "Commands:\n";
-        std::cout << "  init                  Initialize a new CodeBird repository\n";
-        std::cout << "  add <file>            Add a file to the repository\n";
-        std::cout << "  commit <file>         Commit changes made to the repository\n";
-        std::cout << "  log                   Show the commit history of the current branch\n";
-        std::cout << "  status                Show the current status of the repository\n";
-        std::cout << "  create <branch_name>  Create a new branch\n";
-        std::cout << "  switch <branch_name>  Switch to an existing branch\n";
-        std::cout << "  merge <branch_name>   Merge a branch into the current branch\n";
-        std::cout << "  --help, -h            Show this help message\n";
-        std::cout << "\nFor more information, see the CodeBird documentation.\n";
-    }
-};
+    return false;
+}
 
 // Function to handle the CLI commands
 void handleCLI(int argc, char **argv) {
@@ -209,6 +32,7 @@ void handleCLI(int argc, char **argv) {
     }
 
     std::string command = argv[1];
+    TRACE_SCOPE("command", "cli", command);
 
     // If the user requests help
     if (command == "--help" || command == "-h") {
@@ -217,29 +41,146 @@ void handleCLI(int argc, char **argv) {
         return;
     }
 
+    // clone creates its repository in a new directory, so it runs from there
+    if (command == "clone") {
+        bool partial = false;
+        std::string promisor;
+        std::vector<std::string> paths;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--filter=blob:none") {
+                partial = true;
+            } else if (arg.rfind("--promisor=", 0) == 0) {
+                promisor = arg.substr(11);
+                partial = true;
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "Unknown option for clone: " << arg << std::endl;
+                return;
+            } else {
+                paths.push_back(arg);
+            }
+        }
+        if (paths.size() != 2) {
+            std::cerr << "Error: Usage: codebird clone <source> <directory> [--filter=blob:none]" << std::endl;
+            return;
+        }
+        std::filesystem::path source = std::filesystem::absolute(paths[0]).lexically_normal();
+        if (source.has_parent_path() && source.filename().empty()) {
+            source = source.parent_path();
+        }
+        std::error_code ec;
+        if (std::filesystem::exists(paths[1]) && !std::filesystem::is_empty(paths[1], ec)) {
+            std::cerr << "Error: " << paths[1] << " already exists and is not empty!" << std::endl;
+            return;
+        }
+        std::filesystem::create_directories(paths[1], ec);
+        std::filesystem::current_path(paths[1], ec);
+        if (ec) {
+            std::cerr << "Error: Cannot create " << paths[1] << ": " << ec.message() << std::endl;
+            return;
+        }
+        RepoManager clone;
+        clone.cloneFrom(source, partial, promisor);
+        return;
+    }
+
     std::string repoName = argv[2];
     RepoManager repo;
 
     if (command == "init") {
-        repo.initRepo();
+        std::string objectFormat = "sha256";
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.rfind("--object-format=", 0) == 0) {
+                objectFormat = arg.substr(16);
+            } else {
+                std::cerr << "Unknown option for init: " << arg << std::endl;
+                return;
+            }
+        }
+        repo.initRepo(objectFormat);
     } else if (command == "add") {
         if (argc < 4) {
             std::cerr << "Error: No file specified to add." << std::endl;
             return;
         }
         std::string file = argv[3];
-        repo.addFile(file);
+        bool force = argc > 4 && (std::string(argv[4]) == "-f" || std::string(argv[4]) == "--force");
+        repo.addFile(file, force);
     } else if (command == "commit") {
         if (argc < 4) {
             std::cerr << "Error: No file specified for commit." << std::endl;
             return;
         }
         std::string file = argv[3];
-        repo.commitChanges({file});
+        std::string message;
+        if (argc >= 6 && std::string(argv[4]) == "-m") {
+            message = argv[5];
+        } else if (argc > 4) {
+            std::cerr << "Error: Usage: codebird commit <repo_name> <file> [-m <message>]" << std::endl;
+            return;
+        }
+        repo.commitChanges({file}, message);
     } else if (command == "log") {
-        repo.showCommitHistory();
+        LogOptions options;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            time_t time;
+            if (arg == "--") {
+                for (++i; i < argc; ++i) {
+                    std::string path = argv[i];
+                    while (path.size() > 1 && path.back() == '/') {
+                        path.pop_back();
+                    }
+                    options.paths.push_back(path == "." ? "" : path);
+                }
+            } else if (arg == "-n" && i + 1 < argc) {
+                try {
+                    options.maxCount = std::stoull(argv[++i]);
+                } catch (const std::exception&) {
+                    std::cerr << "Error: Invalid number of commits: " << argv[i] << std::endl;
+                    return;
+                }
+            } else if (arg.rfind("--since=", 0) == 0 || arg.rfind("--until=", 0) == 0) {
+                if (!parseDate(arg.substr(8), time)) {
+                    std::cerr << "Error: Invalid date: " << arg.substr(8) << std::endl;
+                    return;
+                }
+                (arg[2] == 's' ? options.since : options.until) = time;
+            } else if (arg.rfind("--author=", 0) == 0) {
+                options.author = arg.substr(9);
+            } else if (!arg.empty() && arg[0] != '-') {
+                options.paths.push_back(arg); // "log <file>" without "--"
+            } else if (arg.rfind("--grep=", 0) == 0) {
+                options.grep = arg.substr(7);
+            } else if (arg == "--all") {
+                options.all = true;
+            } else if (arg == "--date-order") {
+                options.order = LogOrder::Date;
+            } else if (arg == "--topo-order") {
+                options.order = LogOrder::Topo;
+            } else {
+                std::cerr << "Error: Usage: codebird log <repo_name> [--all] [--date-order | --topo-order] "
+                          << "[-n <count>] [--since=<date>] [--until=<date>] [--author=<name>] [--grep=<query>] "
+                          << "[-- <path>...]"
+                          << std::endl;
+                return;
+            }
+        }
+        repo.showCommitHistory(options);
     } else if (command == "status") {
         repo.showStatus();
+    } else if (command == "stats") {
+        size_t lastOperations = 20;
+        if (argc >= 5 && std::string(argv[3]) == "--last") {
+            try {
+                lastOperations = std::stoull(argv[4]);
+            } catch (const std::exception&) {
+                std::cerr << "Error: Invalid number of operations: " << argv[4] << std::endl;
+                return;
+            }
+        }
+        repo.showStats(lastOperations);
     } else if (command == "create") {
         if (argc < 4) {
             std::cerr << "Error: No branch name specified." << std::endl;
@@ -254,6 +195,92 @@ void handleCLI(int argc, char **argv) {
         }
         std::string branchName = argv[3];
         repo.switchBranch(branchName);
+    } else if (command == "checkout") {
+        time_t time;
+        if (argc < 5 || std::string(argv[3]) != "--at") {
+            std::cerr << "Error: Usage: codebird checkout <repo_name> --at <date>" << std::endl;
+            return;
+        }
+        if (!parseDate(argv[4], time)) {
+            std::cerr << "Error: Invalid date: " << argv[4] << std::endl;
+            return;
+        }
+        repo.checkoutAt(time);
+    } else if (command == "serve") {
+        std::string socket = argc > 3 && std::string(argv[3]).rfind("--socket=", 0) == 0 ? argv[3] + 9 : "";
+        if (argc > 3 && std::string(argv[3]) == "--stdio") {
+            repo.serveStdio();
+        } else if (socket.empty()) {
+            std::cerr << "Error: Usage: codebird serve <repo_name> --socket=<path> | --stdio" << std::endl;
+            return;
+        } else {
+            repo.serve(socket);
+        }
+    } else if (command == "fetch" || command == "push") {
+        if (argc < 4) {
+            std::cerr << "Error: Usage: codebird " << command << " <repo_name> <remote> [<branch>[:<branch>]...]"
+                      << std::endl;
+            return;
+        }
+        std::vector<std::string> refspecs(argv + 4, argv + argc);
+        if (command == "fetch") {
+            repo.fetch(argv[3], refspecs);
+        } else {
+            repo.push(argv[3], refspecs);
+        }
+    } else if (command == "worktree") {
+        std::string action = argc > 3 ? argv[3] : "";
+        if (action == "add" && argc == 6) {
+            repo.addWorktree(argv[4], argv[5]);
+        } else if (action == "list") {
+            repo.listWorktrees();
+        } else {
+            std::cerr << "Error: Usage: codebird worktree <repo_name> add <path> <branch> | list" << std::endl;
+        }
+    } else if (command == "sparse") {
+        std::string action = argc > 3 ? argv[3] : "";
+        if (action == "set" && argc > 4) {
+            repo.setSparseCone(std::vector<std::string>(argv + 4, argv + argc));
+        } else if (action == "list") {
+            repo.listSparseCone();
+        } else if (action == "disable") {
+            repo.setSparseCone(std::nullopt);
+        } else {
+            std::cerr << "Error: Usage: codebird sparse <repo_name> set <dir>... | list | disable" << std::endl;
+        }
+    } else if (command == "blame") {
+        if (argc < 4) {
+            std::cerr << "Error: No file specified to blame." << std::endl;
+            return;
+        }
+        std::string path = argv[3];
+        if (path.compare(0, 2, "./") == 0) {
+            path = path.substr(2);
+        }
+        repo.blame(path);
+    } else if (command == "grep") {
+        bool ignoreCase = false, fixedStrings = false;
+        std::optional<std::string> pattern;
+        std::vector<std::string> revisions;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (!pattern && arg == "-i") {
+                ignoreCase = true;
+            } else if (!pattern && arg == "-F") {
+                fixedStrings = true;
+            } else if (!pattern && arg == "-e" && i + 1 < argc) {
+                pattern = argv[++i];
+            } else if (!pattern) {
+                pattern = arg;
+            } else {
+                revisions.push_back(arg);
+            }
+        }
+        if (!pattern) {
+            std::cerr << "Error: No pattern specified." << std::endl;
+            return;
+        }
+        repo.grep(*pattern, revisions, ignoreCase, fixedStrings);
     } else if (command == "merge") {
         if (argc < 4) {
             std::cerr << "Error: No branch name specified to merge." << std::endl;
@@ -261,12 +288,70 @@ void handleCLI(int argc, char **argv) {
         }
         std::string branchName = argv[3];
         repo.mergeBranch(branchName);
+    } else if (command == "branch") {
+        bool verbose = false;
+        std::string prefix;
+        for (int i = 3; i < argc; ++i) {
+            std::string option = argv[i];
+            if (option == "-v") {
+                verbose = true;
+            } else if (option == "--list" && i + 1 < argc) {
+                prefix = argv[++i];
+            } else if ((option == "-d" || option == "-u" || option == "--contains") && i + 1 < argc) {
+                if (option == "-d") {
+                    repo.deleteBranch(argv[i + 1]);
+                } else if (option == "-u") {
+                    repo.setUpstream(argv[i + 1]);
+                } else {
+                    repo.showBranchesContaining(argv[i + 1]);
+                }
+                return;
+            } else if (option.rfind("--set-upstream-to=", 0) == 0) {
+                repo.setUpstream(option.substr(18));
+                return;
+            } else {
+                std::cerr << "Error: Usage: codebird branch <repo_name> [-v] [--list <prefix>] | -d <branch> | "
+                          << "-u <upstream> | --contains <commit>" << std::endl;
+                return;
+            }
+        }
+        repo.listBranches(verbose, prefix);
+    } else if (command == "show") {
+        if (argc < 4) {
+            std::cerr << "Error: No revision specified to show." << std::endl;
+            return;
+        }
+        repo.showObject(argv[3]);
+    } else if (command == "repack") {
+        repo.repack();
     } else {
         std::cerr << "Unknown command: " << command << std::endl;
     }
 }
 
 int main(int argc, char** argv) {
-    handleCLI(argc, argv);
+    // --trace=<file> may appear anywhere; strip it before dispatching the command
+    std::vector<char*> args;
+    std::string tracePath;
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--trace=", 0) == 0) {
+            tracePath = arg.substr(8);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (tracePath.empty()) {
+        if (const char* env = std::getenv("CODEBIRD_TRACE")) {
+            tracePath = env;
+        }
+    }
+    if (!tracePath.empty()) {
+        trace::Tracer::instance().start(tracePath);
+    }
+
+    handleCLI(static_cast<int>(args.size()), args.data());
+
+    trace::Tracer::instance().finish();
     return 0;
 }
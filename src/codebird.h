@@ -0,0 +1,3861 @@
+#ifndef CODEBIRD_H
+#define CODEBIRD_H
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <ctime>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "blame.h"
+#include "commit.h"
+#include "commit_graph.h"
+#include "file_util.h"
+#include "grep.h"
+#include "ignore.h"
+#include "message_index.h"
+#include "object_reader.h"
+#include "object_store.h"
+#include "output.h"
+#include "promisor.h"
+#include "reftable.h"
+#include "sparse.h"
+#include "time_index.h"
+#include "trace.h"
+#include "wal.h"
+
+// Repository counters kept in .cbird/meta so `stats` never walks the object store
+struct RepoStats {
+    uint64_t commits = 0;
+    uint64_t trees = 0;
+    uint64_t blobs = 0;
+    uint64_t looseObjects = 0;
+    uint64_t looseBytes = 0;
+    uint64_t packs = 0;
+    uint64_t packedObjects = 0;
+    uint64_t packBytes = 0;
+    uint64_t indexEntries = 0;
+    uint64_t branches = 0;
+
+    void load(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        std::string key;
+        uint64_t value;
+        while (in >> key >> value) {
+            if (key == "commits") commits = value;
+            else if (key == "trees") trees = value;
+            else if (key == "blobs") blobs = value;
+            else if (key == "loose_objects") looseObjects = value;
+            else if (key == "loose_bytes") looseBytes = value;
+            else if (key == "packs") packs = value;
+            else if (key == "packed_objects") packedObjects = value;
+            else if (key == "pack_bytes") packBytes = value;
+            else if (key == "index_entries") indexEntries = value;
+            else if (key == "branches") branches = value;
+        }
+    }
+
+    bool save(const std::filesystem::path& path) const {
+        std::stringstream ss;
+        ss << "commits " << commits << "\n";
+        ss << "trees " << trees << "\n";
+        ss << "blobs " << blobs << "\n";
+        ss << "loose_objects " << looseObjects << "\n";
+        ss << "loose_bytes " << looseBytes << "\n";
+        ss << "packs " << packs << "\n";
+        ss << "packed_objects " << packedObjects << "\n";
+        ss << "pack_bytes " << packBytes << "\n";
+        ss << "index_entries " << indexEntries << "\n";
+        ss << "branches " << branches << "\n";
+        return writeFileAtomic(path, ss.str());
+    }
+
+    // Combines the counters on disk with the changes made since baseline was
+    // loaded, so concurrent processes do not overwrite each other's counts.
+    // Object and branch counts are deltas; pack and index figures are taken
+    // as set by whichever process changed them.
+    static RepoStats merge(const RepoStats& onDisk, const RepoStats& baseline, const RepoStats& current) {
+        auto delta = [](uint64_t disk, uint64_t base, uint64_t now) {
+            int64_t value = static_cast<int64_t>(disk) + static_cast<int64_t>(now - base);
+            return static_cast<uint64_t>(std::max<int64_t>(value, 0));
+        };
+        auto latest = [](uint64_t disk, uint64_t base, uint64_t now) { return now != base ? now : disk; };
+        RepoStats merged;
+        merged.commits = delta(onDisk.commits, baseline.commits, current.commits);
+        merged.trees = delta(onDisk.trees, baseline.trees, current.trees);
+        merged.blobs = delta(onDisk.blobs, baseline.blobs, current.blobs);
+        merged.looseObjects = delta(onDisk.looseObjects, baseline.looseObjects, current.looseObjects);
+        merged.looseBytes = delta(onDisk.looseBytes, baseline.looseBytes, current.looseBytes);
+        merged.branches = delta(onDisk.branches, baseline.branches, current.branches);
+        merged.packs = latest(onDisk.packs, baseline.packs, current.packs);
+        merged.packedObjects = latest(onDisk.packedObjects, baseline.packedObjects, current.packedObjects);
+        merged.packBytes = latest(onDisk.packBytes, baseline.packBytes, current.packBytes);
+        merged.indexEntries = latest(onDisk.indexEntries, baseline.indexEntries, current.indexEntries);
+        return merged;
+    }
+
+    // Accounts for an object written to the store
+    void countObject(ObjectType type, uint64_t bytes) {
+        if (type == ObjectType::Commit) commits++;
+        else if (type == ObjectType::Tree) trees++;
+        else blobs++;
+        looseObjects++;
+        looseBytes += bytes;
+    }
+};
+
+// Order of `log`: by generation (children before parents), by commit date
+// among commits whose children were all shown, or by lines of history
+enum class LogOrder {
+    Default,
+    Date,
+    Topo,
+};
+
+// Which commits `log` shows; every filter is optional
+struct LogOptions {
+    bool all = false; // Every branch rather than the current one
+    LogOrder order = LogOrder::Default;
+    size_t maxCount = SIZE_MAX;
+    std::optional<time_t> since; // Only commits made at or after this time
+    std::optional<time_t> until; // Only commits made at or before this time
+    std::string author; // Only commits whose author contains this text
+    std::string grep; // Only commits whose message matches this query (see MessageQuery)
+    std::vector<std::string> paths; // Only commits that change one of these files or directories
+};
+
+// Repository manager class
+class RepoManager {
+private:
+    std::string currentBranch = "main";  // Default branch
+    std::map<std::string, std::string> files; // Tracked files and their blob hashes (the index)
+    std::map<std::string, std::string> treeCache; // Directory ("" or "dir/") -> tree hash of its index entries
+    std::map<std::string, std::string> sparseDirs; // Directory ("dir/") outside the sparse cone -> its tree hash
+    SparseCone sparse; // From .cbird/sparse-checkout
+    std::string indexBranch; // Branch and commit this process last saw the index committed as
+    std::string indexBase;
+    std::string pastCommit; // Commit of indexBranch's history checkout --at put in the index; no commits until switch
+    std::string repoDirectory; // This worktree's HEAD, index and sparse cone
+    std::string commonDirectory; // Everything the worktrees share; repoDirectory itself except in linked worktrees
+    RefStack refs; // Branch tips as refs/heads/<name> ("" while a branch has no commits)
+    RefStack::Snapshot pinnedRefs; // Generation pinned while a read-only command runs
+    WriteAheadLog wal; // Ref transactions in flight
+    PostingIndex messages; // Message tokens -> commits, unless messageindex = off
+    PostingIndex pathIndex; // Changed files and "dir/" directories -> commits, unless pathindex = off
+    ObjectStore objects;
+    ObjectReader reader; // Cached, parsed access to objects
+    std::unique_ptr<PromisorRemote> promisor; // Where a partial clone fetches missing objects from
+    std::mutex fetchMutex;
+    std::mutex serveMutex; // One pack service at a time in serve()
+    RepoStats stats;
+    RepoStats statsBaseline; // Counters as loaded, to find this process's changes
+    CacheCounters loggedParsed; // Cache counters already written to the cache log
+    CacheCounters loggedRaw;
+    uint64_t loggedLookups = 0;
+    static constexpr size_t CACHE_LOG_LIMIT = 1000;
+    bool indexLoaded = false;
+    bool indexDirty = false;
+    bool statsDirty = false;
+    std::shared_ptr<const PackFile> bitmapPack; // Pack the loaded bitmaps index into
+    BitmapIndex bitmaps;
+    bool bitmapsLoaded = false;
+    static constexpr size_t BITMAP_INTERVAL = 64; // Every n-th newly packed commit gets a bitmap
+    std::map<std::string, std::string> config; // Settings from .cbird/config
+    CommitGraph graph;
+    bool graphLoaded = false;
+    bool graphDirty = false;
+    IgnoreRules ignoreRules; // From .cbirdignore, loaded on first use
+    bool ignoreRulesLoaded = false;
+    std::string fsyncMode = "batch"; // off, batch (one filesystem flush per ref update) or always (every file)
+    bool unsyncedObjects = false; // Objects written since the last flush to disk
+    static constexpr uint32_t COMMIT_BACKOFF_MS = 64; // Longest wait between attempts to move a contended branch
+    static constexpr uint32_t GRAPH_REFRESH = 256; // Rewrite the graph file once this many commits are missing from it
+
+    // Utility function to generate commit message from modified files
+    std::string generateCommitMessage(const std::vector<std::string>& modifiedFiles) {
+        std::stringstream message;
+        message << "Modified files: ";
+        for (const auto& file : modifiedFiles) {
+            message << file << " ";
+        }
+        return message.str();
+    }
+
+    // Utility function to join a list of strings with commas
+    std::string join(const std::vector<std::string>& list, const std::string& delimiter) {
+        std::stringstream ss;
+        for (size_t i = 0; i < list.size(); ++i) {
+            ss << list[i];
+            if (i != list.size() - 1) ss << delimiter;
+        }
+        return ss.str();
+    }
+
+    // Simple conflict detection between two sets of changes (just for demonstration)
+    bool hasConflict(const std::vector<std::string>& changes1, const std::vector<std::string>& changes2) {
+        std::unordered_set<std::string> set1(changes1.begin(), changes1.end());
+        std::unordered_set<std::string> set2(changes2.begin(), changes2.end());
+
+        for (const auto& change : changes1) {
+            if (set2.find(change) != set2.end()) {
+                return true; // Conflict found
+            }
+        }
+        return false;
+    }
+
+    // Files private to this worktree: HEAD, index, sparse-checkout
+    std::filesystem::path repoPath(const std::string& name) const {
+        return std::filesystem::path(repoDirectory) / name;
+    }
+
+    // Files all worktrees share: config, objects, ref tables, counters
+    std::filesystem::path commonPath(const std::string& name) const {
+        return std::filesystem::path(commonDirectory) / name;
+    }
+
+    // The directory holding the shared files of a .cbird directory: itself,
+    // or for a linked worktree the one its commondir file names
+    static std::filesystem::path commonDirOf(const std::filesystem::path& repoDir) {
+        std::string common;
+        if (!readFile(repoDir / "commondir", common)) {
+            return repoDir;
+        }
+        common = common.substr(0, common.find('\n'));
+        return common.empty() ? repoDir : std::filesystem::path(common);
+    }
+
+    // Every worktree as its directory and checked-out branch: the main one
+    // first, then the linked ones listed in .cbird/worktrees (branch "" when
+    // the directory is gone)
+    std::vector<std::pair<std::filesystem::path, std::string>> worktrees() const {
+        auto headOf = [](const std::filesystem::path& dir) {
+            std::string head;
+            readFile(dir / "HEAD", head);
+            return head.substr(0, head.find('\n'));
+        };
+        std::filesystem::path common = std::filesystem::weakly_canonical(commonDirectory);
+        std::vector<std::pair<std::filesystem::path, std::string>> result = {{common.parent_path(), headOf(common)}};
+        std::ifstream in(commonPath("worktrees"));
+        for (std::string line; std::getline(in, line);) {
+            if (!line.empty()) {
+                result.push_back({line, headOf(std::filesystem::path(line) / ".cbird")});
+            }
+        }
+        return result;
+    }
+
+    // The worktree that has a branch checked out, other than this one unless
+    // includingThis; "" if there is none
+    std::string worktreeWith(const std::string& branchName, bool includingThis) const {
+        std::filesystem::path here = std::filesystem::weakly_canonical(std::filesystem::current_path());
+        for (const auto& [dir, branch] : worktrees()) {
+            if (branch == branchName && (includingThis || dir != here)) {
+                return dir.string();
+            }
+        }
+        return "";
+    }
+
+    static std::string refName(const std::string& branchName) {
+        return "refs/heads/" + branchName;
+    }
+
+    // Branch named by a refs/heads/<name> ref; "" for any other ref
+    static std::string branchOfRef(const std::string& ref) {
+        const std::string prefix = refName("");
+        return ref.rfind(prefix, 0) == 0 ? ref.substr(prefix.size()) : "";
+    }
+
+    // Refs as seen by the running command: the generation a read-only command
+    // pinned, otherwise the latest one this process knows of
+    RefStack::Snapshot refView() const {
+        return pinnedRefs ? pinnedRefs : refs.snapshot();
+    }
+
+    // Pins the newest published ref generation for the life of a read-only
+    // command. It takes no lock, so readers never wait for a writer, and every
+    // branch the command looks at comes from the same point in time.
+    class ReadSnapshot {
+    private:
+        RepoManager& repo;
+
+    public:
+        explicit ReadSnapshot(RepoManager& repo) : repo(repo) {
+            repo.refs.reload();
+            repo.pinnedRefs = repo.refs.snapshot();
+        }
+        ~ReadSnapshot() {
+            repo.pinnedRefs.reset();
+        }
+        ReadSnapshot(const ReadSnapshot&) = delete;
+        ReadSnapshot& operator=(const ReadSnapshot&) = delete;
+    };
+
+    // Tip of a branch; false if the branch does not exist. main always exists.
+    bool readBranch(const std::string& branchName, std::string& tip) const {
+        if (refView()->lookup(refName(branchName), tip)) {
+            return true;
+        }
+        tip.clear();
+        return branchName == "main";
+    }
+
+    bool branchExists(const std::string& branchName) const {
+        std::string tip;
+        return readBranch(branchName, tip);
+    }
+
+    std::string branchTip(const std::string& branchName) const {
+        std::string tip;
+        readBranch(branchName, tip);
+        return tip;
+    }
+
+    // Branches and their tips in name order, optionally only those whose name starts with prefix
+    std::vector<std::pair<std::string, std::string>> listBranchTips(const std::string& prefix = "") const {
+        std::vector<std::pair<std::string, std::string>> result;
+        refView()->forEach(refName(prefix), [&result](const std::string& name, const std::string& tip) {
+            result.push_back({name.substr(refName("").size()), tip});
+            return true;
+        });
+        auto main = std::lower_bound(result.begin(), result.end(), std::make_pair(std::string("main"), std::string()));
+        if (std::string("main").compare(0, prefix.size(), prefix) == 0 && (main == result.end() || main->first != "main")) {
+            result.insert(main, {"main", ""});
+        }
+        return result;
+    }
+
+    // Writes an object and keeps the repository counters up to date
+    std::string writeObject(ObjectType type, const std::string& payload, const std::string& knownHash = "") {
+        bool created = false;
+        uint64_t bytes = 0;
+        std::string hash = knownHash.empty()
+            ? objects.write(type, payload, &created, &bytes)
+            : objects.writeHashed(type, payload, knownHash, &created, &bytes);
+        if (created) {
+            stats.countObject(type, bytes);
+            statsDirty = true;
+            unsyncedObjects = true;
+        }
+        return hash;
+    }
+
+    bool readCommit(const std::string& hash, Commit& commit) {
+        std::shared_ptr<const Commit> cached = reader.readCommit(hash);
+        if (!cached) {
+            return false;
+        }
+        commit = *cached;
+        return true;
+    }
+
+    // Stored tip of a branch; nullopt if it has no ref (main before its first update)
+    std::optional<std::string> storedTip(const std::string& branchName) const {
+        std::string tip;
+        if (!refs.lookup(refName(branchName), tip)) {
+            return std::nullopt;
+        }
+        return tip;
+    }
+
+    // Makes the objects written so far durable before a ref points at them; in
+    // batch mode one filesystem flush covers all of them instead of one fsync each
+    void syncObjects() {
+        if (unsyncedObjects && fsyncMode == "batch") {
+            TRACE_SCOPE("objects.sync", "io");
+            syncFilesystem(commonPath("objects"));
+        }
+        unsyncedObjects = false;
+    }
+
+    // Fetches the objects of a batch that are missing here from the promisor
+    // remote of a partial clone, in one request, and stores them; the number
+    // fetched. Without a promisor nothing is missing on purpose, so nothing
+    // is fetched.
+    size_t fetchObjects(const std::vector<std::string>& hashes) {
+        if (!promisor) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(fetchMutex);
+        std::vector<std::string> missing;
+        std::unordered_set<std::string> seen;
+        for (const auto& hash : hashes) {
+            if (!hash.empty() && seen.insert(hash).second && !objects.exists(hash)) {
+                missing.push_back(hash);
+            }
+        }
+        if (missing.empty()) {
+            return 0;
+        }
+        TRACE_SCOPE("promisor.fetch", "remote", missing.size(), "objects");
+        size_t fetched = 0;
+        bool reached = promisor->fetch(missing, [&](const std::string& hash, ObjectType type, const std::string& payload) {
+            if (objects.hashObject(type, payload) != hash) {
+                std::cerr << "Error: Promisor remote sent a corrupt object " << hash << "!" << std::endl;
+            } else if (!writeObject(type, payload, hash).empty()) {
+                fetched++;
+            }
+        });
+        if (!reached) {
+            std::cerr << "Error: Cannot reach promisor remote " << promisor->where() << "!" << std::endl;
+        }
+        return fetched;
+    }
+
+    // Sets up fetching from the promisor remote the config names, if any
+    void connectPromisor() {
+        if (config.count("promisor")) {
+            // A partial clone: blobs it lacks are fetched when something reads them
+            promisor = std::make_unique<PromisorRemote>(config["promisor"]);
+            objects.setMissingHandler([this](const std::string& hash) { return fetchObjects({hash}) > 0; });
+        }
+    }
+
+    // Gives this repository the object files of another on the same
+    // filesystem as hardlinks, copying where a link cannot be made. Loose
+    // objects, packs and most of objects/info are only ever replaced by
+    // rename, so the two repositories can share them; the journals appended
+    // in place (*.log, info/times/) are copied.
+    bool linkObjects(const std::filesystem::path& sourceDir, size_t& linked, size_t& copied) {
+        TRACE_SCOPE("clone.link", "remote");
+        std::filesystem::path from = sourceDir / "objects";
+        std::filesystem::path to = commonPath("objects");
+        std::error_code ec;
+        std::filesystem::create_directories(to, ec);
+        for (std::filesystem::recursive_directory_iterator it(from, ec), end; !ec && it != end; it.increment(ec)) {
+            std::filesystem::path relative = it->path().lexically_relative(from);
+            std::filesystem::path target = to / relative;
+            std::string name = relative.filename().string();
+            if (it->is_directory(ec)) {
+                std::filesystem::create_directories(target, ec);
+                continue;
+            }
+            if (!it->is_regular_file(ec) || name.compare(0, 4, "tmp-") == 0 || relative.extension() == ".tmp") {
+                continue; // Written by something still running
+            }
+            bool appended = relative.extension() == ".log" || relative.generic_string().compare(0, 11, "info/times/") == 0;
+            if (!appended) {
+                std::filesystem::create_hard_link(it->path(), target, ec);
+                if (!ec) {
+                    linked++;
+                    continue;
+                }
+                ec.clear();
+            }
+            std::filesystem::copy_file(it->path(), target, std::filesystem::copy_options::overwrite_existing, ec);
+            copied++;
+        }
+        if (ec) {
+            std::cerr << "Error: Failed to link the objects of " << sourceDir.parent_path().string() << ": " << ec.message()
+                      << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Writes the commits and trees the branches reach in another repository
+    // into one pack here, leaving the blobs to the promisor; the number packed
+    bool packHistory(const ObjectStore& source, const RefStack::Changes& branches, size_t& packed) {
+        TRACE_SCOPE("clone.pack", "remote");
+        PackWriter writer;
+        if (!writer.begin(objects.packDir())) {
+            std::cerr << "Error: Failed to create a pack in " << objects.packDir() << "!" << std::endl;
+            return false;
+        }
+        std::unordered_set<std::string> seen;
+        std::string packedHashes;
+        auto copy = [&](const std::string& hash, ObjectType expected, std::string& payload) {
+            ObjectType type;
+            if (!source.read(hash, type, payload) || type != expected) {
+                std::cerr << "Error: Missing object " << hash << " in the source repository!" << std::endl;
+                return false;
+            }
+            writer.add(hash, type, payload);
+            packedHashes += hash;
+            (type == ObjectType::Commit ? stats.commits : stats.trees)++;
+            return true;
+        };
+        // Commits first, then their trees
+        std::vector<std::string> commits, trees;
+        for (const auto& [name, tip] : branches) {
+            if (tip && !tip->empty()) {
+                commits.push_back(*tip);
+            }
+        }
+        while (!commits.empty()) {
+            std::string hash = std::move(commits.back());
+            commits.pop_back();
+            std::string payload;
+            Commit commit;
+            if (!seen.insert(hash).second) {
+                continue;
+            }
+            if (!copy(hash, ObjectType::Commit, payload) || !Commit::parse(hash, payload, commit)) {
+                return false;
+            }
+            commits.insert(commits.end(), commit.parents.begin(), commit.parents.end());
+            trees.push_back(commit.treeHash);
+        }
+        while (!trees.empty()) {
+            std::string hash = std::move(trees.back());
+            trees.pop_back();
+            std::string payload;
+            std::vector<TreeEntry> entries;
+            if (hash.empty() || !seen.insert(hash).second) {
+                continue;
+            }
+            if (!copy(hash, ObjectType::Tree, payload) || !parseTree(payload, entries)) {
+                return false;
+            }
+            for (const auto& entry : entries) {
+                if (entry.type == ObjectType::Tree) {
+                    trees.push_back(entry.hash);
+                }
+            }
+        }
+        std::filesystem::path packPath = writer.finish(hashing::toHex(hashing::sha256(packedHashes)));
+        if (packPath.empty()) {
+            std::cerr << "Error: Failed to write the pack!" << std::endl;
+            return false;
+        }
+        if (fsyncMode != "off") {
+            syncFilesystem(objects.packDir());
+        }
+        objects.reloadPacks();
+        std::error_code ec;
+        packed = writer.objectCount();
+        stats.packs = 1;
+        stats.packedObjects = packed;
+        stats.packBytes = std::filesystem::file_size(packPath, ec);
+        statsDirty = true;
+        return true;
+    }
+
+    // Points a branch at tip as a compare-and-swap: when expected is given the
+    // branch must still have that stored tip (nullopt: must not exist), else the
+    // update is Stale and nothing changes. The update is recorded in the
+    // write-ahead log once the objects it refers to are durable.
+    RefUpdateStatus setBranch(const std::string& branchName, const std::string& tip,
+                              std::optional<std::optional<std::string>> expected = std::nullopt) {
+        syncObjects();
+        std::string ref = refName(branchName);
+        RefStack::Expected checks;
+        if (expected) {
+            checks[ref] = *expected;
+        }
+        std::string transaction = wal.begin(ref, expected ? *expected : storedTip(branchName), tip);
+        RefUpdateStatus status = transaction.empty() ? RefUpdateStatus::Failed : refs.update({{ref, tip}}, checks);
+        wal.end(transaction);
+        if (status == RefUpdateStatus::Failed) {
+            std::cerr << "Error: Failed to update branch " << branchName << "!" << std::endl;
+        }
+        return status;
+    }
+
+    // Resolves ref transactions left unfinished by processes that crashed:
+    // rolled forward if the ref still has its old value and the new commit exists
+    void recoverTransactions() {
+        for (const auto& entry : wal.abandoned()) {
+            std::string current;
+            bool present = refs.lookup(entry.ref, current);
+            bool atOld = present == entry.oldValue.has_value() && (!present || current == *entry.oldValue);
+            if (atOld && (entry.newValue.empty() || objects.exists(entry.newValue))) {
+                refs.update({{entry.ref, entry.newValue}}, {{entry.ref, entry.oldValue}});
+            }
+            wal.end(entry.id);
+        }
+        wal.truncateIfIdle();
+    }
+
+    // .cbird/config: a "CodeBird Repository" line followed by "key = value" settings
+    static std::map<std::string, std::string> loadConfig(const std::filesystem::path& path) {
+        std::map<std::string, std::string> config;
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                continue;
+            }
+            size_t keyEnd = line.find_last_not_of(" \t", eq - 1);
+            size_t valueStart = line.find_first_not_of(" \t", eq + 1);
+            if (keyEnd == std::string::npos || valueStart == std::string::npos) {
+                continue;
+            }
+            config[line.substr(0, keyEnd + 1)] = line.substr(valueStart);
+        }
+        return config;
+    }
+
+    // Sets one config key and rewrites .cbird/config
+    bool setConfig(const std::string& key, const std::string& value) {
+        config[key] = value;
+        std::string data = "CodeBird Repository\n";
+        for (const auto& [name, setting] : config) {
+            data += name + " = " + setting + "\n";
+        }
+        return writeFileAtomic(commonPath("config"), data);
+    }
+
+    // Moves refs from one-file-per-branch storage (refs/heads/<name>) into the ref tables
+    void migrateLooseRefs() {
+        std::filesystem::path headsDir = commonPath("refs") / "heads";
+        if (refs.exists() || !std::filesystem::exists(headsDir)) {
+            return;
+        }
+        RefStack::Changes changes;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(headsDir)) {
+            if (!entry.is_regular_file() || entry.path().extension() == ".tmp") {
+                continue;
+            }
+            std::string tip;
+            readFile(entry.path(), tip);
+            while (!tip.empty() && (tip.back() == '\n' || tip.back() == '\r')) {
+                tip.pop_back();
+            }
+            changes[refName(entry.path().lexically_relative(headsDir).generic_string())] = tip;
+        }
+        changes.emplace(refName("main"), "");
+        if (refs.update(changes) != RefUpdateStatus::Ok) {
+            std::cerr << "Error: Failed to migrate refs to .cbird/reftable!" << std::endl;
+            return;
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(commonPath("refs"), ec);
+        stats.branches = changes.size();
+        statsDirty = true;
+    }
+
+    // Appends this run's cache counters to .cbird/cache-log ("objects <hits> <misses> payloads <hits> <misses>")
+    void logCacheCounters() {
+        CacheCounters parsed = reader.objectCacheCounters();
+        CacheCounters raw = reader.payloadCacheCounters();
+        if (parsed.hits + parsed.misses + raw.hits + raw.misses == loggedLookups) {
+            return;
+        }
+        loggedLookups = parsed.hits + parsed.misses + raw.hits + raw.misses;
+
+        std::filesystem::path path = commonPath("cache-log");
+        std::vector<std::string> lines;
+        std::ifstream in(path);
+        for (std::string line; std::getline(in, line);) {
+            lines.push_back(line);
+        }
+        in.close();
+        std::stringstream entry;
+        entry << "objects " << parsed.hits - loggedParsed.hits << " " << parsed.misses - loggedParsed.misses
+              << " payloads " << raw.hits - loggedRaw.hits << " " << raw.misses - loggedRaw.misses;
+        lines.push_back(entry.str());
+        loggedParsed = parsed;
+        loggedRaw = raw;
+
+        // Keep the log bounded; only the most recent operations matter
+        size_t start = lines.size() > CACHE_LOG_LIMIT ? lines.size() - CACHE_LOG_LIMIT : 0;
+        std::string data;
+        for (size_t i = start; i < lines.size(); ++i) {
+            data += lines[i] + "\n";
+        }
+        writeFileAtomic(path, data);
+    }
+
+    // The index file holds "E <blob> <path>" entries, "S <tree> <dir/>" entries for
+    // directories outside the sparse cone, "T <tree> <dir>" cached tree hashes and
+    // a "B <commit> <branch>" line naming the commit it was last committed as,
+    // plus "P <commit> <branch>" while checkout --at has it at an older commit
+    void loadIndex() {
+        if (indexLoaded) {
+            return;
+        }
+        TRACE_SCOPE("index.load", "index");
+        indexLoaded = true;
+        std::ifstream in(repoPath("index"));
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t hashEnd = line.find(' ', 2);
+            if (line.size() < 2 || hashEnd == std::string::npos) {
+                continue;
+            }
+            std::string hash = line.substr(2, hashEnd - 2);
+            std::string path = line.substr(hashEnd + 1);
+            if (line[0] == 'E') {
+                files[path] = hash == "-" ? "" : hash;
+            } else if (line[0] == 'S') {
+                sparseDirs[path] = hash;
+            } else if (line[0] == 'T') {
+                treeCache[path == "." ? "" : path] = hash;
+            } else if (line[0] == 'B') {
+                indexBase = hash == "-" ? "" : hash;
+                indexBranch = path;
+            } else if (line[0] == 'P') {
+                pastCommit = hash;
+            }
+        }
+    }
+
+    void saveIndex() {
+        TRACE_SCOPE("index.save", "index");
+        std::string data;
+        for (const auto& [path, hash] : files) {
+            data += "E " + (hash.empty() ? std::string("-") : hash) + " " + path + "\n";
+        }
+        for (const auto& [dir, hash] : sparseDirs) {
+            data += "S " + hash + " " + dir + "\n";
+        }
+        for (const auto& [dir, hash] : treeCache) {
+            data += "T " + hash + " " + (dir.empty() ? std::string(".") : dir) + "\n";
+        }
+        if (!indexBranch.empty()) {
+            data += "B " + (indexBase.empty() ? std::string("-") : indexBase) + " " + indexBranch + "\n";
+        }
+        if (!pastCommit.empty()) {
+            data += "P " + pastCommit + " " + indexBranch + "\n";
+        }
+        if (!writeFileAtomic(repoPath("index"), data)) {
+            std::cerr << "Error: Failed to write the index!" << std::endl;
+        }
+    }
+
+    // Updates one index entry and drops the cached trees of its directories
+    void updateIndexEntry(const std::string& path, const std::string& blobHash, bool remove = false) {
+        if (remove) {
+            files.erase(path);
+        } else {
+            files[path] = blobHash;
+        }
+        invalidateTrees(path);
+    }
+
+    // Drops the cached trees of the directories containing path
+    void invalidateTrees(const std::string& path) {
+        treeCache.erase("");
+        for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+            treeCache.erase(path.substr(0, slash + 1));
+        }
+        indexDirty = true;
+    }
+
+    // The outermost directory ("dir/") outside the sparse cone containing path; "" if it is materialized
+    std::string sparseDirOf(const std::string& path) const {
+        for (size_t slash = path.find('/'); sparse.enabled() && slash != std::string::npos; slash = path.find('/', slash + 1)) {
+            if (sparse.scope(path.substr(0, slash + 1)) == SparseCone::Scope::Outside) {
+                return path.substr(0, slash + 1);
+            }
+        }
+        return "";
+    }
+
+    // Takes a file's version in a tree into the index. A file outside the
+    // sparse cone is taken by updating its directory's entry to the tree's
+    // version of the whole directory.
+    void takeFromTree(const std::string& treeHash, const std::string& file) {
+        std::string dir = sparseDirOf(file);
+        if (!dir.empty()) {
+            ObjectType type;
+            std::string subtree = lookupEntry(treeHash, dir.substr(0, dir.size() - 1), type);
+            if (type == ObjectType::Tree && !subtree.empty()) {
+                sparseDirs[dir] = subtree;
+            } else {
+                sparseDirs.erase(dir);
+            }
+            invalidateTrees(dir);
+            return;
+        }
+        std::string blob = lookupPath(treeHash, file);
+        if (!blob.empty()) {
+            updateIndexEntry(file, blob);
+        } else if (files.count(file)) {
+            updateIndexEntry(file, "", true);
+        }
+    }
+
+    void loadIgnoreRules() {
+        if (!ignoreRulesLoaded) {
+            ignoreRules.load(".cbirdignore");
+            ignoreRulesLoaded = true;
+        }
+    }
+
+    // Whether a worktree path (relative to the root) or one of its parent
+    // directories is ignored by .cbirdignore
+    bool isIgnored(const std::string& path, bool isDirectory) {
+        loadIgnoreRules();
+        for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+            if (ignoreRules.ignored(std::string_view(path).substr(0, slash), true)) {
+                return true;
+            }
+        }
+        return ignoreRules.ignored(path, isDirectory);
+    }
+
+    // How the branch tip compares with its upstream
+    void showUpstreamStatus(const std::string& tip, const std::string& upstream, const std::string& upstreamTip) {
+        uint64_t ahead, behind;
+        aheadBehind(tip, upstreamTip, ahead, behind);
+        if (ahead == 0 && behind == 0) {
+            std::cout << "Your branch is up to date with '" << upstream << "'." << std::endl;
+        } else if (behind == 0) {
+            std::cout << "Your branch is ahead of '" << upstream << "' by " << ahead << " commit(s)." << std::endl;
+        } else if (ahead == 0) {
+            std::cout << "Your branch is behind '" << upstream << "' by " << behind << " commit(s)." << std::endl;
+        } else {
+            std::cout << "Your branch and '" << upstream << "' have diverged, and have " << ahead << " and "
+                      << behind << " different commits each, respectively." << std::endl;
+        }
+    }
+
+    // Files of a tree in the sparse cone (all of them without one), and the
+    // tree hash of each directory ("dir/") outside it, which is not read
+    void listConeFiles(const std::string& treeHash, const std::string& prefix, std::map<std::string, std::string>& out,
+                       std::map<std::string, std::string>& outside) {
+        std::shared_ptr<const std::vector<TreeEntry>> entries = reader.readTree(treeHash);
+        if (!entries) {
+            return;
+        }
+        for (const auto& entry : *entries) {
+            std::string path = prefix + entry.name;
+            if (entry.type != ObjectType::Tree) {
+                out[path] = entry.hash;
+            } else if (sparse.scope(path + "/") == SparseCone::Scope::Outside) {
+                outside[path + "/"] = entry.hash;
+            } else {
+                listConeFiles(entry.hash, path + "/", out, outside);
+            }
+        }
+    }
+
+    // Makes the index and the tracked files match a tree, within the sparse
+    // cone if there is one: files outside it are removed from the worktree
+    // and their directories kept as single index entries. Refuses if a
+    // tracked file has uncommitted changes.
+    bool checkoutTree(const std::string& treeHash) {
+        TRACE_SCOPE("checkoutTree", "checkout");
+        loadIndex();
+        for (const auto& [path, hash] : files) {
+            std::string content;
+            if (!hash.empty() && (!readFile(path, content) || objects.hashObject(ObjectType::Blob, content) != hash)) {
+                std::cerr << "Error: " << path << " has uncommitted changes; checkout aborted." << std::endl;
+                return false;
+            }
+        }
+
+        std::map<std::string, std::string> wanted;
+        std::map<std::string, std::string> outside;
+        listConeFiles(treeHash, "", wanted, outside);
+        std::vector<std::string> removed;
+        for (const auto& [path, hash] : files) {
+            if (!wanted.count(path)) {
+                removed.push_back(path);
+            }
+        }
+        for (const auto& path : removed) {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            // Directories left empty go too, as they would after leaving the cone
+            for (std::filesystem::path dir = std::filesystem::path(path).parent_path();
+                 !dir.empty() && std::filesystem::is_empty(dir, ec) && std::filesystem::remove(dir, ec);
+                 dir = dir.parent_path()) {
+            }
+            updateIndexEntry(path, "", true);
+        }
+        std::vector<std::string> needed;
+        for (const auto& [path, hash] : wanted) {
+            auto current = files.find(path);
+            if (current == files.end() || current->second != hash || !std::filesystem::exists(path)) {
+                needed.push_back(hash);
+            }
+        }
+        fetchObjects(needed); // A partial clone gets the blobs in one batch
+
+        // Directories first, then the files spread over a thread each core
+        std::vector<std::pair<std::string, std::string>> writes; // Path, blob
+        std::set<std::filesystem::path> parents;
+        for (const auto& [path, hash] : wanted) {
+            auto current = files.find(path);
+            if (current == files.end() || current->second != hash || !std::filesystem::exists(path)) {
+                writes.push_back({path, hash});
+                parents.insert(std::filesystem::path(path).parent_path());
+            }
+        }
+        for (const auto& parent : parents) {
+            std::error_code ec;
+            if (!parent.empty()) {
+                std::filesystem::create_directories(parent, ec);
+            }
+        }
+        std::atomic<size_t> next{0};
+        std::vector<char> written(writes.size(), 0);
+        auto work = [&]() {
+            for (size_t i = next++; i < writes.size(); i = next++) {
+                std::shared_ptr<const RawObject> blob = reader.readRaw(writes[i].second);
+                written[i] = blob && writeFileAtomic(writes[i].first, blob->payload);
+            }
+        };
+        {
+            TRACE_SCOPE("checkoutTree.write", "checkout", writes.size(), "files");
+            size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), writes.size());
+            std::vector<std::thread> pool;
+            for (size_t i = 1; i < threadCount; ++i) {
+                pool.emplace_back(work);
+            }
+            work();
+            for (auto& thread : pool) {
+                thread.join();
+            }
+        }
+        for (size_t i = 0; i < writes.size(); ++i) {
+            if (!written[i]) {
+                std::cerr << "Error: Failed to restore " << writes[i].first << "!" << std::endl;
+                return false;
+            }
+            updateIndexEntry(writes[i].first, writes[i].second);
+        }
+        if (outside != sparseDirs) {
+            sparseDirs = std::move(outside);
+            treeCache.clear();
+            indexDirty = true;
+        }
+        return true;
+    }
+
+    // Untracked files below a worktree directory ("" for the root), in name
+    // order, skipping ignored entries and directories outside the sparse cone
+    // without descending into them. A
+    // directory holding no tracked files is listed once as "dir/", provided
+    // something in it is neither ignored nor tracked (the search for which
+    // stops at the first such file).
+    void findUntracked(const std::string& dir, const std::set<std::string>& trackedDirs, std::vector<std::string>& out,
+                       bool firstOnly = false) {
+        std::vector<std::pair<std::string, bool>> entries; // Name, is a directory
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(dir.empty() ? "." : dir, ec), end; !ec && it != end; it.increment(ec)) {
+            entries.push_back({it->path().filename().string(), it->is_directory(ec) && !it->is_symlink(ec)});
+        }
+        std::sort(entries.begin(), entries.end());
+        for (const auto& [name, isDirectory] : entries) {
+            if (firstOnly && !out.empty()) {
+                return;
+            }
+            std::string path = dir.empty() ? name : dir + "/" + name;
+            if ((dir.empty() && name == ".cbird") || (isDirectory && sparseDirs.count(path + "/")) ||
+                ignoreRules.ignored(path, isDirectory)) {
+                continue;
+            }
+            if (!isDirectory) {
+                if (!files.count(path) || files[path].empty()) {
+                    out.push_back(path);
+                }
+            } else if (trackedDirs.count(path)) {
+                findUntracked(path, trackedDirs, out);
+            } else {
+                std::vector<std::string> inside;
+                findUntracked(path, trackedDirs, inside, true);
+                if (!inside.empty()) {
+                    out.push_back(path + "/");
+                }
+            }
+        }
+    }
+
+    // Stores the current content of a working file as a blob; "" if it cannot be read
+    std::string snapshotFile(const std::string& path) {
+        std::string content;
+        if (!std::filesystem::is_regular_file(path) || !readFile(path, content)) {
+            return "";
+        }
+        return writeObject(ObjectType::Blob, content);
+    }
+
+    // Snapshots several files at once so their blobs are hashed in parallel lanes
+    std::vector<std::string> snapshotFiles(const std::vector<std::string>& paths) {
+        std::vector<std::string> contents;
+        std::vector<size_t> readable;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            std::string content;
+            if (std::filesystem::is_regular_file(paths[i]) && readFile(paths[i], content)) {
+                contents.push_back(std::move(content));
+                readable.push_back(i);
+            }
+        }
+
+        std::vector<std::string> blobs(paths.size());
+        std::vector<std::string> hashes = objects.hashObjects(ObjectType::Blob, contents);
+        for (size_t i = 0; i < readable.size(); ++i) {
+            blobs[readable[i]] = writeObject(ObjectType::Blob, contents[i], hashes[i]);
+        }
+        return blobs;
+    }
+
+    // Writes the tree for the index entries under dir ("" for the root), reusing
+    // cached subtrees. Directories outside the sparse cone are not descended
+    // into: their entry's tree hash is used as it is.
+    std::string writeTree(const std::string& dir) {
+        auto cached = treeCache.find(dir);
+        if (cached != treeCache.end()) {
+            return cached->second;
+        }
+
+        // Keyed by name with a '/' after subdirectories, which sorts them as the index lists them
+        std::map<std::string, TreeEntry> entries;
+        auto addSubtree = [&](const std::string& name) {
+            if (!entries.count(name + "/")) {
+                std::string subtree = writeTree(dir + name + "/");
+                if (!subtree.empty()) {
+                    entries[name + "/"] = {ObjectType::Tree, subtree, name};
+                }
+            }
+        };
+        auto it = files.lower_bound(dir);
+        while (it != files.end() && it->first.compare(0, dir.size(), dir) == 0) {
+            std::string rest = it->first.substr(dir.size());
+            size_t slash = rest.find('/');
+            if (slash == std::string::npos) {
+                if (!it->second.empty()) {
+                    entries[rest] = {ObjectType::Blob, it->second, rest};
+                }
+                ++it;
+                continue;
+            }
+            // Recurse into the subdirectory, then skip past all of its entries ('0' follows '/')
+            addSubtree(rest.substr(0, slash));
+            it = files.lower_bound(dir + rest.substr(0, slash) + "0");
+        }
+        for (auto entry = sparseDirs.lower_bound(dir);
+             entry != sparseDirs.end() && entry->first.compare(0, dir.size(), dir) == 0; ++entry) {
+            std::string rest = entry->first.substr(dir.size());
+            size_t slash = rest.find('/');
+            if (slash + 1 == rest.size()) {
+                entries[rest] = {ObjectType::Tree, entry->second, rest.substr(0, slash)};
+            } else {
+                addSubtree(rest.substr(0, slash));
+            }
+        }
+
+        std::string hash;
+        if (!entries.empty() || dir.empty()) {
+            std::vector<TreeEntry> list;
+            for (auto& [key, entry] : entries) {
+                list.push_back(std::move(entry));
+            }
+            hash = writeObject(ObjectType::Tree, serializeTree(list));
+        }
+        treeCache[dir] = hash;
+        indexDirty = true;
+        return hash;
+    }
+
+    // Blob hash of path inside a tree; "" if the path is not in the tree
+    std::string lookupPath(const std::string& treeHash, const std::string& path) {
+        ObjectType type;
+        std::string hash = lookupEntry(treeHash, path, type);
+        return type == ObjectType::Blob ? hash : "";
+    }
+
+    // Hash and type of the file or directory at path inside a tree; "" if absent
+    std::string lookupEntry(std::string treeHash, const std::string& path, ObjectType& type) {
+        type = ObjectType::Tree;
+        if (path.empty()) {
+            return treeHash;
+        }
+        size_t start = 0;
+        while (!treeHash.empty()) {
+            std::shared_ptr<const std::vector<TreeEntry>> entries = reader.readTree(treeHash);
+            if (!entries) {
+                return "";
+            }
+            size_t slash = path.find('/', start);
+            std::string name = path.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+            treeHash.clear();
+            for (const auto& entry : *entries) {
+                if (entry.name != name) {
+                    continue;
+                }
+                if (slash == std::string::npos) {
+                    type = entry.type;
+                    return entry.hash;
+                }
+                if (entry.type == ObjectType::Tree) {
+                    treeHash = entry.hash;
+                }
+            }
+            start = slash + 1;
+        }
+        return "";
+    }
+
+    // Files listed in a commit's change description ("Modified a, b")
+    static std::vector<std::string> changedFiles(const Commit& commit) {
+        std::vector<std::string> result;
+        const std::string prefix = "Modified ";
+        if (commit.changes.compare(0, prefix.size(), prefix) != 0) {
+            return result;
+        }
+        size_t pos = prefix.size();
+        while (pos <= commit.changes.size()) {
+            size_t end = commit.changes.find(", ", pos);
+            result.push_back(commit.changes.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+            if (end == std::string::npos) {
+                break;
+            }
+            pos = end + 2;
+        }
+        return result;
+    }
+
+    // Commits reachable from tip, parents before children (first parent first)
+    std::vector<Commit> collectHistory(const std::string& tip) {
+        TRACE_SCOPE("history.walk", "tree");
+        std::vector<Commit> history;
+        if (tip.empty()) {
+            return history;
+        }
+
+        std::unordered_set<std::string> visited;
+        std::unordered_map<std::string, Commit> pending;
+        std::vector<std::pair<std::string, bool>> stack = {{tip, false}};
+        while (!stack.empty()) {
+            auto [hash, expanded] = stack.back();
+            stack.pop_back();
+            if (expanded) {
+                history.push_back(std::move(pending[hash]));
+                pending.erase(hash);
+                continue;
+            }
+            if (!visited.insert(hash).second) {
+                continue;
+            }
+            Commit commit;
+            if (!readCommit(hash, commit)) {
+                std::cerr << "Error: Missing commit " << hash << "!" << std::endl;
+                continue;
+            }
+            stack.push_back({hash, true});
+            for (auto parent = commit.parents.rbegin(); parent != commit.parents.rend(); ++parent) {
+                stack.push_back({*parent, false});
+            }
+            pending[hash] = std::move(commit);
+        }
+        return history;
+    }
+
+    // Name recorded as a commit's author: user.name from the config, else
+    // $CODEBIRD_AUTHOR, else the login name
+    std::string authorName() const {
+        auto configured = config.find("user.name");
+        if (configured != config.end()) {
+            return configured->second;
+        }
+        for (const char* variable : {"CODEBIRD_AUTHOR", "USER"}) {
+            if (const char* value = std::getenv(variable)) {
+                return value;
+            }
+        }
+        return "";
+    }
+
+    bool messageIndexEnabled() const {
+        auto setting = config.find("messageindex");
+        return setting == config.end() || setting->second != "off";
+    }
+
+    // What walkHistory does after visiting a commit
+    enum class WalkStep {
+        Continue,
+        Prune, // Do not walk this commit's parents
+        Stop,
+    };
+
+    // Visits the graph positions of the commits reachable from tips newest
+    // first. Commits are only reached as the walk gets to them, so a walk that
+    // stops early costs only what it visited.
+    // In the default order the queue is ordered by generation number, which
+    // puts every commit after all of its children.
+    //
+    // Date and topological order are the incremental topological sort of the
+    // commit graph: an explore queue, also ordered by generation, counts for
+    // each commit how many of its children are reachable, and a commit becomes
+    // ready once all of those were shown. Before a parent's count is checked
+    // the exploration is carried down to its generation; every child has a
+    // larger generation, so by then all of them have been counted. Only the
+    // part of the graph above the commits shown so far is ever explored. Ready
+    // commits come out newest first by date, or for topological order last
+    // ready first, which keeps each line of history together.
+    template <typename Visit>
+    void walkHistory(const std::vector<std::string>& tips, LogOrder order, Visit visit) {
+        TRACE_SCOPE("history.stream", "graph");
+        std::vector<uint32_t> starts;
+        for (const auto& tip : tips) {
+            uint32_t pos = graphPosition(tip);
+            if (pos != CommitGraph::NONE && std::find(starts.begin(), starts.end(), pos) == starts.end()) {
+                starts.push_back(pos);
+            }
+        }
+
+        if (order == LogOrder::Default) {
+            std::priority_queue<std::pair<uint32_t, uint32_t>> queue; // Generation, graph position
+            std::unordered_set<uint32_t> seen;
+            auto enqueue = [&](uint32_t pos) {
+                if (pos != CommitGraph::NONE && seen.insert(pos).second) {
+                    queue.push({graph.generation(pos), pos});
+                }
+            };
+            for (uint32_t pos : starts) {
+                enqueue(pos);
+            }
+            while (!queue.empty()) {
+                uint32_t pos = queue.top().second;
+                queue.pop();
+                WalkStep step = visit(pos);
+                if (step == WalkStep::Stop) {
+                    return;
+                }
+                if (step == WalkStep::Continue) {
+                    for (uint32_t parent : graph.parents(pos)) {
+                        enqueue(parent);
+                    }
+                }
+            }
+            return;
+        }
+
+        std::priority_queue<std::pair<uint32_t, uint32_t>> explore; // Generation, graph position
+        std::unordered_map<uint32_t, uint32_t> indegree; // Commit -> explored children not yet shown
+        std::unordered_set<uint32_t> queued; // Commits pushed to the explore queue
+        auto exploreTo = [&](uint32_t generation) {
+            while (!explore.empty() && explore.top().first >= generation) {
+                uint32_t pos = explore.top().second;
+                explore.pop();
+                for (uint32_t parent : graph.parents(pos)) {
+                    if (parent == CommitGraph::NONE) {
+                        continue;
+                    }
+                    indegree[parent]++;
+                    if (queued.insert(parent).second) {
+                        explore.push({graph.generation(parent), parent});
+                    }
+                }
+            }
+        };
+        std::priority_queue<std::pair<int64_t, uint32_t>> ready; // Date or readiness order, graph position
+        int64_t readyCount = 0;
+        std::unordered_set<uint32_t> live; // Commits with a child that was shown rather than pruned
+        auto makeReady = [&](uint32_t pos) {
+            ready.push({order == LogOrder::Date ? graph.time(pos) : ++readyCount, pos});
+        };
+
+        uint32_t lowest = CommitGraph::NONE;
+        for (uint32_t pos : starts) {
+            explore.push({graph.generation(pos), pos});
+            queued.insert(pos);
+            lowest = std::min(lowest, graph.generation(pos));
+        }
+        exploreTo(lowest);
+        for (uint32_t pos : starts) {
+            if (indegree[pos] == 0) {
+                live.insert(pos);
+                makeReady(pos);
+            }
+        }
+        while (!ready.empty()) {
+            uint32_t pos = ready.top().second;
+            ready.pop();
+            WalkStep step = visit(pos);
+            if (step == WalkStep::Stop) {
+                return;
+            }
+            for (uint32_t parent : graph.parents(pos)) {
+                if (parent == CommitGraph::NONE) {
+                    continue;
+                }
+                exploreTo(graph.generation(parent));
+                if (step == WalkStep::Continue) {
+                    live.insert(parent);
+                }
+                if (--indegree[parent] == 0 && live.count(parent)) {
+                    makeReady(parent);
+                }
+            }
+        }
+    }
+
+    std::filesystem::path timelinePath(const std::string& branchName) const {
+        return commonPath("objects") / "info" / "times" / branchName;
+    }
+
+    // The commit a branch was at at a time, following its first-parent history;
+    // "" if it had no commits yet. The branch's time index is brought up to
+    // date first: commits since the indexed tip are appended, and the index is
+    // rebuilt if the branch no longer descends from that tip.
+    std::string branchAt(const std::string& branchName, int64_t time) {
+        std::string tip = branchTip(branchName);
+        if (tip.empty()) {
+            return "";
+        }
+        std::filesystem::path path = timelinePath(branchName);
+        BranchTimeline timeline;
+        bool loaded = timeline.load(path) && timeline.size() > 0;
+        std::string indexedTip = loaded ? timeline.hashAt(timeline.size() - 1) : "";
+        if (indexedTip != tip) {
+            TRACE_SCOPE("timeline.update", "graph", branchName);
+            uint32_t stop = loaded ? graphPosition(indexedTip) : CommitGraph::NONE;
+            std::vector<BranchTimeline::Entry> added;
+            for (uint32_t pos = graphPosition(tip); pos != CommitGraph::NONE && pos != stop;
+                 pos = graph.parents(pos)[0]) {
+                if (stop != CommitGraph::NONE && graph.generation(pos) <= graph.generation(stop)) {
+                    stop = CommitGraph::NONE; // Passed the indexed tip without meeting it
+                }
+                added.push_back({graph.time(pos), graph.hashAt(pos)});
+            }
+            std::reverse(added.begin(), added.end());
+            bool appended = stop != CommitGraph::NONE && BranchTimeline::append(path, indexedTip, added);
+            if (!appended) {
+                if (stop != CommitGraph::NONE) {
+                    // Another process changed the index meanwhile; rebuild it from the whole history
+                    added.clear();
+                    for (uint32_t pos = graphPosition(tip); pos != CommitGraph::NONE; pos = graph.parents(pos)[0]) {
+                        added.push_back({graph.time(pos), graph.hashAt(pos)});
+                    }
+                    std::reverse(added.begin(), added.end());
+                }
+                BranchTimeline::write(path, added);
+            }
+            if (!timeline.load(path)) {
+                std::cerr << "Error: Failed to write the time index of branch " << branchName << "!" << std::endl;
+                return "";
+            }
+        }
+        size_t i = timeline.lastAtOrBefore(time);
+        return i == timeline.size() ? "" : timeline.hashAt(i);
+    }
+
+    // Blob hashes of every file in a tree, by path
+    void listTreeFiles(const std::string& treeHash, const std::string& prefix,
+                       std::map<std::string, std::string>& result) {
+        std::shared_ptr<const std::vector<TreeEntry>> entries = reader.readTree(treeHash);
+        if (!entries) {
+            return;
+        }
+        for (const auto& entry : *entries) {
+            if (entry.type == ObjectType::Tree) {
+                listTreeFiles(entry.hash, prefix + entry.name + "/", result);
+            } else {
+                result[prefix + entry.name] = entry.hash;
+            }
+        }
+    }
+
+    // Whether a commit changes one of paths: for at least one of them its tree
+    // differs from every parent's (a merge that took a path unchanged from one
+    // side does not count, matching how the side's own commit is shown)
+    bool touchesPaths(const Commit& commit, const std::vector<std::string>& paths) {
+        std::vector<std::string> parentTrees;
+        for (const auto& parent : commit.parents) {
+            std::shared_ptr<const Commit> parentCommit = reader.readCommit(parent);
+            parentTrees.push_back(parentCommit ? parentCommit->treeHash : "");
+        }
+        for (const auto& path : paths) {
+            ObjectType type;
+            std::string ours = lookupEntry(commit.treeHash, path, type);
+            bool sameAsParent = parentTrees.empty() && ours.empty();
+            for (const auto& tree : parentTrees) {
+                sameAsParent = sameAsParent || lookupEntry(tree, path, type) == ours;
+            }
+            if (!sameAsParent) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Adds to out the files, and as "dir/" the directories, whose content
+    // differs between two trees ("" for a missing tree). Identical subtrees
+    // are skipped by hash.
+    void diffTrees(const std::string& ours, const std::string& theirs, const std::string& prefix,
+                   std::set<std::string>& out) {
+        std::map<std::string, const TreeEntry*> entries[2];
+        std::shared_ptr<const std::vector<TreeEntry>> trees[2] = {
+            ours.empty() ? nullptr : reader.readTree(ours), theirs.empty() ? nullptr : reader.readTree(theirs)};
+        for (int side = 0; side < 2; ++side) {
+            if (trees[side]) {
+                for (const auto& entry : *trees[side]) {
+                    entries[side][entry.name] = &entry;
+                }
+            }
+        }
+        std::set<std::string> names;
+        for (const auto& side : entries) {
+            for (const auto& [name, entry] : side) {
+                names.insert(name);
+            }
+        }
+        for (const auto& name : names) {
+            const TreeEntry* a = entries[0].count(name) ? entries[0][name] : nullptr;
+            const TreeEntry* b = entries[1].count(name) ? entries[1][name] : nullptr;
+            if (a && b && a->type == b->type && a->hash == b->hash) {
+                continue;
+            }
+            bool aTree = a && a->type == ObjectType::Tree;
+            bool bTree = b && b->type == ObjectType::Tree;
+            if (aTree || bTree) {
+                out.insert(prefix + name + "/");
+                diffTrees(aTree ? a->hash : "", bTree ? b->hash : "", prefix + name + "/", out);
+            }
+            if ((a && !aTree) || (b && !bTree)) {
+                out.insert(prefix + name);
+            }
+        }
+    }
+
+    // Paths a commit changes: files and "dir/" directories that differ from
+    // every parent, or everything in a root commit (what touchesPaths tests)
+    std::vector<std::string> changedPaths(const Commit& commit) {
+        // Diffing against the first parent first keeps the cost to the size of
+        // the change; the other parents can only narrow the result
+        auto parentTree = [&](size_t i) {
+            std::shared_ptr<const Commit> parentCommit =
+                i < commit.parents.size() ? reader.readCommit(commit.parents[i]) : nullptr;
+            return parentCommit ? parentCommit->treeHash : std::string();
+        };
+        std::set<std::string> changed;
+        diffTrees(commit.treeHash, parentTree(0), "", changed);
+        for (size_t i = 1; i < commit.parents.size() && !changed.empty(); ++i) {
+            std::set<std::string> fromParent;
+            diffTrees(commit.treeHash, parentTree(i), "", fromParent);
+            std::set<std::string> both;
+            std::set_intersection(changed.begin(), changed.end(), fromParent.begin(), fromParent.end(),
+                                  std::inserter(both, both.end()));
+            changed = std::move(both);
+        }
+        return {changed.begin(), changed.end()};
+    }
+
+    bool pathIndexEnabled() const {
+        auto setting = config.find("pathindex");
+        return setting == config.end() || setting->second != "off";
+    }
+
+    std::filesystem::path blameCachePath(const std::string& commitHash, const std::string& path) const {
+        std::string key = objects.hashObject(ObjectType::Blob, commitHash + "\n" + path);
+        return commonPath("objects") / "info" / "blame" / key.substr(0, 2) / key.substr(2);
+    }
+
+    // The commit each line of path came from as of tip. The first-parent
+    // history is walked back to the newest commit whose line origins are
+    // cached, or to where the file was created, and the changes to the file
+    // since are replayed forward as line diffs; the result is cached for the
+    // last commit that changed the file, so after one more change only that
+    // change is diffed. Non-merge commits the path index lists as not
+    // touching the file are passed without reading their trees. Lines a merge
+    // brought in from a side branch are attributed to the merge.
+    bool lineOrigins(const std::string& tip, const std::string& path, LineOrigins& result) {
+        std::shared_ptr<const Commit> tipCommit = reader.readCommit(tip);
+        std::string blob = tipCommit ? lookupPath(tipCommit->treeHash, path) : "";
+        if (blob.empty()) {
+            return false;
+        }
+        std::vector<bool> touching;
+        bool usePathIndex = pathIndexEnabled();
+        if (usePathIndex) {
+            pathIndex.load();
+            touching.assign(pathIndex.size(), false);
+            for (uint32_t number : pathIndex.postings(path)) {
+                touching[number] = true;
+            }
+        }
+
+        std::vector<std::pair<std::string, std::string>> changes; // Commit, blob it left; newest first
+        LineOrigins base;
+        {
+            TRACE_SCOPE("blame.history", "blame", path);
+            for (uint32_t pos = graphPosition(tip); pos != CommitGraph::NONE;) {
+                std::string hash = graph.hashAt(pos);
+                CommitGraph::Parents parents = graph.parents(pos);
+                uint32_t number = usePathIndex && parents[1] == CommitGraph::NONE ? pathIndex.find(hash) : PostingIndex::NONE;
+                if (number != PostingIndex::NONE && !touching[number]) {
+                    pos = parents[0];
+                    continue;
+                }
+                std::string parentBlob;
+                if (parents[0] != CommitGraph::NONE) {
+                    std::shared_ptr<const Commit> parent = reader.readCommit(graph.hashAt(parents[0]));
+                    if (!parent) {
+                        std::cerr << "Error: Missing commit " << graph.hashAt(parents[0]) << "!" << std::endl;
+                        return false;
+                    }
+                    parentBlob = lookupPath(parent->treeHash, path);
+                }
+                if (parentBlob != blob) {
+                    if (base.load(blameCachePath(hash, path), blob)) {
+                        break;
+                    }
+                    changes.push_back({hash, blob});
+                    blob = parentBlob;
+                    if (blob.empty()) {
+                        break; // Created here
+                    }
+                }
+                pos = parents[0];
+            }
+        }
+        if (changes.empty() && base.blob.empty()) {
+            return false;
+        }
+
+        TRACE_SCOPE("blame.replay", "blame", path);
+        std::vector<std::string> blobs = {base.blob};
+        for (const auto& change : changes) {
+            blobs.push_back(change.second);
+        }
+        fetchObjects(blobs);
+        std::shared_ptr<const RawObject> previous = base.blob.empty() ? nullptr : reader.readRaw(base.blob);
+        for (auto change = changes.rbegin(); change != changes.rend(); ++change) {
+            std::shared_ptr<const RawObject> current = reader.readRaw(change->second);
+            if (!current || (!base.blob.empty() && !previous)) {
+                std::cerr << "Error: Missing blob for " << path << "!" << std::endl;
+                return false;
+            }
+            std::vector<size_t> match = matchLines(splitLines(previous ? std::string_view(previous->payload) : ""),
+                                                   splitLines(current->payload));
+            std::vector<std::string> lines(match.size());
+            for (size_t i = 0; i < match.size(); ++i) {
+                lines[i] = match[i] < base.lines.size() ? base.lines[match[i]] : change->first;
+            }
+            base.lines = std::move(lines);
+            base.blob = change->second;
+            previous = current;
+        }
+        if (!changes.empty()) {
+            base.save(blameCachePath(changes.front().first, path));
+        }
+        result = std::move(base);
+        return true;
+    }
+
+    // Records a commit on the current branch and moves the branch to it, provided
+    // the branch still has the expected stored tip
+    RefUpdateStatus recordCommit(const std::string& message, const std::string& changes, std::vector<std::string> parents,
+                                 const std::optional<std::string>& expected) {
+        std::string tree = writeTree("");
+        Commit newCommit(message, changes, currentBranch, tree, parents, objects.hashAlgorithm(), authorName());
+        if (writeObject(ObjectType::Commit, newCommit.serialize()).empty()) {
+            std::cerr << "Error: Failed to write commit object!" << std::endl;
+            return RefUpdateStatus::Failed;
+        }
+        RefUpdateStatus status = setBranch(currentBranch, newCommit.commitHash, std::make_optional(expected));
+        if (status == RefUpdateStatus::Ok) {
+            markIndexBase(newCommit.commitHash);
+            if (messageIndexEnabled()) {
+                messages.add({{newCommit.commitHash, tokenizeMessage(message)}});
+            }
+            if (pathIndexEnabled()) {
+                pathIndex.add({{newCommit.commitHash, changedPaths(newCommit)}});
+            }
+        }
+        return status;
+    }
+
+    // Records that the index now matches tip of the current branch
+    void markIndexBase(const std::string& tip) {
+        indexBranch = currentBranch;
+        indexBase = tip;
+        pastCommit.clear();
+        indexDirty = true;
+    }
+
+    // False (with an error) while checkout --at has the index at an older
+    // commit, whose files a commit on the branch tip would otherwise revert
+    bool indexAtTip() {
+        loadIndex();
+        if (pastCommit.empty()) {
+            return true;
+        }
+        std::cerr << "Error: The files are checked out at " << objects.abbreviate(pastCommit)
+                  << "; switch to " << indexBranch << " before committing." << std::endl;
+        return false;
+    }
+
+    // After another writer moved the branch from oldTip to newTip, takes the files
+    // its commits changed into the index. With overlapAllowed unset, returns false
+    // if one of ours was among them; otherwise our snapshot of those files wins.
+    bool catchUpIndex(const std::string& oldTip, const std::string& newTip, const std::vector<std::string>& ours,
+                      bool overlapAllowed = false) {
+        std::unordered_set<std::string> theirFiles;
+        for (uint32_t pos : commitsSince({graphPosition(oldTip)}, {graphPosition(newTip)})) {
+            Commit commit;
+            if (readCommit(graph.hashAt(pos), commit)) {
+                for (const auto& file : changedFiles(commit)) {
+                    theirFiles.insert(file);
+                }
+            }
+        }
+        for (const auto& file : ours) {
+            if (overlapAllowed) {
+                theirFiles.erase(file);
+            } else if (theirFiles.count(file)) {
+                std::cerr << "Error: " << file << " was changed concurrently on branch " << currentBranch
+                          << "; commit aborted." << std::endl;
+                return false;
+            }
+        }
+        Commit tipCommit;
+        if (!newTip.empty() && readCommit(newTip, tipCommit)) {
+            for (const auto& file : theirFiles) {
+                takeFromTree(tipCommit.treeHash, file);
+            }
+        }
+        return true;
+    }
+
+    // Loads the reachability bitmaps of the repository's pack, if it has one
+    void loadBitmaps() {
+        if (bitmapsLoaded) {
+            return;
+        }
+        bitmapsLoaded = true;
+        std::shared_ptr<const ObjectStore::PackList> packs = objects.packs();
+        if (packs->size() != 1) {
+            return;
+        }
+        std::filesystem::path path = packs->front()->path();
+        path.replace_extension(".bitmap");
+        if (bitmaps.load(path)) {
+            bitmapPack = packs->front();
+        }
+    }
+
+    // Position of an object in the bitmapped pack
+    bool bitmapPosition(const std::string& hash, uint32_t& position) const {
+        uint64_t offset;
+        return bitmapPack && bitmapPack->find(hash, position, offset);
+    }
+
+    // Marks everything reachable from tips in dense, a bitset over pack positions.
+    // Commits with a bitmap contribute it whole instead of being walked; reachable
+    // commits without a position are appended to unpacked. Trees and blobs are
+    // only marked when withTrees is set.
+    template <typename PositionFn, typename BitmapFn>
+    void markReachable(const std::vector<std::string>& tips, PositionFn position, BitmapFn bitmapFor,
+                       bool withTrees, std::vector<uint64_t>& dense, std::vector<std::string>* unpacked) {
+        TRACE_SCOPE("bitmap.mark", "pack");
+        auto testBit = [&dense](uint32_t pos) {
+            return pos / 64 < dense.size() && ((dense[pos / 64] >> (pos % 64)) & 1);
+        };
+        auto setBit = [&dense, &testBit](uint32_t pos) {
+            if (testBit(pos)) {
+                return false;
+            }
+            if (dense.size() <= pos / 64) {
+                dense.resize(pos / 64 + 1, 0);
+            }
+            dense[pos / 64] |= uint64_t(1) << (pos % 64);
+            return true;
+        };
+
+        std::unordered_set<std::string> visited;
+        std::vector<std::string> stack(tips.begin(), tips.end());
+        std::vector<std::string> trees;
+        while (!stack.empty()) {
+            std::string hash = std::move(stack.back());
+            stack.pop_back();
+            if (hash.empty() || !visited.insert(hash).second) {
+                continue;
+            }
+            uint32_t pos;
+            bool packed = position(hash, pos);
+            if (packed && testBit(pos)) {
+                continue; // Already covered by a bitmap
+            }
+            if (const EwahBitmap* bitmap = bitmapFor(hash)) {
+                bitmap->orInto(dense);
+                continue;
+            }
+            std::shared_ptr<const Commit> commit = reader.readCommit(hash);
+            if (!commit) {
+                std::cerr << "Error: Missing commit " << hash << "!" << std::endl;
+                continue;
+            }
+            if (packed) {
+                setBit(pos);
+            } else if (unpacked) {
+                unpacked->push_back(hash);
+            }
+            if (withTrees) {
+                trees.push_back(commit->treeHash);
+            }
+            stack.insert(stack.end(), commit->parents.begin(), commit->parents.end());
+        }
+
+        // Trees already marked were descended when they were marked (or are covered by a bitmap)
+        std::unordered_set<std::string> looseTrees;
+        while (!trees.empty()) {
+            std::string hash = std::move(trees.back());
+            trees.pop_back();
+            uint32_t pos;
+            if (hash.empty() || (position(hash, pos) ? !setBit(pos) : !looseTrees.insert(hash).second)) {
+                continue;
+            }
+            std::shared_ptr<const std::vector<TreeEntry>> entries = reader.readTree(hash);
+            if (!entries) {
+                std::cerr << "Error: Missing tree " << hash << "!" << std::endl;
+                continue;
+            }
+            for (const auto& entry : *entries) {
+                if (entry.type == ObjectType::Tree) {
+                    trees.push_back(entry.hash);
+                } else if (position(entry.hash, pos)) {
+                    setBit(pos);
+                }
+            }
+        }
+    }
+
+    // Whether target is reachable from tip, answered from bitmaps where the walk reaches one
+    bool reaches(const std::string& tip, const std::string& target) {
+        loadBitmaps();
+        uint32_t targetPos = 0;
+        bool targetPacked = bitmapPosition(target, targetPos);
+        std::unordered_set<std::string> visited;
+        std::vector<std::string> stack = {tip};
+        while (!stack.empty()) {
+            std::string hash = std::move(stack.back());
+            stack.pop_back();
+            if (hash == target) {
+                return true;
+            }
+            if (hash.empty() || !visited.insert(hash).second) {
+                continue;
+            }
+            uint32_t pos;
+            if (bitmapPosition(hash, pos)) {
+                if (!targetPacked) {
+                    continue; // Packed commits only reach packed commits
+                }
+                if (const EwahBitmap* bitmap = bitmaps.forCommit(hash)) {
+                    if (bitmap->get(targetPos)) {
+                        return true;
+                    }
+                    continue;
+                }
+            }
+            std::shared_ptr<const Commit> commit = reader.readCommit(hash);
+            if (commit) {
+                stack.insert(stack.end(), commit->parents.begin(), commit->parents.end());
+            }
+        }
+        return false;
+    }
+
+    // Objects reachable from tips as a bitmap over the bitmapped pack, built
+    // from the stored bitmaps where the walk reaches them; objects outside the
+    // pack are left out. Trees and blobs are only walked with withTrees set.
+    EwahBitmap reachableBitmap(const std::vector<std::string>& tips, bool withTrees) {
+        std::vector<uint64_t> dense;
+        markReachable(tips, [this](const std::string& hash, uint32_t& pos) { return bitmapPosition(hash, pos); },
+                      [this](const std::string& hash) { return bitmaps.forCommit(hash); }, withTrees, dense, nullptr);
+        return EwahBitmap::fromWords(dense);
+    }
+
+    // Whether every non-empty hash is in the bitmapped pack. The pack holds
+    // all history reachable from what it contains, so then bitmaps alone
+    // answer reachability questions about them.
+    bool allBitmapped(const std::vector<std::string>& hashes) {
+        loadBitmaps();
+        uint32_t pos;
+        return bitmapPack && std::all_of(hashes.begin(), hashes.end(), [&](const std::string& hash) {
+            return hash.empty() || bitmapPosition(hash, pos);
+        });
+    }
+
+    // Commits reachable from tip that are not in pack, parents before children
+    std::vector<std::string> unpackedHistory(const std::string& tip, const PackFile* pack) {
+        std::vector<std::string> order;
+        std::unordered_set<std::string> visited;
+        std::vector<std::pair<std::string, bool>> stack = {{tip, false}};
+        while (!stack.empty()) {
+            auto [hash, expanded] = stack.back();
+            stack.pop_back();
+            if (expanded) {
+                order.push_back(hash);
+                continue;
+            }
+            if (hash.empty() || !visited.insert(hash).second || (pack && pack->contains(hash))) {
+                continue;
+            }
+            std::shared_ptr<const Commit> commit = reader.readCommit(hash);
+            if (!commit) {
+                std::cerr << "Error: Missing commit " << hash << "!" << std::endl;
+                continue;
+            }
+            stack.push_back({hash, true});
+            for (auto parent = commit->parents.rbegin(); parent != commit->parents.rend(); ++parent) {
+                stack.push_back({*parent, false});
+            }
+        }
+        return order;
+    }
+
+    std::filesystem::path graphPath() const {
+        return commonPath("objects") / "info" / "commit-graph";
+    }
+
+    // Graph position of a commit, adding it and any ancestors missing from the
+    // graph file; NONE if the commit cannot be read
+    uint32_t graphPosition(const std::string& hash) {
+        if (!graphLoaded) {
+            graphLoaded = true;
+            // A file in an older format is replaced on the next flush
+            graphDirty = !graph.load(graphPath()) && std::filesystem::exists(graphPath());
+        }
+        uint32_t pos = graph.find(hash);
+        if (pos != CommitGraph::NONE || hash.empty()) {
+            return pos;
+        }
+
+        TRACE_SCOPE("graph.extend", "graph");
+        std::unordered_map<std::string, std::shared_ptr<const Commit>> pending;
+        std::vector<std::pair<std::string, bool>> stack = {{hash, false}};
+        while (!stack.empty()) {
+            auto [current, expanded] = stack.back();
+            stack.pop_back();
+            if (graph.find(current) != CommitGraph::NONE) {
+                continue;
+            }
+            if (expanded) {
+                const Commit& commit = *pending[current];
+                std::vector<uint32_t> parents;
+                for (const auto& parent : commit.parents) {
+                    uint32_t parentPos = graph.find(parent);
+                    if (parentPos != CommitGraph::NONE) {
+                        parents.push_back(parentPos);
+                    }
+                }
+                graph.add(current, parents, commit.unixTime());
+                pending.erase(current);
+                continue;
+            }
+            if (pending.count(current)) {
+                continue;
+            }
+            std::shared_ptr<const Commit> commit = reader.readCommit(current);
+            if (!commit) {
+                std::cerr << "Error: Missing commit " << current << "!" << std::endl;
+                continue;
+            }
+            pending[current] = commit;
+            stack.push_back({current, true});
+            for (const auto& parent : commit->parents) {
+                stack.push_back({parent, false});
+            }
+        }
+        if (graph.addedCommits() >= GRAPH_REFRESH) {
+            graphDirty = true;
+        }
+        return graph.find(hash);
+    }
+
+    // Commits reachable from ours but not theirs (ahead) and the reverse (behind).
+    // When both tips are packed, these are counted from their reachability
+    // bitmaps, AND-NOT each other and masked to commits. Otherwise walks both
+    // histories at once in decreasing generation, so every commit's flags are
+    // final when it is popped, and stops once all queued commits are
+    // reachable from both sides.
+    void aheadBehind(const std::string& ours, const std::string& theirs, uint64_t& ahead, uint64_t& behind) {
+        TRACE_SCOPE("graph.aheadBehind", "graph");
+        ahead = 0;
+        behind = 0;
+        if (allBitmapped({ours, theirs})) {
+            EwahBitmap oursReach = reachableBitmap({ours}, false);
+            EwahBitmap theirsReach = reachableBitmap({theirs}, false);
+            const EwahBitmap& commits = bitmaps.ofType(ObjectType::Commit);
+            ahead = (oursReach.andNot(theirsReach) & commits).cardinality();
+            behind = (theirsReach.andNot(oursReach) & commits).cardinality();
+            return;
+        }
+        constexpr uint8_t OURS = 1, THEIRS = 2, BOTH = 3;
+        std::unordered_map<uint32_t, uint8_t> flags;
+        std::priority_queue<std::pair<uint32_t, uint32_t>> queue; // Generation, graph position
+        size_t active = 0; // Queued commits not yet known to be reachable from both sides
+        auto mark = [&](uint32_t pos, uint8_t flag) {
+            if (pos == CommitGraph::NONE) {
+                return;
+            }
+            auto [it, inserted] = flags.try_emplace(pos, 0);
+            uint8_t before = it->second;
+            it->second |= flag;
+            if (inserted) {
+                queue.push({graph.generation(pos), pos});
+                active += it->second != BOTH;
+            } else if (before != BOTH && it->second == BOTH) {
+                active--;
+            }
+        };
+        mark(graphPosition(ours), OURS);
+        mark(graphPosition(theirs), THEIRS);
+        while (active > 0 && !queue.empty()) {
+            uint32_t pos = queue.top().second;
+            queue.pop();
+            uint8_t flag = flags[pos];
+            if (flag != BOTH) {
+                active--;
+                (flag == OURS ? ahead : behind)++;
+            }
+            for (uint32_t parent : graph.parents(pos)) {
+                mark(parent, flag);
+            }
+        }
+    }
+
+    // Graph positions of the commits reachable from tips but not from any of
+    // bases, in decreasing generation. Walks both sides at once like
+    // aheadBehind and stops once every queued commit is reachable from a
+    // base, so the history the two share is never visited.
+    std::vector<uint32_t> commitsSince(const std::vector<uint32_t>& bases, const std::vector<uint32_t>& tips) {
+        TRACE_SCOPE("graph.commitsSince", "graph");
+        constexpr uint8_t TIP = 1, BASE = 2;
+        std::unordered_map<uint32_t, uint8_t> flags;
+        std::priority_queue<std::pair<uint32_t, uint32_t>> queue; // Generation, graph position
+        size_t active = 0; // Queued commits not yet known to be reachable from a base
+        auto mark = [&](uint32_t pos, uint8_t flag) {
+            if (pos == CommitGraph::NONE) {
+                return;
+            }
+            auto [it, inserted] = flags.try_emplace(pos, 0);
+            uint8_t before = it->second;
+            it->second |= flag;
+            if (inserted) {
+                queue.push({graph.generation(pos), pos});
+                active += !(it->second & BASE);
+            } else if (!(before & BASE) && (it->second & BASE)) {
+                active--;
+            }
+        };
+        for (uint32_t pos : bases) {
+            mark(pos, BASE);
+        }
+        for (uint32_t pos : tips) {
+            mark(pos, TIP);
+        }
+        std::vector<uint32_t> result;
+        while (active > 0 && !queue.empty()) {
+            uint32_t pos = queue.top().second;
+            queue.pop();
+            uint8_t flag = flags[pos];
+            if (!(flag & BASE)) {
+                active--;
+                result.push_back(pos);
+            }
+            for (uint32_t parent : graph.parents(pos)) {
+                mark(parent, flag);
+            }
+        }
+        return result;
+    }
+
+    // The branch a branch is compared against: branch.<name>.upstream, else the
+    // "upstream" setting, else main; "" when that is the branch itself or missing
+    std::string upstreamOf(const std::string& branchName) {
+        auto specific = config.find("branch." + branchName + ".upstream");
+        auto general = config.find("upstream");
+        std::string upstream = specific != config.end() ? specific->second
+                             : general != config.end() ? general->second : "main";
+        return upstream == branchName || !branchExists(upstream) ? "" : upstream;
+    }
+
+    // Resolves a branch name, full hash or unique hash prefix (at least 4 digits) to an object hash
+    bool resolveRevision(std::string rev, std::string& hash) {
+        if (readBranch(rev, hash)) {
+            if (hash.empty()) {
+                std::cerr << "Error: Branch " << rev << " has no commits!" << std::endl;
+                return false;
+            }
+            return true;
+        }
+        std::transform(rev.begin(), rev.end(), rev.begin(), [](unsigned char c) { return std::tolower(c); });
+        std::vector<std::string> matches = rev.size() >= 4 ? objects.matchPrefix(rev, 2) : std::vector<std::string>();
+        if (matches.empty()) {
+            std::cerr << "Error: Unknown revision " << rev << "!" << std::endl;
+            return false;
+        }
+        if (matches.size() > 1) {
+            std::cerr << "Error: Short hash " << rev << " is ambiguous!" << std::endl;
+            return false;
+        }
+        hash = matches.front();
+        return true;
+    }
+
+    // The objects reachable from tips but not from haves, for a pack to a
+    // repository that has the haves: the missing commits, then the trees and
+    // blobs they introduce. When every tip is packed this is the tips' bitmap
+    // AND-NOT the haves'; otherwise it leaves out everything in the trees of
+    // the boundary commits (those the other side has that missing ones build
+    // on). False if a tip cannot be read.
+    bool missingObjects(const std::vector<std::string>& tips, const std::vector<std::string>& haves,
+                        std::vector<std::string>& out) {
+        TRACE_SCOPE("sync.missingObjects", "remote");
+        std::vector<uint32_t> bases;
+        for (const auto& hash : haves) {
+            bases.push_back(graphPosition(hash));
+        }
+        std::vector<uint32_t> tipPositions;
+        for (const auto& tip : tips) {
+            uint32_t pos = graphPosition(tip);
+            if (pos == CommitGraph::NONE) {
+                std::cerr << "Error: Missing commit " << tip << "!" << std::endl;
+                return false;
+            }
+            tipPositions.push_back(pos);
+        }
+        if (allBitmapped(tips)) {
+            EwahBitmap missing = reachableBitmap(tips, true).andNot(reachableBitmap(haves, true));
+            const EwahBitmap& commits = bitmaps.ofType(ObjectType::Commit);
+            std::vector<uint32_t> positions;
+            auto collect = [&positions](uint64_t pos) { positions.push_back(static_cast<uint32_t>(pos)); };
+            (missing & commits).forEach(collect);
+            missing.andNot(commits).forEach(collect);
+            std::vector<std::string> hashes = bitmapPack->hashesAt(positions);
+            out.insert(out.end(), hashes.begin(), hashes.end());
+            return true;
+        }
+        // Only the history down to where the haves meet the tips is walked
+        std::vector<uint32_t> missing = commitsSince(bases, tipPositions);
+        std::unordered_set<uint32_t> missingSet(missing.begin(), missing.end());
+        std::unordered_set<uint32_t> boundarySet;
+        std::vector<uint32_t> boundary;
+        size_t commits = out.size();
+        for (uint32_t pos : missing) {
+            out.push_back(graph.hashAt(pos));
+            for (uint32_t parent : graph.parents(pos)) {
+                if (parent != CommitGraph::NONE && !missingSet.count(parent) && boundarySet.insert(parent).second) {
+                    boundary.push_back(parent);
+                }
+            }
+        }
+
+        // Trees are walked from the boundary commits first, so what they hold is seen before it could be sent
+        std::unordered_set<std::string> seen;
+        auto walkTree = [&](const std::string& root, bool send) {
+            std::vector<std::string> trees = {root};
+            while (!trees.empty()) {
+                std::string tree = std::move(trees.back());
+                trees.pop_back();
+                if (tree.empty() || !seen.insert(tree).second) {
+                    continue;
+                }
+                if (send) {
+                    out.push_back(tree);
+                }
+                std::shared_ptr<const std::vector<TreeEntry>> entries = reader.readTree(tree);
+                for (const auto& entry : entries ? *entries : std::vector<TreeEntry>()) {
+                    if (entry.type == ObjectType::Tree) {
+                        trees.push_back(entry.hash);
+                    } else if (seen.insert(entry.hash).second && send) {
+                        out.push_back(entry.hash);
+                    }
+                }
+            }
+        };
+        for (uint32_t pos : boundary) {
+            std::shared_ptr<const Commit> commit = reader.readCommit(graph.hashAt(pos));
+            if (commit) {
+                walkTree(commit->treeHash, false);
+            }
+        }
+        size_t end = out.size();
+        for (size_t i = commits; i < end; ++i) {
+            std::shared_ptr<const Commit> commit = reader.readCommit(out[i]);
+            if (commit) {
+                walkTree(commit->treeHash, true);
+            }
+        }
+        return true;
+    }
+
+    // Streams objects as a pack (see sync.h); false if one cannot be read or the other side went away
+    bool sendPack(Channel& channel, const std::vector<std::string>& hashes) {
+        TRACE_SCOPE("sync.sendPack", "remote", hashes.size(), "objects");
+        channel.write("pack " + std::to_string(hashes.size()) + "\n");
+        for (const auto& hash : hashes) {
+            ObjectType type;
+            std::string payload;
+            if (!objects.read(hash, type, payload)) {
+                std::cerr << "Error: Missing object " << hash << "!" << std::endl;
+                return false;
+            }
+            sendObject(channel, hash, type, payload);
+            if (!channel.ok()) {
+                return false;
+            }
+        }
+        return channel.flush();
+    }
+
+    // Reads a pack, verifying each object and storing those not here yet as
+    // they arrive; false (with the reason in error) if the pack is bad
+    bool receivePack(Channel& channel, size_t& stored, std::string& error) {
+        TRACE_SCOPE("sync.receivePack", "remote");
+        std::string line;
+        if (!channel.readLine(line)) {
+            error = "the remote hung up";
+            return false;
+        }
+        if (line.compare(0, 6, "error ") == 0) {
+            error = "remote: " + line.substr(6);
+            return false;
+        }
+        if (line.compare(0, 5, "pack ") != 0) {
+            error = "expected a pack";
+            return false;
+        }
+        uint64_t count = std::strtoull(line.c_str() + 5, nullptr, 10);
+        for (uint64_t i = 0; i < count; ++i) {
+            std::string hash;
+            ObjectType type;
+            std::string payload;
+            if (!channel.readLine(line) || !receiveObject(channel, line, hash, type, payload)) {
+                error = "the pack ended early";
+                return false;
+            }
+            if (objects.hashObject(type, payload) != hash) {
+                error = "corrupt object " + hash;
+                return false;
+            }
+            if (!objects.exists(hash) && !writeObject(type, payload, hash).empty()) {
+                stored++;
+            }
+        }
+        return true;
+    }
+
+    // Sends this repository's branches to the other side (see sync.h)
+    void advertiseRefs(Channel& channel) {
+        refs.reload();
+        objects.refreshPacks();
+        for (const auto& [name, tip] : listBranchTips()) {
+            channel.write((tip.empty() ? "-" : tip) + " " + refName(name) + "\n");
+        }
+        channel.write("end\n");
+        channel.flush();
+    }
+
+    // Reads the other side's branch advertisement as ref -> tip ("" without commits); false if it hung up
+    static bool readAdvertisement(Channel& channel, std::map<std::string, std::string>& remoteRefs) {
+        for (std::string line; channel.readLine(line);) {
+            if (line == "end") {
+                return true;
+            }
+            size_t space = line.find(' ');
+            if (space != std::string::npos) {
+                std::string tip = line.substr(0, space);
+                remoteRefs[line.substr(space + 1)] = tip == "-" ? "" : tip;
+            }
+        }
+        return false;
+    }
+
+    // Splits "<from>[:<to>]" refspecs into branch pairs
+    static std::vector<std::pair<std::string, std::string>> parseRefspecs(const std::vector<std::string>& refspecs) {
+        std::vector<std::pair<std::string, std::string>> pairs;
+        for (const auto& spec : refspecs) {
+            size_t colon = spec.find(':');
+            pairs.push_back(colon == std::string::npos ? std::make_pair(spec, spec)
+                                                       : std::make_pair(spec.substr(0, colon), spec.substr(colon + 1)));
+        }
+        return pairs;
+    }
+
+    // Server side of fetch: advertise, acknowledge the client's haves round
+    // by round, then send what its wants reach beyond the common commits
+    void uploadPack(Channel& channel) {
+        TRACE_SCOPE("sync.uploadPack", "remote");
+        advertiseRefs(channel);
+        std::vector<std::string> wants, common;
+        std::string line;
+        while (channel.readLine(line) && line.compare(0, 5, "want ") == 0) {
+            wants.push_back(line.substr(5));
+        }
+        if (line != "end") {
+            return;
+        }
+        while (channel.readLine(line) && line != "done") {
+            if (line.compare(0, 5, "have ") == 0) {
+                std::string hash = line.substr(5);
+                if (objects.exists(hash) && graphPosition(hash) != CommitGraph::NONE) {
+                    channel.write("ack " + hash + "\n");
+                    common.push_back(hash);
+                }
+            } else if (line != "end") {
+                return;
+            } else {
+                channel.write("end\n");
+                channel.flush();
+            }
+        }
+        std::vector<std::string> hashes;
+        if (line != "done") {
+            return;
+        }
+        if (!missingObjects(wants, common, hashes)) {
+            channel.write("error unknown commit wanted\n");
+            channel.flush();
+            return;
+        }
+        sendPack(channel, hashes);
+    }
+
+    // Server side of push: take the pack, then move each branch the client
+    // asks for, only forward, only from the tip the client saw, and never
+    // one checked out in a worktree here
+    void receiveUpdates(Channel& channel) {
+        TRACE_SCOPE("sync.receiveUpdates", "remote");
+        advertiseRefs(channel);
+        std::vector<std::array<std::string, 3>> updates; // Old tip, new tip, ref
+        std::string line;
+        while (channel.readLine(line) && line.compare(0, 7, "update ") == 0) {
+            std::stringstream ss(line.substr(7));
+            std::array<std::string, 3> update;
+            if (ss >> update[0] >> update[1] >> update[2]) {
+                updates.push_back(update);
+            }
+        }
+        size_t received = 0;
+        std::string error;
+        if (line != "end" || !receivePack(channel, received, error)) {
+            if (!error.empty()) {
+                std::cerr << "Error: Push failed: " << error << std::endl;
+            }
+            return;
+        }
+        for (const auto& [oldTip, newTip, ref] : updates) {
+            std::string branch = branchOfRef(ref);
+            std::optional<std::string> stored = storedTip(branch);
+            std::string reason;
+            if (branch.empty()) {
+                reason = "not a branch";
+            } else if (!worktreeWith(branch, true).empty()) {
+                reason = "branch is checked out";
+            } else if (!reader.readCommit(newTip)) {
+                reason = "missing objects";
+            } else if (stored.value_or("") != (oldTip == "-" ? "" : oldTip)) {
+                reason = "stale, fetch first";
+            } else if (!stored.value_or("").empty() && !reaches(newTip, *stored)) {
+                reason = "non-fast-forward";
+            } else if (setBranch(branch, newTip, std::make_optional(stored)) != RefUpdateStatus::Ok) {
+                reason = "stale, fetch first";
+            } else if (!stored) {
+                stats.branches++;
+                statsDirty = true;
+            }
+            channel.write((reason.empty() ? "ok " + ref : "ng " + ref + " " + reason) + "\n");
+        }
+        channel.write("end\n");
+        channel.flush();
+    }
+
+    // Client side of the have rounds: advertised tips this side already has
+    // are common without asking; the rest comes from the skipping walk, in
+    // rounds that double in size
+    void negotiate(Channel& channel, const std::map<std::string, std::string>& remoteRefs) {
+        TRACE_SCOPE("sync.negotiate", "remote");
+        std::vector<std::string> haves;
+        std::vector<uint32_t> tips;
+        for (const auto& [name, tip] : listBranchTips()) {
+            tips.push_back(graphPosition(tip));
+        }
+        SkippingNegotiator negotiator(graph);
+        for (const auto& [ref, tip] : remoteRefs) {
+            uint32_t pos = !tip.empty() && objects.exists(tip) ? graphPosition(tip) : CommitGraph::NONE;
+            if (pos != CommitGraph::NONE) {
+                negotiator.markCommon(pos);
+                haves.push_back(tip);
+            }
+        }
+        for (uint32_t pos : tips) {
+            negotiator.addTip(pos);
+        }
+        for (size_t batch = 16;; batch = std::min<size_t>(batch * 2, 256)) {
+            for (uint32_t pos : negotiator.next(batch > haves.size() ? batch - haves.size() : 0)) {
+                haves.push_back(graph.hashAt(pos));
+            }
+            if (haves.empty()) {
+                return;
+            }
+            for (const auto& hash : haves) {
+                channel.write("have " + hash + "\n");
+            }
+            channel.write("end\n");
+            channel.flush();
+            haves.clear();
+            std::string line;
+            while (channel.readLine(line) && line.compare(0, 4, "ack ") == 0) {
+                negotiator.markCommon(graph.find(line.substr(4)));
+            }
+            if (line != "end") {
+                return;
+            }
+        }
+    }
+
+    // Answers one connection; the service line picks what the client wants (see sync.h)
+    void serveConnection(Channel& channel) {
+        std::string service;
+        if (!channel.readLine(service)) {
+            return;
+        }
+        if (service == "objects") {
+            serveObjects(objects, channel);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(serveMutex);
+        if (service == "upload-pack") {
+            uploadPack(channel);
+        } else if (service == "receive-pack") {
+            receiveUpdates(channel);
+        }
+        flush();
+    }
+
+public:
+    RepoManager() : repoDirectory(".cbird"), commonDirectory(commonDirOf(".cbird").string()),
+                    refs(std::filesystem::path(commonDirectory) / "reftable"),
+                    wal(std::filesystem::path(commonDirectory) / "wal"),
+                    messages(std::filesystem::path(commonDirectory) / "objects" / "info", "message-index"),
+                    pathIndex(std::filesystem::path(commonDirectory) / "objects" / "info", "path-index"),
+                    objects(commonDirectory), reader(objects) {
+        TRACE_SCOPE("repo.open", "repo");
+        if (!std::filesystem::exists(repoDirectory)) {
+            std::filesystem::create_directory(repoDirectory);
+        }
+
+        config = loadConfig(commonPath("config"));
+        auto format = config.find("objectformat");
+        if (format != config.end()) {
+            HashAlgorithm algorithm;
+            if (parseHashAlgorithm(format->second, algorithm)) {
+                objects.setHashAlgorithm(algorithm);
+            } else {
+                std::cerr << "Error: Unknown object format " << format->second << " in .cbird/config!" << std::endl;
+            }
+        }
+        size_t objectCacheBytes = DEFAULT_OBJECT_CACHE_BYTES;
+        size_t payloadCacheBytes = DEFAULT_PAYLOAD_CACHE_BYTES;
+        try {
+            if (config.count("objectcachebytes")) {
+                objectCacheBytes = std::stoull(config["objectcachebytes"]);
+            }
+            if (config.count("payloadcachebytes")) {
+                payloadCacheBytes = std::stoull(config["payloadcachebytes"]);
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Error: Invalid cache size in .cbird/config!" << std::endl;
+        }
+        reader.setBudgets(objectCacheBytes, payloadCacheBytes);
+        connectPromisor();
+        if (config.count("fsync")) {
+            if (config["fsync"] == "off" || config["fsync"] == "batch" || config["fsync"] == "always") {
+                fsyncMode = config["fsync"];
+            } else {
+                std::cerr << "Error: Unknown fsync mode " << config["fsync"] << " in .cbird/config!" << std::endl;
+            }
+        }
+        refs.setDurable(fsyncMode != "off");
+        sparse.load(repoPath("sparse-checkout"));
+        wal.setDurable(fsyncMode != "off");
+        objects.setDurable(fsyncMode == "always");
+
+        // The default 'main' branch always exists, even before it is stored
+        stats.load(commonPath("meta"));
+        statsBaseline = stats;
+        if (!refs.reload()) {
+            std::cerr << "Error: Failed to read the ref tables in .cbird/reftable!" << std::endl;
+        }
+        recoverTransactions();
+        migrateLooseRefs();
+
+        std::string head;
+        if (readFile(repoPath("HEAD"), head)) {
+            while (!head.empty() && (head.back() == '\n' || head.back() == '\r')) {
+                head.pop_back();
+            }
+            if (branchExists(head)) {
+                currentBranch = head;
+            }
+        }
+    }
+
+    ~RepoManager() {
+        flush();
+    }
+
+    // Writes the index and the repository counters if they changed
+    void flush() {
+        if (indexDirty) {
+            saveIndex();
+            indexDirty = false;
+            stats.indexEntries = files.size();
+            statsDirty = true;
+        }
+        if (graphDirty) {
+            graph.save(graphPath());
+            graphDirty = false;
+        }
+        if (statsDirty) {
+            // Merge with counts other processes saved meanwhile, under a lock on the meta file
+            int lock = ::open(commonPath("meta.lock").c_str(), O_CREAT | O_RDWR, 0644);
+            if (lock >= 0) {
+                flock(lock, LOCK_EX);
+            }
+            RepoStats onDisk;
+            onDisk.load(commonPath("meta"));
+            stats = RepoStats::merge(onDisk, statsBaseline, stats);
+            stats.save(commonPath("meta"));
+            statsBaseline = stats;
+            if (lock >= 0) {
+                flock(lock, LOCK_UN);
+                ::close(lock);
+            }
+            statsDirty = false;
+        }
+        logCacheCounters();
+    }
+
+    void initRepo(std::string objectFormat = "sha256") {
+        if (std::filesystem::exists(commonPath("config"))) {
+            std::cerr << "Error: Repository already initialized!" << std::endl;
+            return;
+        }
+        HashAlgorithm algorithm;
+        if (!parseHashAlgorithm(objectFormat, algorithm)) {
+            std::cerr << "Error: Unknown object format " << objectFormat << " (expected sha256 or blake3)." << std::endl;
+            return;
+        }
+        if (stats.looseObjects + stats.packedObjects > 0 && algorithm != objects.hashAlgorithm()) {
+            std::cerr << "Error: Cannot change the object format of a repository that already has objects!" << std::endl;
+            return;
+        }
+
+        if (setConfig("objectformat", hashAlgorithmName(algorithm))) {
+            objects.setHashAlgorithm(algorithm);
+            setBranch("main", "");
+            stats.branches = 1;
+            writeFileAtomic(repoPath("HEAD"), currentBranch + "\n");
+            statsDirty = true;
+            std::cout << "Repository initialized! .cbird directory created." << std::endl;
+        } else {
+            std::cerr << "Error: Failed to create .cbird/config file!" << std::endl;
+        }
+    }
+
+    // Adds a file to the index; files .cbirdignore matches need force
+    void addFile(std::string filename, bool force = false) {
+        filename = std::filesystem::path(filename).lexically_normal().generic_string();
+        if (!force && isIgnored(filename, std::filesystem::is_directory(filename))) {
+            std::cerr << "Error: " << filename << " is ignored by .cbirdignore; use -f to add it anyway." << std::endl;
+            return;
+        }
+        if (!sparse.includes(filename)) {
+            std::cerr << "Error: " << filename << " is outside the sparse checkout." << std::endl;
+            return;
+        }
+        loadIndex();
+        updateIndexEntry(filename, snapshotFile(filename));
+        std::cout << "File added: " << filename << std::endl;
+    }
+
+    // Commits the current content of the modified files; without a message,
+    // one listing the files is generated
+    void commitChanges(std::vector<std::string> modifiedFiles, const std::string& userMessage = "") {
+        if (modifiedFiles.empty()) {
+            std::cerr << "Error: No files modified to commit." << std::endl;
+            return;
+        }
+        TRACE_SCOPE("commitChanges", "commit", currentBranch);
+        for (const auto& file : modifiedFiles) {
+            if (!sparse.includes(file)) {
+                std::cerr << "Error: " << file << " is outside the sparse checkout." << std::endl;
+                return;
+            }
+        }
+        if (!indexAtTip()) {
+            return;
+        }
+
+        // Snapshot the current content of every modified file; files gone from disk leave the index
+        std::vector<std::string> blobs = snapshotFiles(modifiedFiles);
+        for (size_t i = 0; i < modifiedFiles.size(); ++i) {
+            const std::string& file = modifiedFiles[i];
+            if (!blobs[i].empty()) {
+                updateIndexEntry(file, blobs[i]);
+            } else if (files.count(file) && !std::filesystem::exists(file)) {
+                updateIndexEntry(file, "", true);
+            }
+        }
+
+        // The branch moves by compare-and-swap; if another writer got there first,
+        // catch up with its changes and commit on top of its tip
+        std::string message = userMessage.empty() ? generateCommitMessage(modifiedFiles) : userMessage;
+        std::optional<std::string> expected = storedTip(currentBranch);
+        if (indexBranch == currentBranch && indexBase != expected.value_or("")) {
+            // The index was last saved for an older commit (another process saved
+            // over it); bring in what the branch gained since, keeping our snapshots
+            catchUpIndex(indexBase, expected.value_or(""), modifiedFiles, true);
+        }
+        // A stale update means another writer's commit landed, so retrying until
+        // ours does always makes progress; the backoff only spreads writers out
+        RefUpdateStatus status = RefUpdateStatus::Stale;
+        std::mt19937 jitter(std::random_device{}());
+        for (uint32_t attempt = 0; status == RefUpdateStatus::Stale; ++attempt) {
+            if (attempt > 0) {
+                // Exponential backoff with jitter so competing writers do not retry in lockstep
+                uint32_t window = std::min(2u << std::min(attempt, 16u), COMMIT_BACKOFF_MS);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1 + jitter() % window));
+                std::optional<std::string> moved = storedTip(currentBranch);
+                if (!catchUpIndex(expected.value_or(""), moved.value_or(""), modifiedFiles)) {
+                    return;
+                }
+                expected = moved;
+            }
+            std::vector<std::string> parents;
+            if (expected && !expected->empty()) {
+                parents.push_back(*expected);
+            }
+            status = recordCommit(message, "Modified " + join(modifiedFiles, ", "), parents, expected);
+        }
+        if (status != RefUpdateStatus::Ok) {
+            return;
+        }
+
+        std::cout << "Commit made on branch " << currentBranch << " with message: " << message << std::endl;
+    }
+
+    // Streams the history of the current branch (or all branches) newest
+    // first, stopping as soon as the requested commits are shown or the
+    // reader of the output has gone away
+    void showCommitHistory(const LogOptions& options = {}) {
+        TRACE_SCOPE("log.walk", "log", currentBranch);
+        ReadSnapshot snapshot(*this);
+        BufferedOutput out;
+        std::vector<std::string> branches;
+        if (options.all) {
+            out << "Commit History for all branches:\n";
+            for (const auto& [name, tip] : listBranchTips()) {
+                branches.push_back(name);
+            }
+        } else {
+            out << "Commit History for branch " << currentBranch << ":\n";
+            branches.push_back(currentBranch);
+        }
+        // With --until the walk starts where each branch stood at that time
+        std::vector<std::string> tips;
+        for (const auto& name : branches) {
+            std::string tip = options.until ? branchAt(name, *options.until) : branchTip(name);
+            if (!tip.empty()) {
+                tips.push_back(tip);
+            }
+        }
+        if (tips.empty() || options.maxCount == 0) {
+            return;
+        }
+
+        // With --grep, commits in the message index are ruled out from their
+        // posting lists without being read; others are matched directly and
+        // indexed afterwards
+        MessageQuery query;
+        std::vector<bool> candidates;
+        std::vector<PostingIndex::Entry> unindexed;
+        bool useIndex = messageIndexEnabled();
+        // Likewise with paths, through the path index: commits listed for none
+        // of the paths are skipped, and the rest need no tree lookups
+        std::vector<bool> pathCandidates;
+        std::vector<PostingIndex::Entry> pathsUnindexed;
+        bool usePathIndex = !options.paths.empty() && pathIndexEnabled() &&
+            std::find(options.paths.begin(), options.paths.end(), "") == options.paths.end();
+        if (usePathIndex) {
+            TRACE_SCOPE("log.pathIndex", "log");
+            pathIndex.load();
+            pathCandidates.assign(pathIndex.size(), false);
+            for (const auto& path : options.paths) {
+                for (const auto& key : {path, path + "/"}) {
+                    for (uint32_t number : pathIndex.postings(key)) {
+                        pathCandidates[number] = true;
+                    }
+                }
+            }
+        }
+        if (!options.grep.empty()) {
+            if (!query.parse(options.grep)) {
+                std::cerr << "Error: Empty search query!" << std::endl;
+                return;
+            }
+            if (useIndex) {
+                TRACE_SCOPE("log.grepIndex", "log");
+                messages.load();
+                candidates = query.candidates(messages);
+            }
+        }
+
+        size_t shown = 0;
+        walkHistory(tips, options.order, [&](uint32_t pos) {
+            if (!out.ok()) {
+                return WalkStep::Stop;
+            }
+            int64_t time = graph.time(pos);
+            if (options.since && time < *options.since) {
+                return WalkStep::Prune; // Its ancestors are older still
+            }
+            if (options.until && time > *options.until) {
+                return WalkStep::Continue; // Merged in from a side branch after the bound
+            }
+            std::string hash = graph.hashAt(pos);
+            uint32_t number = useIndex && !options.grep.empty() ? messages.find(hash) : PostingIndex::NONE;
+            if (number != PostingIndex::NONE && !candidates[number]) {
+                return WalkStep::Continue;
+            }
+            uint32_t pathNumber = usePathIndex ? pathIndex.find(hash) : PostingIndex::NONE;
+            if (pathNumber != PostingIndex::NONE && !pathCandidates[pathNumber]) {
+                return WalkStep::Continue;
+            }
+            std::shared_ptr<const Commit> found = reader.readCommit(hash);
+            if (!found) {
+                std::cerr << "Error: Missing commit " << hash << "!" << std::endl;
+                return WalkStep::Prune;
+            }
+            const Commit& commit = *found;
+            if (useIndex && !options.grep.empty() && number == PostingIndex::NONE) {
+                unindexed.push_back({hash, tokenizeMessage(commit.message)});
+            }
+            if (!options.grep.empty() && (number == PostingIndex::NONE || !query.exact()) &&
+                !query.matches(commit.message)) {
+                return WalkStep::Continue;
+            }
+            if (!options.author.empty() && commit.author.find(options.author) == std::string::npos) {
+                return WalkStep::Continue;
+            }
+            if (usePathIndex && pathNumber == PostingIndex::NONE) {
+                std::vector<std::string> changed = changedPaths(commit);
+                pathsUnindexed.push_back({hash, changed});
+                bool touched = false;
+                for (const auto& path : options.paths) {
+                    touched = touched || std::binary_search(changed.begin(), changed.end(), path) ||
+                              std::binary_search(changed.begin(), changed.end(), path + "/");
+                }
+                if (!touched) {
+                    return WalkStep::Continue;
+                }
+            } else if (!usePathIndex && !options.paths.empty() && !touchesPaths(commit, options.paths)) {
+                return WalkStep::Continue;
+            }
+            out << "Commit Hash: " << objects.abbreviate(commit.commitHash) << "\n";
+            if (!commit.author.empty()) {
+                out << "Author: " << commit.author << "\n";
+            }
+            out << "Message: " << commit.message << "\n";
+            out << "Timestamp: " << commit.timestamp;
+            out << "Changes: " << commit.changes << "\n\n";
+            return ++shown < options.maxCount && out.ok() ? WalkStep::Continue : WalkStep::Stop;
+        });
+        messages.add(unindexed);
+        pathIndex.add(pathsUnindexed);
+    }
+
+    void showStatus() {
+        ReadSnapshot snapshot(*this);
+        std::cout << "Currently on branch: " << currentBranch << std::endl;
+        std::string upstream = upstreamOf(currentBranch);
+        std::string tip = branchTip(currentBranch);
+        std::string upstreamTip = upstream.empty() ? "" : branchTip(upstream);
+        if (!tip.empty() && !upstreamTip.empty()) {
+            showUpstreamStatus(tip, upstream, upstreamTip);
+        }
+
+        TRACE_SCOPE("status.untracked", "status");
+        loadIndex();
+        loadIgnoreRules();
+        std::set<std::string> trackedDirs;
+        for (const auto& [path, hash] : files) {
+            for (size_t slash = path.find('/'); !hash.empty() && slash != std::string::npos; slash = path.find('/', slash + 1)) {
+                trackedDirs.insert(path.substr(0, slash));
+            }
+        }
+        std::vector<std::string> untracked;
+        findUntracked("", trackedDirs, untracked);
+        if (!untracked.empty()) {
+            std::cout << "Untracked files:\n";
+            for (const auto& path : untracked) {
+                std::cout << "  " << path << "\n";
+            }
+            std::cout << std::flush;
+        }
+    }
+
+    // Repository-scale metrics, read from .cbird/meta and .cbird/cache-log rather than the objects themselves
+    void showStats(size_t lastOperations = 20) {
+        RepoStats current;
+        current.load(commonPath("meta"));
+
+        std::vector<std::string> lines;
+        std::ifstream in(commonPath("cache-log"));
+        for (std::string line; std::getline(in, line);) {
+            lines.push_back(line);
+        }
+        uint64_t objectHits = 0, objectMisses = 0, payloadHits = 0, payloadMisses = 0;
+        size_t start = lines.size() > lastOperations ? lines.size() - lastOperations : 0;
+        for (size_t i = start; i < lines.size(); ++i) {
+            std::stringstream ss(lines[i]);
+            std::string objectsLabel, payloadsLabel;
+            uint64_t oh = 0, om = 0, ph = 0, pm = 0;
+            if (ss >> objectsLabel >> oh >> om >> payloadsLabel >> ph >> pm) {
+                objectHits += oh;
+                objectMisses += om;
+                payloadHits += ph;
+                payloadMisses += pm;
+            }
+        }
+        auto hitRate = [](uint64_t hits, uint64_t misses) {
+            std::stringstream ss;
+            if (hits + misses == 0) {
+                ss << "n/a";
+            } else {
+                ss.precision(1);
+                ss << std::fixed << 100.0 * hits / (hits + misses) << "% (" << hits << "/" << hits + misses << ")";
+            }
+            return ss.str();
+        };
+
+        std::cout << "Repository statistics:\n";
+        std::cout << "  Commits:           " << current.commits << "\n";
+        std::cout << "  Trees:             " << current.trees << "\n";
+        std::cout << "  Blobs:             " << current.blobs << "\n";
+        std::cout << "  Loose objects:     " << current.looseObjects << " (" << current.looseBytes << " bytes)\n";
+        std::cout << "  Packed objects:    " << current.packedObjects << " in " << current.packs << " pack(s) ("
+                  << current.packBytes << " bytes)\n";
+        std::cout << "  Index entries:     " << current.indexEntries << "\n";
+        std::cout << "  Branches:          " << current.branches << "\n";
+        std::cout << "Cache hit rates over the last " << lines.size() - start << " operations:\n";
+        std::cout << "  Object cache:      " << hitRate(objectHits, objectMisses) << "\n";
+        std::cout << "  Payload cache:     " << hitRate(payloadHits, payloadMisses) << std::endl;
+    }
+
+    void createBranch(std::string branchName) {
+        if (branchExists(branchName)) {
+            std::cerr << "Error: Branch already exists!" << std::endl;
+            return;
+        }
+        RefUpdateStatus status = setBranch(branchName, "", std::make_optional(std::optional<std::string>()));
+        if (status == RefUpdateStatus::Stale) {
+            std::cerr << "Error: Branch already exists!" << std::endl;
+        }
+        if (status != RefUpdateStatus::Ok) {
+            return;
+        }
+        stats.branches++;
+        statsDirty = true;
+        std::cout << "Branch " << branchName << " created." << std::endl;
+    }
+
+    void switchBranch(std::string branchName) {
+        if (!branchExists(branchName)) {
+            std::cerr << "Error: Branch does not exist!" << std::endl;
+            return;
+        }
+        std::string holder = worktreeWith(branchName, false);
+        if (!holder.empty()) {
+            std::cerr << "Error: Branch " << branchName << " is checked out in the worktree " << holder << "!" << std::endl;
+            return;
+        }
+        // With sparse checkout the branch's files are materialized within the
+        // cone, and after checkout --at the tip's files come back
+        loadIndex();
+        bool restore = sparse.enabled() || !pastCommit.empty();
+        std::string tip = branchTip(branchName);
+        if (restore && !tip.empty()) {
+            std::shared_ptr<const Commit> commit = reader.readCommit(tip);
+            if (!commit) {
+                std::cerr << "Error: Missing commit " << tip << "!" << std::endl;
+                return;
+            }
+            if (!checkoutTree(commit->treeHash)) {
+                return;
+            }
+        }
+        currentBranch = branchName;
+        writeFileAtomic(repoPath("HEAD"), currentBranch + "\n");
+        if (restore && !tip.empty()) {
+            markIndexBase(tip);
+        }
+        std::cout << "Switched to branch " << branchName << std::endl;
+    }
+
+    // Sets the sparse checkout cone (or turns it off with nullopt) and brings
+    // the worktree and index in line with it. The index itself keeps its
+    // content: its tree is checked out again under the new cone.
+    void setSparseCone(const std::optional<std::vector<std::string>>& dirs) {
+        loadIndex();
+        std::string tree = writeTree("");
+        SparseCone previous = sparse;
+        if (dirs) {
+            sparse.set(*dirs);
+        } else {
+            sparse.disable();
+        }
+        if (!checkoutTree(tree)) {
+            sparse = previous;
+            return;
+        }
+        std::error_code ec;
+        if (dirs ? !sparse.save(repoPath("sparse-checkout")) : !std::filesystem::remove(repoPath("sparse-checkout"), ec) && ec) {
+            std::cerr << "Error: Failed to update .cbird/sparse-checkout!" << std::endl;
+            return;
+        }
+        std::cout << (dirs ? "Sparse checkout set to " + std::to_string(sparse.directories().size()) + " director(ies)."
+                           : std::string("Sparse checkout disabled.")) << std::endl;
+    }
+
+    void listSparseCone() {
+        if (!sparse.enabled()) {
+            std::cout << "Sparse checkout is not enabled." << std::endl;
+            return;
+        }
+        for (const auto& dir : sparse.directories()) {
+            std::cout << dir.substr(0, dir.size() - 1) << std::endl;
+        }
+    }
+
+    // Restores the tracked files to the state of the current branch at a time,
+    // found through the branch's time index. The branch itself does not move;
+    // files with uncommitted changes make it refuse. Until a switch brings
+    // back the tip, commits are refused rather than made from the old files.
+    void checkoutAt(time_t time) {
+        TRACE_SCOPE("checkoutAt", "checkout", currentBranch);
+        std::string target = branchAt(currentBranch, time);
+        if (target.empty()) {
+            std::cerr << "Error: Branch " << currentBranch << " had no commits at that time!" << std::endl;
+            return;
+        }
+        std::shared_ptr<const Commit> commit = reader.readCommit(target);
+        if (!commit) {
+            std::cerr << "Error: Missing commit " << target << "!" << std::endl;
+            return;
+        }
+        if (!checkoutTree(commit->treeHash)) {
+            return;
+        }
+        std::string tip = branchTip(currentBranch);
+        if (target == tip) {
+            markIndexBase(tip);
+        } else {
+            indexBranch = currentBranch;
+            pastCommit = target;
+            indexDirty = true;
+        }
+        std::cout << "Checked out " << objects.abbreviate(target) << " (" << currentBranch << " as of "
+                  << commit->timestamp.substr(0, commit->timestamp.find('\n')) << ")" << std::endl;
+    }
+
+    // Shows each line of a file as of the tip of the current branch with the
+    // commit that last changed it
+    void blame(const std::string& path) {
+        TRACE_SCOPE("blame", "blame", path);
+        ReadSnapshot snapshot(*this);
+        std::string tip = branchTip(currentBranch);
+        LineOrigins origins;
+        if (tip.empty() || !lineOrigins(tip, path, origins)) {
+            std::cerr << "Error: " << path << " is not in branch " << currentBranch << "!" << std::endl;
+            return;
+        }
+        std::shared_ptr<const RawObject> blob = reader.readRaw(origins.blob);
+        if (!blob) {
+            std::cerr << "Error: Missing blob " << origins.blob << "!" << std::endl;
+            return;
+        }
+        std::vector<std::string_view> lines = splitLines(blob->payload);
+        size_t width = std::to_string(lines.size()).size();
+        std::map<std::string, std::string> labels; // Origin commit -> "<hash> (<author> <date>"
+        BufferedOutput out;
+        for (size_t i = 0; i < lines.size() && out.ok(); ++i) {
+            const std::string& origin = origins.lines[i];
+            auto label = labels.find(origin);
+            if (label == labels.end()) {
+                std::shared_ptr<const Commit> commit = reader.readCommit(origin);
+                std::string text = objects.abbreviate(origin) + " (";
+                if (commit) {
+                    time_t time = commit->unixTime();
+                    char date[32];
+                    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&time));
+                    text += (commit->author.empty() ? std::string("unknown") : commit->author) + " " + date;
+                }
+                label = labels.emplace(origin, text).first;
+            }
+            std::string number = std::to_string(i + 1);
+            out << label->second << ' ' << std::string(width - number.size(), ' ') << number << ") " << lines[i] << '\n';
+        }
+    }
+
+    // Searches the tracked files of the worktree, or the trees of the given
+    // revisions, for lines matching an extended regular expression. Each
+    // distinct blob is searched once however many revisions and paths share
+    // it, by a pool of threads; results are printed in revision and path
+    // order as they become available.
+    void grep(const std::string& pattern, const std::vector<std::string>& revisions, bool ignoreCase,
+              bool fixedStrings) {
+        TRACE_SCOPE("grep", "grep");
+        LineMatcher matcher;
+        std::string error;
+        if (!matcher.compile(pattern, fixedStrings, ignoreCase, error)) {
+            std::cerr << "Error: Invalid pattern: " << error << std::endl;
+            return;
+        }
+        ReadSnapshot snapshot(*this);
+        std::vector<std::string> sources; // Worktree paths, or blob hashes
+        std::vector<std::pair<std::string, size_t>> targets; // Output prefix, source
+        bool worktree = revisions.empty();
+        if (worktree) {
+            loadIndex();
+            for (const auto& [path, hash] : files) {
+                if (!hash.empty()) {
+                    targets.push_back({path, sources.size()});
+                    sources.push_back(path);
+                }
+            }
+        } else {
+            std::unordered_map<std::string, size_t> sourceOf;
+            for (const auto& rev : revisions) {
+                std::string hash;
+                if (!resolveRevision(rev, hash)) {
+                    return;
+                }
+                std::shared_ptr<const Commit> commit = reader.readCommit(hash);
+                if (!commit) {
+                    std::cerr << "Error: " << rev << " is not a commit!" << std::endl;
+                    return;
+                }
+                std::map<std::string, std::string> tree;
+                listTreeFiles(commit->treeHash, "", tree);
+                for (const auto& [path, blob] : tree) {
+                    auto [source, added] = sourceOf.try_emplace(blob, sources.size());
+                    if (added) {
+                        sources.push_back(blob);
+                    }
+                    targets.push_back({rev + ":" + path, source->second});
+                }
+            }
+        }
+
+        if (!worktree) {
+            fetchObjects(sources);
+        }
+
+        // Workers take sources in order and publish their results; contents
+        // are kept only for sources with matching lines
+        struct Result {
+            std::string content;
+            std::vector<LineMatcher::Match> matches;
+            bool binary = false;
+            bool missing = false;
+        };
+        std::vector<std::unique_ptr<Result>> results(sources.size());
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::atomic<size_t> next{0};
+        std::atomic<bool> stop{false};
+        auto work = [&]() {
+            for (size_t i; !stop && (i = next++) < sources.size();) {
+                auto result = std::make_unique<Result>();
+                ObjectType type = ObjectType::Blob;
+                if (worktree ? !readFile(sources[i], result->content)
+                             : !objects.read(sources[i], type, result->content) || type != ObjectType::Blob) {
+                    result->missing = true;
+                } else {
+                    // Like git, content with a NUL byte near the start is binary and only reported as matching
+                    size_t probe = std::min<size_t>(result->content.size(), 8000);
+                    result->binary = std::memchr(result->content.data(), '\0', probe) != nullptr;
+                    matcher.search(result->content, result->matches, result->binary);
+                }
+                if (result->binary || result->matches.empty()) {
+                    std::string().swap(result->content);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    results[i] = std::move(result);
+                }
+                ready.notify_all();
+            }
+        };
+        size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), sources.size());
+        std::vector<std::thread> pool;
+        for (size_t i = 0; i < threadCount; ++i) {
+            pool.emplace_back(work);
+        }
+
+        BufferedOutput out;
+        for (const auto& [prefix, source] : targets) {
+            const Result* result;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&]() { return results[source] != nullptr; });
+                result = results[source].get();
+            }
+            if (result->missing && !worktree) {
+                std::cerr << "Error: Missing blob for " << prefix << "!" << std::endl;
+            } else if (result->binary && !result->matches.empty()) {
+                out << "Binary file " << prefix << " matches\n";
+            } else {
+                for (const auto& match : result->matches) {
+                    out << prefix << ':' << match.line << ':' << match.text << '\n';
+                }
+            }
+            if (!out.ok()) {
+                stop = true;
+                break;
+            }
+        }
+        for (auto& thread : pool) {
+            thread.join();
+        }
+    }
+
+    void mergeBranch(std::string branchName) {
+        if (!branchExists(branchName)) {
+            std::cerr << "Error: Branch does not exist!" << std::endl;
+            return;
+        }
+        if (!indexAtTip()) {
+            return;
+        }
+        TRACE_SCOPE("mergeBranch", "merge", branchName);
+        loadIndex();
+
+        std::cout << "Merging branch " << branchName << " into " << currentBranch << std::endl;
+
+        std::vector<std::string> changesCurrentBranch;
+        std::vector<std::string> changesOtherBranch;
+        std::unordered_set<std::string> theirFiles;
+        std::optional<std::string> expected = storedTip(currentBranch);
+        std::string ourTip = expected.value_or("");
+        std::string theirTip = branchTip(branchName);
+
+        // Collect the changes of the commits only one side has (each commit has a simple list of changed files)
+        {
+            TRACE_SCOPE("merge.collectChanges", "merge");
+            std::vector<Commit> ours = collectHistory(ourTip);
+            std::vector<Commit> theirs = collectHistory(theirTip);
+            std::unordered_set<std::string> ourHashes;
+            for (const auto& commit : ours) {
+                ourHashes.insert(commit.commitHash);
+            }
+            std::unordered_set<std::string> theirHashes;
+            for (const auto& commit : theirs) {
+                theirHashes.insert(commit.commitHash);
+                if (!ourHashes.count(commit.commitHash)) {
+                    changesOtherBranch.push_back(commit.changes);
+                    for (const auto& file : changedFiles(commit)) {
+                        theirFiles.insert(file);
+                    }
+                }
+            }
+            for (const auto& commit : ours) {
+                if (!theirHashes.count(commit.commitHash)) {
+                    changesCurrentBranch.push_back(commit.changes);
+                }
+            }
+        }
+
+        // Check for conflicts
+        bool conflict;
+        {
+            TRACE_SCOPE("merge.detectConflicts", "diff");
+            conflict = hasConflict(changesCurrentBranch, changesOtherBranch);
+        }
+        if (conflict) {
+            std::cout << "Conflict detected! Merge cannot be completed automatically." << std::endl;
+            std::cout << "Please resolve conflicts manually in the following files: ";
+            for (const auto& file : files) {
+                std::cout << file.first << " ";
+            }
+            std::cout << "\nMerge aborted." << std::endl;
+            return;
+        }
+
+        // If no conflicts, perform the merge: the files they changed are taken into the index
+        // and a merge commit joins both histories (an empty or behind branch just fast-forwards)
+        if (!changesOtherBranch.empty()) {
+            Commit theirCommit;
+            if (readCommit(theirTip, theirCommit)) {
+                for (const auto& file : theirFiles) {
+                    takeFromTree(theirCommit.treeHash, file);
+                }
+            }
+            RefUpdateStatus status =
+                ourTip.empty() || changesCurrentBranch.empty()
+                    ? setBranch(currentBranch, theirTip, std::make_optional(expected))
+                    : recordCommit("Merge branch " + branchName + " into " + currentBranch, "Merged " + branchName,
+                                   {ourTip, theirTip}, expected);
+            if (status == RefUpdateStatus::Ok && (ourTip.empty() || changesCurrentBranch.empty())) {
+                markIndexBase(theirTip);
+            }
+            if (status == RefUpdateStatus::Stale) {
+                std::cerr << "Error: Branch " << currentBranch << " moved during the merge; merge aborted." << std::endl;
+            }
+            if (status != RefUpdateStatus::Ok) {
+                return;
+            }
+        }
+
+        std::cout << "Merge completed successfully!" << std::endl;
+    }
+
+    // Packs every object reachable from a branch into one pack with reachability
+    // bitmaps. Objects of the existing pack keep their positions, so its bitmaps
+    // stay valid and only commits added since the last repack are walked.
+    void repack() {
+        TRACE_SCOPE("repack", "pack");
+        std::shared_ptr<const ObjectStore::PackList> packs = objects.packs();
+        if (packs->size() > 1) {
+            std::cerr << "Error: Expected at most one pack in " << objects.packDir() << "!" << std::endl;
+            return;
+        }
+        std::shared_ptr<const PackFile> old = packs->empty() ? nullptr : packs->front();
+        BitmapIndex index;
+        bool oldBitmaps = false;
+        std::vector<std::string> order;
+        if (old) {
+            std::filesystem::path path = old->path();
+            oldBitmaps = index.load(path.replace_extension(".bitmap"));
+            order = old->hashesInPackOrder();
+        }
+        size_t oldCount = order.size();
+
+        std::unordered_map<std::string, uint32_t> added; // New objects and their pack positions
+        auto position = [&](const std::string& hash, uint32_t& pos) {
+            uint64_t offset;
+            if (old && old->find(hash, pos, offset)) {
+                return true;
+            }
+            auto it = added.find(hash);
+            if (it == added.end()) {
+                return false;
+            }
+            pos = it->second;
+            return true;
+        };
+        auto add = [&](const std::string& hash) {
+            uint32_t pos;
+            if (position(hash, pos)) {
+                return false;
+            }
+            added[hash] = static_cast<uint32_t>(order.size());
+            order.push_back(hash);
+            return true;
+        };
+
+        // New commits in topological order, each followed by the trees and blobs it introduces
+        std::vector<std::string> newCommits;
+        {
+            TRACE_SCOPE("repack.collect", "pack");
+            for (const auto& [name, tip] : listBranchTips()) {
+                for (const auto& hash : unpackedHistory(tip, old.get())) {
+                    if (!add(hash)) {
+                        continue;
+                    }
+                    newCommits.push_back(hash);
+                    std::vector<std::string> trees = {reader.readCommit(hash)->treeHash};
+                    while (!trees.empty()) {
+                        std::string tree = std::move(trees.back());
+                        trees.pop_back();
+                        if (tree.empty() || !add(tree)) {
+                            continue;
+                        }
+                        std::shared_ptr<const std::vector<TreeEntry>> entries = reader.readTree(tree);
+                        if (!entries) {
+                            std::cerr << "Error: Missing tree " << tree << "!" << std::endl;
+                            return;
+                        }
+                        for (const auto& entry : *entries) {
+                            if (entry.type == ObjectType::Tree) {
+                                trees.push_back(entry.hash);
+                            } else if (!promisor || objects.exists(entry.hash)) {
+                                add(entry.hash); // A partial clone leaves out blobs it has not fetched
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Bitmap commits: every branch tip plus every n-th new commit
+        std::vector<std::string> selected;
+        for (size_t i = BITMAP_INTERVAL - 1; i < newCommits.size(); i += BITMAP_INTERVAL) {
+            selected.push_back(newCommits[i]);
+        }
+        for (const auto& [name, tip] : listBranchTips()) {
+            if (!tip.empty() && !index.forCommit(tip)) {
+                selected.push_back(tip);
+            }
+        }
+        if (newCommits.empty() && oldBitmaps && selected.empty()) {
+            std::cout << "Nothing to repack: all reachable objects are packed." << std::endl;
+            return;
+        }
+
+        // Write the pack: the old objects first, in their old order
+        PackWriter writer;
+        std::vector<uint64_t> typeWords[3];
+        std::string packedHashes;
+        {
+            TRACE_SCOPE("repack.write", "pack", order.size(), "objects");
+            if (!writer.begin(objects.packDir())) {
+                std::cerr << "Error: Failed to create a pack in " << objects.packDir() << "!" << std::endl;
+                return;
+            }
+            for (uint32_t pos = 0; pos < order.size(); ++pos) {
+                ObjectType type;
+                std::string payload;
+                if (!objects.read(order[pos], type, payload)) {
+                    std::cerr << "Error: Missing object " << order[pos] << "!" << std::endl;
+                    return;
+                }
+                writer.add(order[pos], type, payload);
+                std::vector<uint64_t>& words = typeWords[static_cast<int>(type)];
+                words.resize(order.size() / 64 + 1, 0);
+                words[pos / 64] |= uint64_t(1) << (pos % 64);
+                packedHashes += order[pos];
+            }
+        }
+        std::string packId = hashing::toHex(hashing::sha256(packedHashes));
+        std::filesystem::path packPath = writer.finish(packId);
+        if (packPath.empty()) {
+            std::cerr << "Error: Failed to write pack " << packId << "!" << std::endl;
+            return;
+        }
+
+        // Bitmaps of the selected commits, parents first so each can reuse its ancestors' bitmaps
+        {
+            TRACE_SCOPE("repack.bitmaps", "pack", selected.size(), "commits");
+            for (const auto& commit : selected) {
+                std::vector<uint64_t> dense;
+                markReachable({commit}, position,
+                              [&index](const std::string& hash) { return index.forCommit(hash); },
+                              true, dense, nullptr);
+                index.setCommit(commit, EwahBitmap::fromWords(dense));
+            }
+            index.setObjectCount(static_cast<uint32_t>(order.size()));
+            for (int type = 0; type < 3; ++type) {
+                index.setType(static_cast<ObjectType>(type), EwahBitmap::fromWords(typeWords[type]));
+            }
+        }
+        std::filesystem::path bitmapPath = packPath;
+        if (!index.save(bitmapPath.replace_extension(".bitmap"))) {
+            std::cerr << "Error: Failed to write bitmaps for pack " << packId << "!" << std::endl;
+            return;
+        }
+
+        // Retire the old pack and the loose copies of everything now packed
+        if (fsyncMode != "off") {
+            syncFilesystem(objects.packDir());
+        }
+        std::error_code ec;
+        if (old && old->path() != packPath) {
+            std::filesystem::path oldPath = old->path();
+            std::filesystem::remove(oldPath, ec);
+            std::filesystem::remove(oldPath.replace_extension(".idx"), ec);
+            std::filesystem::remove(oldPath.replace_extension(".bitmap"), ec);
+        }
+        old.reset();
+        objects.reloadPacks();
+        bitmapsLoaded = false;
+        bitmapPack.reset();
+        uint64_t removed = 0;
+        for (const auto& hash : order) {
+            std::filesystem::path loose = objects.loosePath(hash);
+            uint64_t size = std::filesystem::file_size(loose, ec);
+            if (!ec && std::filesystem::remove(loose, ec)) {
+                removed++;
+                stats.looseObjects -= std::min(stats.looseObjects, uint64_t(1));
+                stats.looseBytes -= std::min(stats.looseBytes, size);
+            }
+        }
+        for (const auto& [name, tip] : listBranchTips()) {
+            graphPosition(tip);
+        }
+        graph.save(graphPath());
+        graphDirty = false;
+
+        stats.packs = 1;
+        stats.packedObjects = order.size();
+        stats.packBytes = std::filesystem::file_size(packPath, ec);
+        statsDirty = true;
+
+        std::cout << "Packed " << order.size() << " objects (" << order.size() - oldCount << " new, "
+                  << removed << " loose removed) with " << index.size() << " bitmaps into "
+                  << packPath.filename().string() << std::endl;
+    }
+
+    // Makes this new repository a clone of the one in the directory source,
+    // with its config and branches. A full clone shares the source's object
+    // files as hardlinks, so it costs next to no time or space on the same
+    // filesystem. A partial one packs the commits and trees the branches
+    // reach and records a promisor (source itself unless another location is
+    // given) to fetch blobs from in batches as they are needed, starting
+    // with the checkout.
+    void cloneFrom(const std::filesystem::path& source, bool partial, const std::string& promisorLocation = "") {
+        TRACE_SCOPE("clone", "remote", source.native());
+        std::filesystem::path sourceDir = commonDirOf(source / ".cbird");
+        if (!std::filesystem::exists(sourceDir / "config")) {
+            std::cerr << "Error: " << source.string() << " is not a CodeBird repository!" << std::endl;
+            return;
+        }
+        if (std::filesystem::exists(commonPath("config"))) {
+            std::cerr << "Error: Repository already initialized!" << std::endl;
+            return;
+        }
+        std::map<std::string, std::string> sourceConfig = loadConfig(sourceDir / "config");
+        HashAlgorithm algorithm = HashAlgorithm::Sha256;
+        auto format = sourceConfig.find("objectformat");
+        if (format != sourceConfig.end() && !parseHashAlgorithm(format->second, algorithm)) {
+            std::cerr << "Error: Unknown object format " << format->second << " in " << source.string() << "!" << std::endl;
+            return;
+        }
+        objects.setHashAlgorithm(algorithm);
+        sourceConfig["objectformat"] = hashAlgorithmName(algorithm);
+        if (partial) {
+            sourceConfig["promisor"] = promisorLocation.empty() ? source.string() : promisorLocation;
+        }
+        config = sourceConfig;
+        if (!setConfig("objectformat", config["objectformat"])) {
+            std::cerr << "Error: Failed to create .cbird/config file!" << std::endl;
+            return;
+        }
+
+        RefStack sourceRefs(sourceDir / "reftable");
+        if (!sourceRefs.reload()) {
+            std::cerr << "Error: Failed to read the ref tables of " << source.string() << "!" << std::endl;
+            return;
+        }
+        RefStack::Changes branches;
+        sourceRefs.forEach(refName(""), [&branches](const std::string& name, const std::string& tip) {
+            branches[name] = tip;
+            return true;
+        });
+        branches.emplace(refName("main"), "");
+
+        size_t linked = 0, copied = 0, packed = 0;
+        if (partial) {
+            if (!packHistory(ObjectStore(sourceDir, algorithm), branches, packed)) {
+                return;
+            }
+        } else {
+            if (!linkObjects(sourceDir, linked, copied)) {
+                return;
+            }
+            // The object counts describe the same files
+            RepoStats sourceStats;
+            sourceStats.load(sourceDir / "meta");
+            stats.commits = sourceStats.commits;
+            stats.trees = sourceStats.trees;
+            stats.blobs = sourceStats.blobs;
+            stats.looseObjects = sourceStats.looseObjects;
+            stats.looseBytes = sourceStats.looseBytes;
+            stats.packs = sourceStats.packs;
+            stats.packedObjects = sourceStats.packedObjects;
+            stats.packBytes = sourceStats.packBytes;
+            objects.reloadPacks();
+        }
+        stats.branches = branches.size();
+        statsDirty = true;
+
+        if (refs.update(branches) != RefUpdateStatus::Ok) {
+            std::cerr << "Error: Failed to write the branches!" << std::endl;
+            return;
+        }
+        connectPromisor();
+
+        // Check out the branch the source has checked out
+        std::string head;
+        readFile(source / ".cbird" / "HEAD", head);
+        head = head.substr(0, head.find('\n'));
+        if (branches.count(refName(head))) {
+            currentBranch = head;
+        }
+        writeFileAtomic(repoPath("HEAD"), currentBranch + "\n");
+        std::string tip = branches[refName(currentBranch)].value_or("");
+        std::shared_ptr<const Commit> commit = tip.empty() ? nullptr : reader.readCommit(tip);
+        if (commit && checkoutTree(commit->treeHash)) {
+            markIndexBase(tip);
+        }
+        std::cout << "Cloned " << source.string() << ": " << branches.size() << " branch(es), ";
+        if (partial) {
+            std::cout << packed << " objects (blobs are fetched on demand)." << std::endl;
+        } else {
+            std::cout << linked << " object files linked, " << copied << " copied." << std::endl;
+        }
+    }
+
+    // Checks out a branch into a new directory as a linked worktree. Its
+    // .cbird holds only its own HEAD and index and a commondir file naming
+    // this repository's .cbird, whose objects, refs and config it shares. A
+    // branch can be checked out in one worktree at a time.
+    void addWorktree(const std::string& path, const std::string& branchName) {
+        if (!branchExists(branchName)) {
+            std::cerr << "Error: Branch " << branchName << " does not exist!" << std::endl;
+            return;
+        }
+        std::string holder = worktreeWith(branchName, true);
+        if (!holder.empty()) {
+            std::cerr << "Error: Branch " << branchName << " is already checked out in " << holder << "!" << std::endl;
+            return;
+        }
+        std::filesystem::path dir = std::filesystem::weakly_canonical(std::filesystem::absolute(path));
+        std::error_code ec;
+        if (std::filesystem::exists(dir) && !std::filesystem::is_empty(dir, ec)) {
+            std::cerr << "Error: " << path << " already exists and is not empty!" << std::endl;
+            return;
+        }
+        std::filesystem::create_directories(dir / ".cbird", ec);
+        std::string common = std::filesystem::weakly_canonical(commonDirectory).string();
+        if (ec || !writeFileAtomic(dir / ".cbird" / "commondir", common + "\n") ||
+            !writeFileAtomic(dir / ".cbird" / "HEAD", branchName + "\n")) {
+            std::cerr << "Error: Failed to create the worktree " << path << "!" << std::endl;
+            return;
+        }
+        std::ofstream(commonPath("worktrees"), std::ios::app) << dir.string() << "\n";
+
+        // Fill it in from there, as that worktree's own manager
+        std::filesystem::path previous = std::filesystem::current_path();
+        std::filesystem::current_path(dir, ec);
+        {
+            RepoManager worktree;
+            std::string tip = worktree.branchTip(branchName);
+            std::shared_ptr<const Commit> commit = tip.empty() ? nullptr : worktree.reader.readCommit(tip);
+            if (commit && worktree.checkoutTree(commit->treeHash)) {
+                worktree.markIndexBase(tip);
+            }
+        }
+        std::filesystem::current_path(previous, ec);
+        std::cout << "Created worktree " << dir.string() << " on branch " << branchName << std::endl;
+    }
+
+    void listWorktrees() const {
+        for (const auto& [dir, branch] : worktrees()) {
+            std::error_code ec;
+            bool present = std::filesystem::exists(dir / ".cbird", ec);
+            std::cout << dir.string() << "  " << (present ? "[" + branch + "]" : "(missing)") << std::endl;
+        }
+    }
+
+    // Answers one connection on standard input and output, for the client that spawned this process
+    void serveStdio() {
+        Channel channel(STDIN_FILENO, STDOUT_FILENO);
+        serveConnection(channel);
+    }
+
+    // Fetches branches from another repository (see connectRemote): each
+    // refspec is "<remote branch>[:<local branch>]", and without any every
+    // branch comes under its own name. Local branches only move forward, and
+    // never while checked out in a worktree.
+    void fetch(const std::string& location, const std::vector<std::string>& refspecs) {
+        TRACE_SCOPE("fetch", "remote", location);
+        std::string error;
+        std::unique_ptr<Channel> channel = connectRemote(location, "upload-pack", error);
+        std::map<std::string, std::string> remoteRefs;
+        if (!channel || !readAdvertisement(*channel, remoteRefs)) {
+            std::cerr << "Error: Cannot reach " << location << (error.empty() ? "" : ": " + error) << "!" << std::endl;
+            return;
+        }
+        std::vector<std::pair<std::string, std::string>> targets = parseRefspecs(refspecs);
+        if (refspecs.empty()) {
+            for (const auto& [ref, tip] : remoteRefs) {
+                std::string branch = branchOfRef(ref);
+                if (!branch.empty()) {
+                    targets.push_back({branch, branch});
+                }
+            }
+        }
+        std::vector<std::string> wants;
+        for (const auto& [from, to] : targets) {
+            auto remote = remoteRefs.find(refName(from));
+            if (remote == remoteRefs.end()) {
+                std::cerr << "Error: " << location << " has no branch " << from << "!" << std::endl;
+                return;
+            }
+            if (!remote->second.empty() && !objects.exists(remote->second) &&
+                std::find(wants.begin(), wants.end(), remote->second) == wants.end()) {
+                wants.push_back(remote->second);
+            }
+        }
+        for (const auto& want : wants) {
+            channel->write("want " + want + "\n");
+        }
+        channel->write("end\n");
+        if (!wants.empty()) {
+            negotiate(*channel, remoteRefs);
+        }
+        channel->write("done\n");
+        channel->flush();
+        size_t stored = 0;
+        if (!receivePack(*channel, stored, error)) {
+            std::cerr << "Error: Fetch from " << location << " failed: " << error << "!" << std::endl;
+            return;
+        }
+        channel.reset();
+
+        std::cout << "From " << location << std::endl;
+        for (const auto& [from, to] : targets) {
+            std::string tip = remoteRefs[refName(from)];
+            std::optional<std::string> current = storedTip(to);
+            std::string label = from + " -> " + to;
+            if (current && *current == tip) {
+                continue;
+            }
+            std::string reason;
+            if (!worktreeWith(to, true).empty()) {
+                reason = "checked out";
+            } else if (!current.value_or("").empty() && (tip.empty() || !reaches(tip, *current))) {
+                reason = "non-fast-forward";
+            } else if (setBranch(to, tip, std::make_optional(current)) != RefUpdateStatus::Ok) {
+                reason = "changed meanwhile";
+            }
+            if (!reason.empty()) {
+                std::cout << " ! [rejected]  " << label << " (" << reason << ")" << std::endl;
+            } else if (current.value_or("").empty()) {
+                stats.branches += current ? 0 : 1;
+                statsDirty = true;
+                std::cout << " * [new]       " << label << std::endl;
+            } else {
+                std::cout << "   " << objects.abbreviate(*current) << ".." << objects.abbreviate(tip) << "  " << label
+                          << std::endl;
+            }
+        }
+        std::cout << "Received " << stored << " new objects." << std::endl;
+    }
+
+    // Pushes branches to another repository (see connectRemote): each refspec
+    // is "<local branch>[:<remote branch>]", the current branch without any.
+    // The remote only moves a branch forward from the tip it advertised and
+    // refuses one it has checked out; the pack holds just what the
+    // advertised tips do not reach.
+    void push(const std::string& location, const std::vector<std::string>& refspecs) {
+        TRACE_SCOPE("push", "remote", location);
+        std::string error;
+        std::unique_ptr<Channel> channel = connectRemote(location, "receive-pack", error);
+        std::map<std::string, std::string> remoteRefs;
+        if (!channel || !readAdvertisement(*channel, remoteRefs)) {
+            std::cerr << "Error: Cannot reach " << location << (error.empty() ? "" : ": " + error) << "!" << std::endl;
+            return;
+        }
+        std::vector<std::pair<std::string, std::string>> targets =
+            parseRefspecs(refspecs.empty() ? std::vector<std::string>{currentBranch} : refspecs);
+        std::vector<std::string> tips, haves, lines;
+        for (const auto& [from, to] : targets) {
+            std::string tip;
+            if (!readBranch(from, tip) || tip.empty()) {
+                std::cerr << "Error: Branch " << from << " has no commits to push!" << std::endl;
+                return;
+            }
+            auto remote = remoteRefs.find(refName(to));
+            std::string old = remote == remoteRefs.end() ? "" : remote->second;
+            if (old == tip) {
+                std::cout << "   " << from << " -> " << to << " (up to date)" << std::endl;
+            } else if (!old.empty() && (!objects.exists(old) || !reaches(tip, old))) {
+                std::cout << " ! [rejected]  " << from << " -> " << to << " (non-fast-forward, fetch first)" << std::endl;
+            } else {
+                tips.push_back(tip);
+                lines.push_back("update " + (old.empty() ? "-" : old) + " " + tip + " " + refName(to) + "\n");
+            }
+        }
+        if (lines.empty()) {
+            return;
+        }
+        for (const auto& [ref, tip] : remoteRefs) {
+            if (!tip.empty() && objects.exists(tip) && graphPosition(tip) != CommitGraph::NONE) {
+                haves.push_back(tip);
+            }
+        }
+        std::vector<std::string> hashes;
+        if (!missingObjects(tips, haves, hashes)) {
+            return;
+        }
+        for (const auto& line : lines) {
+            channel->write(line);
+        }
+        channel->write("end\n");
+        if (!sendPack(*channel, hashes)) {
+            std::cerr << "Error: Push to " << location << " failed while sending objects!" << std::endl;
+            return;
+        }
+        std::cout << "To " << location << " (" << hashes.size() << " objects)" << std::endl;
+        // Replies are "ok <ref>" or "ng <ref> <reason>"
+        const std::string ok = "ok ", rejected = "ng ";
+        std::string line;
+        while (channel->readLine(line) && line != "end") {
+            std::string branch, reason;
+            if (line.rfind(ok, 0) == 0) {
+                branch = branchOfRef(line.substr(ok.size()));
+            } else if (line.rfind(rejected, 0) == 0) {
+                std::string rest = line.substr(rejected.size());
+                size_t space = rest.find(' ');
+                if (space != std::string::npos && space + 1 < rest.size()) {
+                    branch = branchOfRef(rest.substr(0, space));
+                    reason = rest.substr(space + 1);
+                }
+            }
+            if (branch.empty()) {
+                std::cerr << "Error: " << location << " sent a malformed push reply: " << line << std::endl;
+                return;
+            }
+            if (reason.empty()) {
+                std::cout << "   " << branch << " updated" << std::endl;
+            } else {
+                std::cout << " ! [remote rejected]  " << branch << " (" << reason << ")" << std::endl;
+            }
+        }
+        if (line != "end") {
+            std::cerr << "Error: " << location << " hung up before confirming the push!" << std::endl;
+        }
+    }
+
+    // Serves this repository on a Unix socket (see sync.h): objects for
+    // partial clones, fetches and pushes, one thread per connection, until
+    // killed
+    void serve(const std::string& socketPath) {
+        std::string error;
+        int listener = Channel::listenUnix(socketPath, error);
+        if (listener < 0) {
+            std::cerr << "Error: Cannot listen on " << socketPath << ": " << error << std::endl;
+            return;
+        }
+        std::cout << "Serving objects on " << socketPath << std::endl;
+        while (true) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd < 0 && errno == EINTR) {
+                continue;
+            }
+            if (fd < 0) {
+                std::cerr << "Error: Accepting a connection failed: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            std::thread([this, fd]() {
+                Channel channel(fd, fd);
+                serveConnection(channel);
+            }).detach();
+        }
+        ::close(listener);
+    }
+
+    // Lists the branches whose name starts with prefix; verbose adds each tip,
+    // its ahead/behind counts against its upstream and its message
+    void listBranches(bool verbose, const std::string& prefix = "") {
+        TRACE_SCOPE("branch.list", "refs", prefix);
+        ReadSnapshot snapshot(*this);
+        std::vector<std::pair<std::string, std::string>> tips = listBranchTips(prefix);
+        size_t width = 0;
+        for (const auto& entry : tips) {
+            width = std::max(width, entry.first.size());
+        }
+        std::stringstream out;
+        for (const auto& [name, tip] : tips) {
+            out << (name == currentBranch ? "* " : "  ") << name;
+            if (!verbose) {
+                out << "\n";
+                continue;
+            }
+            out << std::string(width - name.size() + 1, ' ');
+            std::shared_ptr<const Commit> commit = tip.empty() ? nullptr : reader.readCommit(tip);
+            if (!commit) {
+                out << "(no commits)\n";
+                continue;
+            }
+            out << objects.abbreviate(tip);
+            std::string upstream = upstreamOf(name);
+            std::string upstreamTip = upstream.empty() ? "" : branchTip(upstream);
+            if (!upstreamTip.empty()) {
+                uint64_t ahead, behind;
+                aheadBehind(tip, upstreamTip, ahead, behind);
+                out << " [" << upstream;
+                if (ahead) out << ": ahead " << ahead;
+                if (ahead && behind) out << ",";
+                if (behind) out << (ahead ? " " : ": ") << "behind " << behind;
+                out << "]";
+            }
+            out << " " << commit->message.substr(0, commit->message.find('\n')) << "\n";
+        }
+        std::cout << out.str() << std::flush;
+    }
+
+    void deleteBranch(const std::string& branchName) {
+        if (branchName == currentBranch) {
+            std::cerr << "Error: Cannot delete the current branch " << branchName << "!" << std::endl;
+            return;
+        }
+        if (branchName == "main") {
+            std::cerr << "Error: Cannot delete the default branch main!" << std::endl;
+            return;
+        }
+        std::string holder = worktreeWith(branchName, false);
+        if (!holder.empty()) {
+            std::cerr << "Error: Cannot delete branch " << branchName << ", checked out in the worktree " << holder << "!"
+                      << std::endl;
+            return;
+        }
+        std::string tip;
+        if (!readBranch(branchName, tip)) {
+            std::cerr << "Error: Branch does not exist!" << std::endl;
+            return;
+        }
+        if (refs.update({{refName(branchName), std::nullopt}}, {{refName(branchName), tip}}) != RefUpdateStatus::Ok) {
+            std::cerr << "Error: Failed to delete branch " << branchName << "!" << std::endl;
+            return;
+        }
+        stats.branches -= std::min<uint64_t>(stats.branches, 1);
+        statsDirty = true;
+        std::cout << "Deleted branch " << branchName << (tip.empty() ? "" : " (was " + objects.abbreviate(tip) + ")")
+                  << "." << std::endl;
+    }
+
+    // Sets the upstream the current branch's ahead/behind counts are computed against
+    void setUpstream(const std::string& upstream) {
+        if (!branchExists(upstream)) {
+            std::cerr << "Error: Branch " << upstream << " does not exist!" << std::endl;
+            return;
+        }
+        if (!setConfig("branch." + currentBranch + ".upstream", upstream)) {
+            std::cerr << "Error: Failed to update .cbird/config!" << std::endl;
+            return;
+        }
+        std::cout << "Branch " << currentBranch << " now tracks " << upstream << "." << std::endl;
+    }
+
+    // Lists the branches whose history contains the given commit (a branch, hash or hash prefix)
+    void showBranchesContaining(const std::string& rev) {
+        ReadSnapshot snapshot(*this);
+        std::string target;
+        if (!resolveRevision(rev, target)) {
+            return;
+        }
+        if (!reader.readCommit(target)) {
+            std::cerr << "Error: " << rev << " is not a commit!" << std::endl;
+            return;
+        }
+        TRACE_SCOPE("branch.contains", "pack", target);
+        for (const auto& [name, tip] : listBranchTips()) {
+            if (!tip.empty() && reaches(tip, target)) {
+                std::cout << (name == currentBranch ? "* " : "  ") << name << "\n";
+            }
+        }
+        std::cout << std::flush;
+    }
+
+    // Shows an object given by branch, hash or hash prefix: a commit's header and message,
+    // a tree's entries or a blob's content
+    void showObject(const std::string& rev) {
+        ReadSnapshot snapshot(*this);
+        std::string hash;
+        if (!resolveRevision(rev, hash)) {
+            return;
+        }
+        std::shared_ptr<const RawObject> raw = reader.readRaw(hash);
+        if (!raw) {
+            std::cerr << "Error: Failed to read object " << hash << "!" << std::endl;
+            return;
+        }
+        if (raw->type == ObjectType::Blob) {
+            std::cout << raw->payload << std::flush;
+            return;
+        }
+        if (raw->type == ObjectType::Tree) {
+            std::shared_ptr<const std::vector<TreeEntry>> entries = reader.readTree(hash);
+            for (const auto& entry : entries ? *entries : std::vector<TreeEntry>()) {
+                std::cout << objectTypeName(entry.type) << " " << objects.abbreviate(entry.hash) << " " << entry.name << "\n";
+            }
+            std::cout << std::flush;
+            return;
+        }
+        std::shared_ptr<const Commit> commit = reader.readCommit(hash);
+        if (!commit) {
+            std::cerr << "Error: Failed to parse commit " << hash << "!" << std::endl;
+            return;
+        }
+        std::cout << "Commit Hash: " << commit->commitHash << "\n";
+        std::cout << "Tree: " << objects.abbreviate(commit->treeHash) << "\n";
+        for (const auto& parent : commit->parents) {
+            std::cout << "Parent: " << objects.abbreviate(parent) << "\n";
+        }
+        std::cout << "Branch: " << commit->branchName << "\n";
+        if (!commit->author.empty()) {
+            std::cout << "Author: " << commit->author << "\n";
+        }
+        std::cout << "Message: " << commit->message << "\n";
+        std::cout << "Timestamp: " << commit->timestamp;
+        std::cout << "Changes: " << commit->changes << std::endl;
+    }
+
+    // Help function to show available commands
+    void showHelp() {
+        std::cout << "CodeBird - A simple version control system\n\n";
+        std::cout << "Usage:\n";
+        std::cout << "  codebird <command> <repo_name> [options]\n\n";
+        std::cout << "Commands:\n";
+        std::cout << "  init [--object-format=<sha256|blake3>]\n";
+        std::cout << "                        Initialize a new CodeBird repository\n";
+        std::cout << "  add <file> [-f]       Add a file to the repository (-f: even if .cbirdignore matches it)\n";
+        std::cout << "  commit <file> [-m <message>]\n";
+        std::cout << "                        Commit changes made to the repository\n";
+        std::cout << "  log [--all] [--date-order | --topo-order] [-n <count>] [--since=<date>]\n";
+        std::cout << "      [--until=<date>] [--author=<name>] [--grep=<query>] [-- <path>...]\n";
+        std::cout << "                        Show the history of the current branch (or all branches), newest\n";
+        std::cout << "                        first; dates are YYYY-MM-DD [HH:MM[:SS]] or @<epoch seconds>; a query\n";
+        std::cout << "                        needs all of its words, \"OR\" separates alternatives, -word excludes\n";
+        std::cout << "  status                Show the current status of the repository\n";
+        std::cout << "  stats [--last <n>]    Show object, index and branch counts and recent cache hit rates\n";
+        std::cout << "  create <branch_name>  Create a new branch\n";
+        std::cout << "  switch <branch_name>  Switch to an existing branch\n";
+        std::cout << "  checkout --at <date>  Restore the files to the state of the current branch at a date\n";
+        std::cout << "  clone <source> <directory> [--filter=blob:none] [--promisor=<dir | unix:socket>]\n";
+        std::cout << "                        Clone a repository; with a filter, blobs are fetched when needed\n";
+        std::cout << "  serve --socket=<path> Serve partial clones, fetches and pushes on a Unix socket\n";
+        std::cout << "  fetch <remote> [<branch>[:<local>]...]\n";
+        std::cout << "                        Fetch branches from a repository directory or unix:<socket>\n";
+        std::cout << "  push <remote> [<branch>[:<remote branch>]...]\n";
+        std::cout << "                        Push branches to a repository directory or unix:<socket>\n";
+        std::cout << "  worktree add <path> <branch> | list\n";
+        std::cout << "                        Check out a branch in another directory sharing this repository\n";
+        std::cout << "  sparse set <dir>... | list | disable\n";
+        std::cout << "                        Only check out the given directories (cone mode)\n";
+        std::cout << "  blame <file>          Show the commit that last changed each line of a file\n";
+        std::cout << "  grep [-i] [-F] <pattern> [<rev>...]\n";
+        std::cout << "                        Search tracked files, or the files of revisions, for a regular expression\n";
+        std::cout << "  merge <branch_name>   Merge a branch into the current branch\n";
+        std::cout << "  branch [-v] [--list <prefix>]\n";
+        std::cout << "                        List branches (those starting with prefix); -v adds tips and\n";
+        std::cout << "                        ahead/behind counts against upstreams\n";
+        std::cout << "  branch -d <branch>    Delete a branch\n";
+        std::cout << "  branch -u <upstream>  Set the upstream of the current branch (default: the upstream\n";
+        std::cout << "                        config setting, else main)\n";
+        std::cout << "  branch --contains <commit>\n";
+        std::cout << "                        List the branches whose history contains a commit\n";
+        std::cout << "  show <rev>            Show a commit, tree or blob by branch, hash or unique hash prefix\n";
+        std::cout << "  repack                Pack all reachable objects and write reachability bitmaps\n";
+        std::cout << "  --help, -h            Show this help message\n";
+        std::cout << "\nOptions:\n";
+        std::cout << "  --trace=<file>        Write Chrome trace-event JSON of command phases to <file>\n";
+        std::cout << "                        (also enabled by the CODEBIRD_TRACE environment variable)\n";
+        std::cout << "\nFor more information, see the CodeBird documentation.\n";
+    }
+};
+
+#endif // CODEBIRD_H
@@ -0,0 +1,480 @@
+#include "codebird.h"
+#include "blake3.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <random>
+
+// Benchmark driver for CodeBird. Generates synthetic repositories and times
+// the RepoManager operations at increasing scales, emitting JSON so results
+// can be compared between releases.
+
+// Stream buffer that swallows everything; used to silence RepoManager output
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Redirects std::cout and std::cerr into a NullBuffer for its lifetime
+class SilenceOutput {
+private:
+    NullBuffer null;
+    std::streambuf* oldOut;
+    std::streambuf* oldErr;
+
+public:
+    SilenceOutput() {
+        oldOut = std::cout.rdbuf(&null);
+        oldErr = std::cerr.rdbuf(&null);
+    }
+    ~SilenceOutput() {
+        std::cout.rdbuf(oldOut);
+        std::cerr.rdbuf(oldErr);
+    }
+};
+
+// Parameters of one synthetic repository
+struct BenchConfig {
+    std::vector<size_t> scales = {1000, 10000};
+    size_t files = 0;       // 0 means "same as scale"
+    size_t depth = 4;       // Directory nesting of generated files
+    size_t commits = 0;     // 0 means "scale / 10"
+    size_t fanout = 4;      // Number of branches created off main
+    std::string sizeDist = "mixed"; // empty, small, mixed or large
+    uint32_t seed = 42;
+    std::string output;     // JSON output path, stdout if empty
+    std::string workDir;    // Where synthetic repositories are generated
+    bool keep = false;      // Keep generated repositories after the run
+    bool hashOnly = false;  // Run the hashing microbenchmark instead
+    std::vector<size_t> hashSizes = {64, 1024, 16 * 1024, 1024 * 1024};
+};
+
+// Accumulated timing of one operation type
+struct OpTiming {
+    size_t count = 0;
+    double totalMs = 0.0;
+};
+
+// Writes synthetic files on disk and remembers their relative paths
+class SyntheticRepo {
+private:
+    std::mt19937 rng;
+    const BenchConfig& config;
+
+    size_t pickSize() {
+        if (config.sizeDist == "empty") {
+            return 0;
+        }
+        // Log-normal sizes roughly match source trees: most files are small, a few are large
+        double median = 1024.0;
+        double sigma = 1.0;
+        if (config.sizeDist == "small") {
+            median = 256.0;
+            sigma = 0.5;
+        } else if (config.sizeDist == "large") {
+            median = 64.0 * 1024.0;
+            sigma = 1.5;
+        }
+        std::lognormal_distribution<double> dist(std::log(median), sigma);
+        return std::min<size_t>(static_cast<size_t>(dist(rng)), 64u * 1024u * 1024u);
+    }
+
+    std::string makePath(size_t index) {
+        std::string path;
+        size_t value = index;
+        for (size_t level = 0; level < config.depth; ++level) {
+            path += "d" + std::to_string(value % 16) + "/";
+            value /= 16;
+        }
+        return path + "file" + std::to_string(index) + ".txt";
+    }
+
+public:
+    std::vector<std::string> paths;
+    uint64_t totalBytes = 0;
+
+    SyntheticRepo(const BenchConfig& config) : rng(config.seed), config(config) {}
+
+    void generate(size_t fileCount) {
+        std::string chunk(4096, 'x');
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            chunk[i] = static_cast<char>('a' + rng() % 26);
+        }
+
+        paths.reserve(fileCount);
+        for (size_t i = 0; i < fileCount; ++i) {
+            std::string path = makePath(i);
+            std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+
+            size_t size = pickSize();
+            std::ofstream out(path, std::ios::binary);
+            out << "file " << i << "\n";
+            for (size_t written = 0; written < size; written += chunk.size()) {
+                out.write(chunk.data(), std::min(chunk.size(), size - written));
+            }
+            totalBytes += size;
+            paths.push_back(path);
+        }
+    }
+};
+
+// Times a callable and adds the result to the given operation
+template <typename Fn>
+void timeOp(OpTiming& timing, size_t count, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    timing.count += count;
+    timing.totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Runs every benchmarked operation on a repository of the given scale
+std::map<std::string, OpTiming> runScale(const BenchConfig& config, size_t scale, SyntheticRepo& synth) {
+    std::map<std::string, OpTiming> timings;
+    size_t commitCount = config.commits ? config.commits : std::max<size_t>(1, scale / 10);
+    const std::vector<std::string>& paths = synth.paths;
+
+    SilenceOutput silence;
+    RepoManager repo;
+
+    timeOp(timings["addFile"], paths.size(), [&] {
+        for (const auto& path : paths) {
+            repo.addFile(path);
+        }
+    });
+
+    // Main gets the first half of the files, the branches share the rest so merges are conflict-free
+    size_t mainFiles = std::max<size_t>(1, paths.size() / 2);
+    size_t perCommit = std::max<size_t>(1, mainFiles / commitCount);
+    timeOp(timings["commitChanges"], commitCount, [&] {
+        for (size_t c = 0; c < commitCount; ++c) {
+            std::vector<std::string> batch;
+            for (size_t f = 0; f < perCommit; ++f) {
+                batch.push_back(paths[(c * perCommit + f) % mainFiles]);
+            }
+            repo.commitChanges(batch);
+        }
+    });
+
+    timeOp(timings["showCommitHistory"], 1, [&] { repo.showCommitHistory(); });
+    timeOp(timings["showStatus"], 1, [&] { repo.showStatus(); });
+
+    std::vector<std::string> branchNames;
+    for (size_t b = 0; b < config.fanout; ++b) {
+        branchNames.push_back("bench-" + std::to_string(b));
+    }
+
+    timeOp(timings["createBranch"], branchNames.size(), [&] {
+        for (const auto& name : branchNames) {
+            repo.createBranch(name);
+        }
+    });
+
+    // Each branch commits its own slice of the remaining files
+    size_t branchPool = paths.size() - mainFiles;
+    size_t branchCommits = std::max<size_t>(1, commitCount / std::max<size_t>(1, config.fanout));
+    for (size_t b = 0; b < branchNames.size(); ++b) {
+        timeOp(timings["switchBranch"], 1, [&] { repo.switchBranch(branchNames[b]); });
+        timeOp(timings["commitChanges"], branchCommits, [&] {
+            for (size_t c = 0; c < branchCommits; ++c) {
+                size_t index = branchPool ? mainFiles + (b * branchCommits + c) % branchPool : 0;
+                repo.commitChanges({paths[index]});
+            }
+        });
+    }
+
+    timeOp(timings["switchBranch"], 1, [&] { repo.switchBranch("main"); });
+    timeOp(timings["mergeBranch"], branchNames.size(), [&] {
+        for (const auto& name : branchNames) {
+            repo.mergeBranch(name);
+        }
+    });
+    timeOp(timings["showCommitHistory"], 1, [&] { repo.showCommitHistory(); });
+    timeOp(timings["showStatus"], 1, [&] { repo.showStatus(); });
+
+    return timings;
+}
+
+// Escapes a string for inclusion in JSON output
+std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+std::vector<size_t> parseScales(const std::string& list) {
+    std::vector<size_t> scales;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            scales.push_back(std::stoull(item));
+        }
+    }
+    return scales;
+}
+
+// Throughput in MB/s of hashing bytesPerRound bytes, repeated until enough time has passed
+template <typename Fn>
+double measureThroughput(size_t bytesPerRound, Fn fn) {
+    size_t rounds = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        fn();
+        ++rounds;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < 0.2);
+    return bytesPerRound * rounds / elapsed / (1024.0 * 1024.0);
+}
+
+// Compares the SHA-256 backends on this machine, single-buffer and multi-buffer
+std::string runHashBench(const BenchConfig& config) {
+    const hashing::Sha256Backend backends[] = {
+        hashing::Sha256Backend::Portable, hashing::Sha256Backend::ShaNi, hashing::Sha256Backend::Avx2};
+    std::mt19937 rng(config.seed);
+    volatile uint8_t sink = 0;
+
+    std::stringstream json;
+    json << "{\n  \"benchmark\": \"codebird_hash_bench\",\n";
+    json << "  \"single_backend\": " << jsonString(hashing::backendName(hashing::singleBackend()))
+         << ", \"multi_backend\": " << jsonString(hashing::backendName(hashing::multiBackend())) << ",\n";
+    json << "  \"results\": [";
+
+    bool first = true;
+    for (size_t size : config.hashSizes) {
+        // Enough messages for about 4 MB per round, at least one full set of lanes
+        size_t count = std::max<size_t>(8, (4u << 20) / std::max<size_t>(size, 1));
+        std::vector<std::string> messages(count, std::string(size, '\0'));
+        for (auto& message : messages) {
+            for (auto& c : message) {
+                c = static_cast<char>(rng());
+            }
+        }
+        std::vector<std::string_view> views(messages.begin(), messages.end());
+        size_t roundBytes = count * size;
+
+        for (auto backend : backends) {
+            if (!hashing::backendSupported(backend)) {
+                continue;
+            }
+            // The AVX2 backend only exists in multi-buffer form
+            double single = -1.0;
+            if (backend != hashing::Sha256Backend::Avx2) {
+                single = measureThroughput(roundBytes, [&] {
+                    for (const auto& view : views) {
+                        sink = sink + hashing::sha256With(backend, view)[0];
+                    }
+                });
+            }
+            double multi = measureThroughput(roundBytes, [&] {
+                sink = sink + hashing::sha256ManyWith(backend, views)[0][0];
+            });
+            json << (first ? "" : ",") << "\n    {\"backend\": " << jsonString(hashing::backendName(backend))
+                 << ", \"size\": " << size << ", \"messages\": " << count
+                 << ", \"single_mb_per_s\": ";
+            if (single < 0) {
+                json << "null";
+            } else {
+                json << single;
+            }
+            json << ", \"multi_mb_per_s\": " << multi << "}";
+            first = false;
+        }
+
+        // BLAKE3: one thread versus tree-parallel hashing on every core
+        double serial = measureThroughput(roundBytes, [&] {
+            for (const auto& view : views) {
+                sink = sink + blake3::hash(view, 1)[0];
+            }
+        });
+        double parallel = measureThroughput(roundBytes, [&] {
+            for (const auto& view : views) {
+                sink = sink + blake3::hash(view)[0];
+            }
+        });
+        json << ",\n    {\"backend\": \"blake3\", \"size\": " << size << ", \"messages\": " << count
+             << ", \"single_mb_per_s\": " << serial << ", \"parallel_mb_per_s\": " << parallel << "}";
+    }
+    json << "\n  ]\n}\n";
+    return json.str();
+}
+
+void showBenchHelp() {
+    std::cout << "codebird_bench - CodeBird performance benchmarks\n\n";
+    std::cout << "Usage:\n";
+    std::cout << "  codebird_bench [options]\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --scales <n,n,...>    Repository sizes to run (default 1000,10000)\n";
+    std::cout << "  --files <n>           Files per repository (default: the scale)\n";
+    std::cout << "  --depth <n>           Directory depth of generated files (default 4)\n";
+    std::cout << "  --commits <n>         Commits on main (default: scale / 10)\n";
+    std::cout << "  --fanout <n>          Branches created and merged back (default 4)\n";
+    std::cout << "  --size-dist <dist>    File sizes: empty, small, mixed or large (default mixed)\n";
+    std::cout << "  --seed <n>            Random seed for the generator (default 42)\n";
+    std::cout << "  --work-dir <dir>      Directory for generated repositories (default: temp dir)\n";
+    std::cout << "  --keep                Keep the generated repositories\n";
+    std::cout << "  --hash                Compare the SHA-256 backends and BLAKE3 instead of timing a repository\n";
+    std::cout << "  --hash-sizes <n,...>  Message sizes for --hash (default 64,1024,16384,1048576)\n";
+    std::cout << "  --output <file>       Write JSON results to a file instead of stdout\n";
+    std::cout << "  --help, -h            Show this help message\n";
+}
+
+bool parseArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            showBenchHelp();
+            return false;
+        }
+        if (arg == "--keep") {
+            config.keep = true;
+            continue;
+        }
+        if (arg == "--hash") {
+            config.hashOnly = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--scales") {
+            config.scales = parseScales(value);
+        } else if (arg == "--hash-sizes") {
+            config.hashSizes = parseScales(value);
+        } else if (arg == "--files") {
+            config.files = std::stoull(value);
+        } else if (arg == "--depth") {
+            config.depth = std::stoull(value);
+        } else if (arg == "--commits") {
+            config.commits = std::stoull(value);
+        } else if (arg == "--fanout") {
+            config.fanout = std::stoull(value);
+        } else if (arg == "--size-dist") {
+            config.sizeDist = value;
+        } else if (arg == "--seed") {
+            config.seed = static_cast<uint32_t>(std::stoul(value));
+        } else if (arg == "--work-dir") {
+            config.workDir = value;
+        } else if (arg == "--output") {
+            config.output = value;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (config.sizeDist != "empty" && config.sizeDist != "small" &&
+        config.sizeDist != "mixed" && config.sizeDist != "large") {
+        std::cerr << "Error: Unknown size distribution " << config.sizeDist << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    try {
+        if (!parseArgs(argc, argv, config)) {
+            return 1;
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Error: Invalid numeric option." << std::endl;
+        return 1;
+    }
+
+    if (config.hashOnly) {
+        std::string json = runHashBench(config);
+        if (config.output.empty()) {
+            std::cout << json;
+            return 0;
+        }
+        std::ofstream out(config.output);
+        if (!out.is_open()) {
+            std::cerr << "Error: Failed to write " << config.output << std::endl;
+            return 1;
+        }
+        out << json;
+        return 0;
+    }
+
+    std::filesystem::path originalDir = std::filesystem::current_path();
+    std::filesystem::path workDir = config.workDir.empty()
+        ? std::filesystem::temp_directory_path() / ("codebird_bench_" + std::to_string(std::random_device{}()))
+        : std::filesystem::absolute(config.workDir);
+
+    std::stringstream json;
+    json << "{\n  \"benchmark\": \"codebird_bench\",\n";
+    json << "  \"config\": {\"depth\": " << config.depth << ", \"fanout\": " << config.fanout
+         << ", \"size_dist\": " << jsonString(config.sizeDist) << ", \"seed\": " << config.seed << "},\n";
+    json << "  \"results\": [";
+
+    for (size_t s = 0; s < config.scales.size(); ++s) {
+        size_t scale = config.scales[s];
+        size_t fileCount = config.files ? config.files : scale;
+        std::filesystem::path repoDir = workDir / ("scale_" + std::to_string(scale));
+        std::filesystem::remove_all(repoDir);
+        std::filesystem::create_directories(repoDir);
+        std::filesystem::current_path(repoDir);
+
+        std::cerr << "Generating " << fileCount << " files for scale " << scale << "..." << std::endl;
+        SyntheticRepo synth(config);
+        auto genStart = std::chrono::steady_clock::now();
+        synth.generate(fileCount);
+        double genMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - genStart).count();
+
+        std::cerr << "Running operations for scale " << scale << "..." << std::endl;
+        std::map<std::string, OpTiming> timings = runScale(config, scale, synth);
+
+        json << (s ? "," : "") << "\n    {\"scale\": " << scale << ", \"files\": " << fileCount
+             << ", \"bytes\": " << synth.totalBytes << ", \"generate_ms\": " << genMs << ",\n";
+        json << "     \"operations\": {";
+        bool first = true;
+        for (const auto& [name, timing] : timings) {
+            double perOpUs = timing.count ? timing.totalMs * 1000.0 / timing.count : 0.0;
+            json << (first ? "" : ",") << "\n       " << jsonString(name) << ": {\"count\": " << timing.count
+                 << ", \"total_ms\": " << timing.totalMs << ", \"per_op_us\": " << perOpUs << "}";
+            first = false;
+        }
+        json << "\n     }}";
+
+        std::filesystem::current_path(originalDir);
+        if (!config.keep) {
+            std::filesystem::remove_all(repoDir);
+        }
+    }
+    json << "\n  ]\n}\n";
+
+    if (!config.keep && config.workDir.empty()) {
+        std::filesystem::remove_all(workDir);
+    }
+
+    if (config.output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(config.output);
+        if (!out.is_open()) {
+            std::cerr << "Error: Failed to write " << config.output << std::endl;
+            return 1;
+        }
+        out << json.str();
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+#ifndef CODEBIRD_COMMIT_H
+#define CODEBIRD_COMMIT_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "object_store.h"
+#include "trace.h"
+
+// Simple structure for Commit
+struct Commit {
+    std::string commitHash;
+    std::string message;
+    std::string timestamp; // ctime's local-time format, for display
+    int64_t seconds = -1; // Creation time since the epoch; -1 in commits made before it was recorded
+    std::string changes; // Simple change description
+    std::string branchName; // Branch this commit belongs to
+    std::string author; // Who made the commit; "" in commits made before authors were recorded
+    std::string treeHash; // Snapshot of the tracked files
+    std::vector<std::string> parents; // Previous tip of the branch, two parents for merges
+
+    Commit() = default;
+
+    Commit(std::string msg, std::string changes, std::string branch,
+           std::string tree, std::vector<std::string> parentHashes, HashAlgorithm algorithm,
+           std::string authorName = "")
+        : message(msg), changes(changes), branchName(branch), author(authorName), treeHash(tree),
+          parents(parentHashes) {
+        TRACE_SCOPE("commit.hash", "hash");
+
+        // Generate timestamp for commit
+        time_t now = time(0);
+        timestamp = ctime(&now);
+        seconds = now;
+
+        // The commit hash is the hash of its serialized content
+        commitHash = ObjectStore::hashObject(algorithm, ObjectType::Commit, serialize());
+    }
+
+    // Commit payload: header lines, a blank line, then the message
+    std::string serialize() const {
+        std::string payload = "tree " + treeHash + "\n";
+        for (const auto& parent : parents) {
+            payload += "parent " + parent + "\n";
+        }
+        std::string time = timestamp;
+        if (!time.empty() && time.back() == '\n') {
+            time.pop_back();
+        }
+        payload += "branch " + branchName + "\n";
+        if (!author.empty()) {
+            payload += "author " + author + "\n";
+        }
+        payload += "timestamp " + time + "\n";
+        if (seconds >= 0) {
+            payload += "time " + std::to_string(seconds) + "\n";
+        }
+        payload += "changes " + changes + "\n";
+        payload += "\n" + message;
+        return payload;
+    }
+
+    // Seconds since the epoch. Older commits only have the ctime string, which
+    // is parsed in the reader's time zone; -1 if that is malformed
+    time_t unixTime() const {
+        if (seconds >= 0) {
+            return static_cast<time_t>(seconds);
+        }
+        std::tm parts = {};
+        if (!strptime(timestamp.c_str(), "%a %b %d %H:%M:%S %Y", &parts)) {
+            return -1;
+        }
+        parts.tm_isdst = -1;
+        return mktime(&parts);
+    }
+
+    static bool parse(const std::string& hash, const std::string& payload, Commit& commit) {
+        commit = Commit();
+        commit.commitHash = hash;
+        size_t pos = 0;
+        while (pos < payload.size()) {
+            size_t end = payload.find('\n', pos);
+            if (end == std::string::npos) {
+                return false;
+            }
+            if (end == pos) {
+                commit.message = payload.substr(end + 1);
+                return true;
+            }
+            std::string line = payload.substr(pos, end - pos);
+            size_t space = line.find(' ');
+            std::string key = line.substr(0, space);
+            std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+            if (key == "tree") {
+                commit.treeHash = value;
+            } else if (key == "parent") {
+                commit.parents.push_back(value);
+            } else if (key == "branch") {
+                commit.branchName = value;
+            } else if (key == "author") {
+                commit.author = value;
+            } else if (key == "timestamp") {
+                commit.timestamp = value + "\n";
+            } else if (key == "time") {
+                commit.seconds = std::strtoll(value.c_str(), nullptr, 10);
+            } else if (key == "changes") {
+                commit.changes = value;
+            }
+            pos = end + 1;
+        }
+        return false;
+    }
+};
+
+#endif // CODEBIRD_COMMIT_H
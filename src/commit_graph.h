@@ -0,0 +1,176 @@
+#ifndef CODEBIRD_COMMIT_GRAPH_H
+#define CODEBIRD_COMMIT_GRAPH_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_util.h"
+#include "pack.h"
+
+// Parent links and generation numbers of commits, so history queries walk
+// small integer records instead of parsing commit objects. A commit's
+// generation is one more than the largest generation of its parents, so a
+// walk that visits commits in decreasing generation sees every child before
+// its parents. Commit times are kept as epoch seconds, so date queries never
+// parse the timestamps of commit objects.
+//
+// File (.cbird/objects/info/commit-graph): "CBCG" v2 count, 256-entry fan-out,
+// sorted 32-byte hashes, then per commit its generation, first parent and
+// second parent as u32 graph positions (NONE when absent) and its time as a
+// signed u64, little-endian. Commits created since the file was written are
+// added in memory.
+class CommitGraph {
+public:
+    static constexpr uint32_t NONE = 0xffffffff;
+    using Parents = std::array<uint32_t, 2>;
+
+private:
+    static constexpr size_t HEADER = 12;
+    static constexpr size_t FANOUT = 256 * 4;
+    static constexpr uint32_t VERSION = 2;
+    static constexpr size_t RECORD = 20;
+
+    MappedFile file;
+    uint32_t count = 0; // Commits in the file
+
+    struct Extra {
+        std::string hash;
+        uint32_t generation;
+        Parents parents;
+        int64_t time;
+    };
+    std::vector<Extra> extras; // Commits added since the file was written; positions count + i
+    std::unordered_map<std::string, uint32_t> extraIndex;
+
+    const char* record(uint32_t pos) const {
+        return file.data() + HEADER + FANOUT + size_t(count) * 32 + size_t(pos) * RECORD;
+    }
+
+public:
+    bool load(const std::filesystem::path& path) {
+        MappedFile mapped;
+        if (!mapped.open(path) || mapped.size() < HEADER + FANOUT || mapped.view().substr(0, 4) != "CBCG" ||
+            getU32(mapped.data() + 4) != VERSION) {
+            return false;
+        }
+        uint32_t fileCount = getU32(mapped.data() + 8);
+        if (mapped.size() < HEADER + FANOUT + size_t(fileCount) * (32 + RECORD)) {
+            return false;
+        }
+        file = std::move(mapped);
+        count = fileCount;
+        extras.clear();
+        extraIndex.clear();
+        return true;
+    }
+
+    // Graph position of a commit, or NONE if it is not in the graph
+    uint32_t find(const std::string& hash) const {
+        std::string binary;
+        if (count && hexToBinary(hash, binary)) {
+            uint8_t first = static_cast<uint8_t>(binary[0]);
+            uint32_t low = first ? getU32(file.data() + HEADER + (first - 1) * 4) : 0;
+            uint32_t high = getU32(file.data() + HEADER + first * 4);
+            while (low < high) {
+                uint32_t mid = low + (high - low) / 2;
+                int cmp = std::memcmp(file.data() + HEADER + FANOUT + size_t(mid) * 32, binary.data(), 32);
+                if (cmp == 0) {
+                    return mid;
+                }
+                if (cmp < 0) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+        }
+        auto it = extraIndex.find(hash);
+        return it == extraIndex.end() ? NONE : it->second;
+    }
+
+    // Adds a commit whose parents are already in the graph; returns its position
+    uint32_t add(const std::string& hash, const std::vector<uint32_t>& parentPositions, int64_t time) {
+        Extra extra{hash, 1, {NONE, NONE}, time};
+        for (size_t i = 0; i < parentPositions.size() && i < 2; ++i) {
+            extra.parents[i] = parentPositions[i];
+            extra.generation = std::max(extra.generation, generation(parentPositions[i]) + 1);
+        }
+        uint32_t pos = count + static_cast<uint32_t>(extras.size());
+        extras.push_back(std::move(extra));
+        extraIndex[hash] = pos;
+        return pos;
+    }
+
+    uint32_t size() const { return count + static_cast<uint32_t>(extras.size()); }
+    uint32_t fileCommits() const { return count; }
+    uint32_t addedCommits() const { return static_cast<uint32_t>(extras.size()); }
+
+    std::string hashAt(uint32_t pos) const {
+        return pos < count ? binaryToHex(file.data() + HEADER + FANOUT + size_t(pos) * 32) : extras[pos - count].hash;
+    }
+
+    uint32_t generation(uint32_t pos) const {
+        return pos < count ? getU32(record(pos)) : extras[pos - count].generation;
+    }
+
+    Parents parents(uint32_t pos) const {
+        if (pos >= count) {
+            return extras[pos - count].parents;
+        }
+        return {getU32(record(pos) + 4), getU32(record(pos) + 8)};
+    }
+
+    // Commit time in seconds since the epoch
+    int64_t time(uint32_t pos) const {
+        return pos < count ? static_cast<int64_t>(getU64(record(pos) + 12)) : extras[pos - count].time;
+    }
+
+    // Writes every commit, including those added in memory, and reloads the file
+    bool save(const std::filesystem::path& path) {
+        uint32_t total = size();
+        std::vector<std::string> binaries(total);
+        std::vector<uint32_t> order(total);
+        for (uint32_t pos = 0; pos < total; ++pos) {
+            hexToBinary(hashAt(pos), binaries[pos]);
+            order[pos] = pos;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return binaries[a] < binaries[b]; });
+        std::vector<uint32_t> newPosition(total);
+        for (uint32_t i = 0; i < total; ++i) {
+            newPosition[order[i]] = i;
+        }
+
+        std::string out = "CBCG";
+        putU32(out, VERSION);
+        putU32(out, total);
+        uint32_t fanout[256] = {};
+        for (const auto& binary : binaries) {
+            fanout[static_cast<uint8_t>(binary[0])]++;
+        }
+        uint32_t running = 0;
+        for (uint32_t bucket : fanout) {
+            running += bucket;
+            putU32(out, running);
+        }
+        for (uint32_t pos : order) {
+            out += binaries[pos];
+        }
+        for (uint32_t pos : order) {
+            putU32(out, generation(pos));
+            for (uint32_t parent : parents(pos)) {
+                putU32(out, parent == NONE ? NONE : newPosition[parent]);
+            }
+            putU64(out, static_cast<uint64_t>(time(pos)));
+        }
+        std::filesystem::create_directories(path.parent_path());
+        return writeFileAtomic(path, out) && load(path);
+    }
+};
+
+#endif // CODEBIRD_COMMIT_GRAPH_H
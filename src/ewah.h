@@ -0,0 +1,303 @@
+#ifndef CODEBIRD_EWAH_H
+#define CODEBIRD_EWAH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// EWAH-compressed bitmap (Enhanced Word-Aligned Hybrid). The buffer is a
+// sequence of marker words, each followed by its literal words. A marker
+// holds a run of identical all-zero or all-one words (bit 0: the run's bit,
+// bits 1-32: run length in words) and the number of literal words that
+// follow it (bits 33-63). Boolean operations walk both bitmaps run by run,
+// so long runs are combined in one step.
+class EwahBitmap {
+private:
+    static constexpr uint64_t MAX_RUN = (uint64_t(1) << 32) - 1;
+    static constexpr uint64_t MAX_LITERALS = (uint64_t(1) << 31) - 1;
+
+    std::vector<uint64_t> buffer = {0};
+    size_t marker = 0;      // Position of the last marker word in buffer
+    uint64_t words = 0;     // Uncompressed length in 64-bit words
+
+    static bool runBit(uint64_t rlw) { return rlw & 1; }
+    static uint64_t runLength(uint64_t rlw) { return (rlw >> 1) & MAX_RUN; }
+    static uint64_t literalCount(uint64_t rlw) { return rlw >> 33; }
+
+    static uint64_t makeMarker(bool bit, uint64_t run, uint64_t literals) {
+        return uint64_t(bit) | (run << 1) | (literals << 33);
+    }
+
+    // Reads a bitmap chunk by chunk: a run of identical words, or one literal word
+    class Cursor {
+    private:
+        const std::vector<uint64_t>* buffer;
+        size_t markerPos = 0;
+        uint64_t runLeft = 0;
+        bool bit = false;
+        uint64_t literalsLeft = 0;
+        size_t literalPos = 0;
+
+        void loadMarker() {
+            while (markerPos < buffer->size()) {
+                uint64_t rlw = (*buffer)[markerPos];
+                bit = runBit(rlw);
+                runLeft = runLength(rlw);
+                literalsLeft = literalCount(rlw);
+                literalPos = markerPos + 1;
+                if (runLeft || literalsLeft) {
+                    return;
+                }
+                markerPos = literalPos;
+            }
+        }
+
+    public:
+        explicit Cursor(const std::vector<uint64_t>& buffer) : buffer(&buffer) {
+            loadMarker();
+        }
+
+        bool done() const { return runLeft == 0 && literalsLeft == 0; }
+        bool inRun() const { return runLeft > 0; }
+        bool runValue() const { return bit; }
+        uint64_t runWords() const { return runLeft; }
+
+        // The current word; all zero once the bitmap is exhausted
+        uint64_t word() const {
+            if (runLeft) {
+                return bit ? ~uint64_t(0) : 0;
+            }
+            return literalsLeft ? (*buffer)[literalPos] : 0;
+        }
+
+        void advance(uint64_t count) {
+            while (count && !done()) {
+                if (runLeft) {
+                    uint64_t step = std::min(count, runLeft);
+                    runLeft -= step;
+                    count -= step;
+                } else {
+                    literalPos++;
+                    literalsLeft--;
+                    count--;
+                }
+                if (done()) {
+                    markerPos = literalPos;
+                    loadMarker();
+                }
+            }
+        }
+    };
+
+public:
+    EwahBitmap() = default;
+
+    // Appends one uncompressed word
+    void addWord(uint64_t word) {
+        if (word == 0 || word == ~uint64_t(0)) {
+            addRun(word != 0, 1);
+            return;
+        }
+        uint64_t rlw = buffer[marker];
+        if (literalCount(rlw) == MAX_LITERALS) {
+            buffer.push_back(0);
+            marker = buffer.size() - 1;
+            rlw = 0;
+        }
+        buffer[marker] = makeMarker(runBit(rlw), runLength(rlw), literalCount(rlw) + 1);
+        buffer.push_back(word);
+        words++;
+    }
+
+    // Appends count words that are all zeros or all ones
+    void addRun(bool bit, uint64_t count) {
+        words += count;
+        while (count) {
+            uint64_t rlw = buffer[marker];
+            bool extendable = literalCount(rlw) == 0 && (runLength(rlw) == 0 || runBit(rlw) == bit);
+            if (!extendable || runLength(rlw) == MAX_RUN) {
+                buffer.push_back(0);
+                marker = buffer.size() - 1;
+                rlw = 0;
+            }
+            uint64_t step = std::min(count, MAX_RUN - runLength(rlw));
+            buffer[marker] = makeMarker(bit, runLength(rlw) + step, 0);
+            count -= step;
+        }
+    }
+
+    // Compresses a dense bitset
+    static EwahBitmap fromWords(const std::vector<uint64_t>& dense) {
+        EwahBitmap bitmap;
+        for (uint64_t word : dense) {
+            bitmap.addWord(word);
+        }
+        return bitmap;
+    }
+
+    // ORs this bitmap into a dense bitset, growing it as needed
+    void orInto(std::vector<uint64_t>& dense) const {
+        if (dense.size() < words) {
+            dense.resize(words, 0);
+        }
+        uint64_t pos = 0;
+        for (Cursor cursor(buffer); !cursor.done();) {
+            if (cursor.inRun()) {
+                uint64_t count = cursor.runWords();
+                if (cursor.runValue()) {
+                    std::fill(dense.begin() + pos, dense.begin() + pos + count, ~uint64_t(0));
+                }
+                pos += count;
+                cursor.advance(count);
+            } else {
+                dense[pos++] |= cursor.word();
+                cursor.advance(1);
+            }
+        }
+    }
+
+    uint64_t sizeInWords() const { return words; }
+    size_t compressedWords() const { return buffer.size(); }
+
+    bool get(uint64_t pos) const {
+        uint64_t target = pos / 64;
+        uint64_t at = 0;
+        for (Cursor cursor(buffer); !cursor.done();) {
+            uint64_t count = cursor.inRun() ? cursor.runWords() : 1;
+            if (target < at + count) {
+                return (cursor.word() >> (pos % 64)) & 1;
+            }
+            at += count;
+            cursor.advance(count);
+        }
+        return false;
+    }
+
+    uint64_t cardinality() const {
+        uint64_t total = 0;
+        for (Cursor cursor(buffer); !cursor.done();) {
+            if (cursor.inRun()) {
+                total += cursor.runValue() ? 64 * cursor.runWords() : 0;
+                cursor.advance(cursor.runWords());
+            } else {
+                total += __builtin_popcountll(cursor.word());
+                cursor.advance(1);
+            }
+        }
+        return total;
+    }
+
+    // Calls fn(position) for every set bit in increasing order
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        uint64_t pos = 0;
+        for (Cursor cursor(buffer); !cursor.done();) {
+            if (cursor.inRun()) {
+                uint64_t count = cursor.runWords();
+                if (cursor.runValue()) {
+                    for (uint64_t bit = pos * 64; bit < (pos + count) * 64; ++bit) {
+                        fn(bit);
+                    }
+                }
+                pos += count;
+                cursor.advance(count);
+            } else {
+                uint64_t word = cursor.word();
+                while (word) {
+                    fn(pos * 64 + __builtin_ctzll(word));
+                    word &= word - 1;
+                }
+                pos++;
+                cursor.advance(1);
+            }
+        }
+    }
+
+    enum class Op { Or, And, AndNot };
+
+    // Combines two bitmaps run by run; the shorter one is treated as zero-extended
+    static EwahBitmap combine(const EwahBitmap& a, const EwahBitmap& b, Op op) {
+        auto apply = [op](uint64_t x, uint64_t y) {
+            switch (op) {
+                case Op::Or: return x | y;
+                case Op::And: return x & y;
+                case Op::AndNot: return x & ~y;
+            }
+            return x;
+        };
+
+        EwahBitmap result;
+        Cursor left(a.buffer);
+        Cursor right(b.buffer);
+        uint64_t total = std::max(a.words, b.words);
+        while (result.words < total) {
+            bool leftRun = left.inRun() || left.done();
+            bool rightRun = right.inRun() || right.done();
+            if (leftRun && rightRun) {
+                uint64_t count = total - result.words;
+                if (!left.done()) count = std::min(count, left.runWords());
+                if (!right.done()) count = std::min(count, right.runWords());
+                result.addRun(apply(left.word(), right.word()) != 0, count);
+                left.advance(count);
+                right.advance(count);
+            } else {
+                result.addWord(apply(left.word(), right.word()));
+                left.advance(1);
+                right.advance(1);
+            }
+        }
+        return result;
+    }
+
+    EwahBitmap operator|(const EwahBitmap& other) const { return combine(*this, other, Op::Or); }
+    EwahBitmap operator&(const EwahBitmap& other) const { return combine(*this, other, Op::And); }
+    EwahBitmap andNot(const EwahBitmap& other) const { return combine(*this, other, Op::AndNot); }
+
+    // Serialized form: uncompressed word count, buffer length, then the buffer (little-endian)
+    void serialize(std::string& out) const {
+        auto put = [&out](uint64_t value) {
+            for (int i = 0; i < 8; ++i) {
+                out += static_cast<char>(value >> (8 * i));
+            }
+        };
+        put(words);
+        put(buffer.size());
+        for (uint64_t word : buffer) {
+            put(word);
+        }
+    }
+
+    // Parses a bitmap at pos, advancing pos; returns false on truncated input
+    static bool parse(const std::string& data, size_t& pos, EwahBitmap& bitmap) {
+        auto get = [&data, &pos](uint64_t& value) {
+            if (pos + 8 > data.size()) {
+                return false;
+            }
+            value = 0;
+            for (int i = 0; i < 8; ++i) {
+                value |= uint64_t(static_cast<unsigned char>(data[pos + i])) << (8 * i);
+            }
+            pos += 8;
+            return true;
+        };
+        uint64_t wordCount, length;
+        if (!get(wordCount) || !get(length) || length == 0 || length > (data.size() - pos) / 8) {
+            return false;
+        }
+        bitmap.buffer.assign(length, 0);
+        for (auto& word : bitmap.buffer) {
+            get(word);
+        }
+        bitmap.words = wordCount;
+        // Find the last marker so further appends stay valid
+        size_t at = 0;
+        while (at < bitmap.buffer.size()) {
+            bitmap.marker = at;
+            at += 1 + literalCount(bitmap.buffer[at]);
+        }
+        return at == bitmap.buffer.size();
+    }
+};
+
+#endif // CODEBIRD_EWAH_H
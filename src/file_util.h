@@ -0,0 +1,166 @@
+#ifndef CODEBIRD_FILE_UTIL_H
+#define CODEBIRD_FILE_UTIL_H
+
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Small file helpers shared by the repository modules
+
+// Reads a whole file into data; returns false if it cannot be opened
+inline bool readFile(const std::filesystem::path& path, std::string& data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    data = ss.str();
+    return true;
+}
+
+// Flushes a file (or directory) to stable storage
+inline bool syncPath(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// Flushes every pending write of the filesystem holding path with one call,
+// so a batch of files costs one flush instead of one fsync each
+inline bool syncFilesystem(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::syncfs(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// Writes data to a temporary file and renames it over path, so readers
+// never see a partially written file. Each writer gets its own temporary
+// name, so concurrent writers of one path never write into the same file.
+// With durable set, the file and its directory are fsynced so the new
+// content survives a crash.
+inline bool writeFileAtomic(const std::filesystem::path& path, const std::string& data, bool durable = false) {
+    static thread_local std::mt19937_64 random(std::random_device{}());
+    std::filesystem::path tmp;
+    int fd = -1;
+    for (int attempt = 0; attempt < 16 && fd < 0; ++attempt) {
+        std::ostringstream name;
+        name << path.filename().string() << "." << std::hex << (random() & 0xffffffff) << ".tmp";
+        tmp = path.parent_path() / name.str();
+        fd = ::open(tmp.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t written = 0; ok && written < data.size();) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n > 0) {
+            written += static_cast<size_t>(n);
+        } else {
+            ok = n < 0 && errno == EINTR;
+        }
+    }
+    if (ok && durable) {
+        ok = ::fsync(fd) == 0;
+    }
+    ok = ::close(fd) == 0 && ok;
+    std::error_code ec;
+    if (ok) {
+        std::filesystem::rename(tmp, path, ec);
+    }
+    if (!ok || ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    if (durable) {
+        syncPath(path.parent_path().empty() ? "." : path.parent_path());
+    }
+    return true;
+}
+
+// A read-only memory mapping of a whole file. The mapping stays valid after
+// the file is renamed over or removed, so readers keep a consistent view.
+class MappedFile {
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept : base(other.base), length(other.length) {
+        other.base = nullptr;
+        other.length = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(base, other.base);
+            std::swap(length, other.length);
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::filesystem::path& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if (ok && st.st_size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapped != MAP_FAILED;
+            if (ok) {
+                base = static_cast<const char*>(mapped);
+                length = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    void close() {
+        if (base) {
+            munmap(const_cast<char*>(base), length);
+        }
+        base = nullptr;
+        length = 0;
+    }
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+    std::string_view view() const { return {base, length}; }
+};
+
+#endif // CODEBIRD_FILE_UTIL_H
@@ -0,0 +1,168 @@
+#ifndef CODEBIRD_GREP_H
+#define CODEBIRD_GREP_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A literal every match of an extended regular expression must contain, so
+// files and lines without it can be skipped with a memchr-driven substring
+// search before the regex engine runs; "" if none can be told (top-level
+// alternation, or no plain characters outside groups and classes). The
+// longest such run of plain characters is chosen.
+inline std::string requiredLiteral(const std::string& pattern) {
+    std::string best, run;
+    auto endRun = [&]() {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+    int depth = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        char next = i + 1 < pattern.size() ? pattern[i + 1] : '\0';
+        bool optional = next == '*' || next == '?' || next == '{';
+        if (c == '|' && depth == 0) {
+            return "";
+        }
+        if (c == '(') {
+            endRun();
+            depth++;
+        } else if (c == ')') {
+            depth = std::max(depth - 1, 0);
+        } else if (c == '[') {
+            // Skip the bracket expression; a ']' right after "[" or "[^" is literal
+            size_t j = i + 1;
+            if (j < pattern.size() && pattern[j] == '^') {
+                j++;
+            }
+            if (j < pattern.size() && pattern[j] == ']') {
+                j++;
+            }
+            while (j < pattern.size() && pattern[j] != ']') {
+                j++;
+            }
+            i = j;
+            endRun();
+        } else if (c == '{') {
+            i = std::min(pattern.find('}', i), pattern.size());
+            endRun();
+        } else if (depth > 0) {
+            continue;
+        } else if (c == '\\' && i + 1 < pattern.size() && !std::isalnum(static_cast<unsigned char>(next))) {
+            next = i + 2 < pattern.size() ? pattern[i + 2] : '\0';
+            if (next == '*' || next == '?' || next == '{') {
+                endRun();
+            } else {
+                run += pattern[i + 1];
+            }
+            i++;
+        } else if (std::strchr(".*+?{}^$\\", c)) {
+            endRun();
+        } else if (optional) {
+            endRun();
+        } else {
+            run += c;
+        }
+    }
+    endRun();
+    return best;
+}
+
+// Matches a grep pattern against file contents line by line. A literal the
+// pattern requires (or the whole pattern with fixed strings) is looked for
+// first and only the lines containing it are given to std::regex; with no
+// literal every line is.
+class LineMatcher {
+public:
+    struct Match {
+        size_t line; // 1-based
+        std::string_view text;
+    };
+
+private:
+    std::regex regex;
+    std::string literal; // Lowercased when ignoring case
+    bool fixed = false;
+    bool ignoreCase = false;
+
+    static std::string lowercase(std::string_view text) {
+        std::string lowered(text);
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        return lowered;
+    }
+
+    bool lineMatches(std::string_view line) const {
+        if (fixed) {
+            return true; // The literal was found in it
+        }
+        return std::regex_search(line.begin(), line.end(), regex);
+    }
+
+public:
+    // False (with the reason in error) if the pattern is not a valid regular expression
+    bool compile(const std::string& pattern, bool fixedStrings, bool caseInsensitive, std::string& error) {
+        fixed = fixedStrings;
+        ignoreCase = caseInsensitive;
+        literal = fixed ? pattern : requiredLiteral(pattern);
+        if (ignoreCase) {
+            literal = lowercase(literal);
+        }
+        if (!fixed) {
+            try {
+                auto flags = std::regex::extended | std::regex::nosubs | std::regex::optimize;
+                regex = std::regex(pattern, ignoreCase ? flags | std::regex::icase : flags);
+            } catch (const std::regex_error& e) {
+                error = e.what();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Appends the matching lines of content to out; stops after the first with firstOnly
+    void search(std::string_view content, std::vector<Match>& out, bool firstOnly = false) const {
+        std::string lowered;
+        std::string_view haystack = content;
+        if (ignoreCase && !literal.empty()) {
+            lowered = lowercase(content);
+            haystack = lowered;
+        }
+        size_t line = 1;
+        size_t counted = 0; // Newlines before this offset are in line
+        size_t pos = 0;
+        while (pos < content.size()) {
+            size_t start = pos;
+            if (!literal.empty()) {
+                size_t found = haystack.find(literal, pos);
+                if (found == std::string_view::npos) {
+                    return;
+                }
+                size_t lineStart = content.rfind('\n', found);
+                start = lineStart == std::string_view::npos || lineStart < pos ? pos : lineStart + 1;
+            }
+            size_t end = content.find('\n', start);
+            if (end == std::string_view::npos) {
+                end = content.size();
+            }
+            line += std::count(content.begin() + counted, content.begin() + start, '\n');
+            counted = start;
+            std::string_view text = content.substr(start, end - start);
+            if (lineMatches(text)) {
+                out.push_back({line, text});
+                if (firstOnly) {
+                    return;
+                }
+            }
+            pos = end + 1;
+        }
+    }
+};
+
+#endif // CODEBIRD_GREP_H
@@ -0,0 +1,489 @@
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CODEBIRD_X86_HASH 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace hashing {
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t INITIAL_STATE[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t loadBigEndian(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void compressPortable(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    uint32_t w[64];
+    for (size_t block = 0; block < count; ++block, blocks += 64) {
+        for (int t = 0; t < 16; ++t) {
+            w[t] = loadBigEndian(blocks + 4 * t);
+        }
+        for (int t = 16; t < 64; ++t) {
+            uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int t = 0; t < 64; ++t) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + K[t] + w[t];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#ifdef CODEBIRD_X86_HASH
+
+// SHA-NI block function: two rounds per sha256rnds2, message schedule in sha256msg1/msg2
+__attribute__((target("sha,sse4.1,ssse3")))
+void compressShaNi(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);             // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);       // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);    // CDGH
+
+    for (size_t block = 0; block < count; ++block, blocks += 64) {
+        __m128i saveAbef = state0;
+        __m128i saveCdgh = state1;
+        __m128i msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), byteSwap);
+        }
+
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; ++i) {
+            if (i >= 4) {
+                // W[4i..4i+3] from the previous sixteen words
+                __m128i next = _mm_sha256msg1_epu32(msg[i % 4], msg[(i + 1) % 4]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(msg[(i + 3) % 4], msg[(i + 2) % 4], 4));
+                msg[i % 4] = _mm_sha256msg2_epu32(next, msg[(i + 3) % 4]);
+            }
+            __m128i words = _mm_add_epi32(msg[i % 4], _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[4 * i])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+            words = _mm_shuffle_epi32(words, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, words);
+        }
+
+        state0 = _mm_add_epi32(state0, saveAbef);
+        state1 = _mm_add_epi32(state1, saveCdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);          // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);       // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);    // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);       // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+__attribute__((target("avx2")))
+inline __m256i rotr8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+// Eight messages at once, one per 32-bit lane. blocks[lane] points at the
+// lane's next 64-byte block; lanes whose mask is zero keep their state.
+__attribute__((target("avx2")))
+void compressAvx2Lanes(__m256i state[8], const uint8_t* const blocks[8], __m256i activeMask) {
+    const __m256i byteSwap = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i w[16];
+    for (int t = 0; t < 16; ++t) {
+        uint32_t words[8];
+        for (int lane = 0; lane < 8; ++lane) {
+            std::memcpy(&words[lane], blocks[lane] + 4 * t, 4);
+        }
+        w[t] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words)), byteSwap);
+    }
+
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; ++t) {
+        __m256i wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            __m256i w15 = w[(t - 15) & 15];
+            __m256i w2 = w[(t - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w15, 7), rotr8(w15, 18)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w2, 17), rotr8(w2, 19)), _mm256_srli_epi32(w2, 10));
+            wt = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+            w[t & 15] = wt;
+        }
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(K[t])), wt)));
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        __m256i t2 = _mm256_add_epi32(s0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    __m256i updated[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; ++i) {
+        state[i] = _mm256_blendv_epi8(state[i], _mm256_add_epi32(state[i], updated[i]), activeMask);
+    }
+}
+
+bool cpuHasShaNi() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    bool ssse3 = ecx & (1u << 9);
+    bool sse41 = ecx & (1u << 19);
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return ssse3 && sse41 && (ebx & (1u << 29));
+}
+
+bool cpuHasAvx2() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    // The OS must save the YMM registers (OSXSAVE and XCR0 bits 1-2)
+    if (!(ecx & (1u << 27)) || !(ecx & (1u << 28))) {
+        return false;
+    }
+    unsigned int xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    if ((xcr0Low & 6) != 6) {
+        return false;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return ebx & (1u << 5);
+}
+
+#endif // CODEBIRD_X86_HASH
+
+// Lays out the SHA-256 padding of a message: whole blocks come straight from
+// the input, the last one or two blocks from tail
+struct PaddedMessage {
+    const uint8_t* data = nullptr;
+    size_t fullBlocks = 0;
+    uint8_t tail[128];
+    size_t tailBlocks = 0;
+
+    PaddedMessage() = default;
+
+    explicit PaddedMessage(std::string_view message) {
+        reset(message);
+    }
+
+    void reset(std::string_view message) {
+        data = reinterpret_cast<const uint8_t*>(message.data());
+        fullBlocks = message.size() / 64;
+        size_t rest = message.size() % 64;
+        std::memset(tail, 0, sizeof(tail));
+        std::memcpy(tail, data + fullBlocks * 64, rest);
+        tail[rest] = 0x80;
+        tailBlocks = rest + 9 > 64 ? 2 : 1;
+        uint64_t bits = uint64_t(message.size()) * 8;
+        for (int i = 0; i < 8; ++i) {
+            tail[tailBlocks * 64 - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+
+    size_t blocks() const { return fullBlocks + tailBlocks; }
+
+    const uint8_t* block(size_t index) const {
+        return index < fullBlocks ? data + index * 64 : tail + (index - fullBlocks) * 64;
+    }
+};
+
+Digest stateToDigest(const uint32_t state[8]) {
+    Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+        digest[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest[4 * i + 3] = static_cast<uint8_t>(state[i]);
+    }
+    return digest;
+}
+
+#ifdef CODEBIRD_X86_HASH
+
+// Hashes up to eight messages in the AVX2 lanes; shorter messages are masked
+// off once their last block is done
+__attribute__((target("avx2")))
+void sha256Lanes(const std::string_view* messages, size_t count, Digest* out) {
+    PaddedMessage padded[8];
+    size_t maxBlocks = 0;
+    for (size_t lane = 0; lane < count; ++lane) {
+        padded[lane].reset(messages[lane]);
+        maxBlocks = std::max(maxBlocks, padded[lane].blocks());
+    }
+
+    __m256i state[8];
+    for (int i = 0; i < 8; ++i) {
+        state[i] = _mm256_set1_epi32(static_cast<int>(INITIAL_STATE[i]));
+    }
+
+    static const uint8_t zeroBlock[64] = {};
+    for (size_t index = 0; index < maxBlocks; ++index) {
+        const uint8_t* blocks[8];
+        alignas(32) int32_t mask[8];
+        for (size_t lane = 0; lane < 8; ++lane) {
+            bool active = lane < count && index < padded[lane].blocks();
+            blocks[lane] = active ? padded[lane].block(index) : zeroBlock;
+            mask[lane] = active ? -1 : 0;
+        }
+        compressAvx2Lanes(state, blocks, _mm256_load_si256(reinterpret_cast<const __m256i*>(mask)));
+    }
+
+    alignas(32) uint32_t words[8][8];
+    for (int i = 0; i < 8; ++i) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(words[i]), state[i]);
+    }
+    for (size_t lane = 0; lane < count; ++lane) {
+        uint32_t laneState[8];
+        for (int i = 0; i < 8; ++i) {
+            laneState[i] = words[i][lane];
+        }
+        out[lane] = stateToDigest(laneState);
+    }
+}
+
+#endif // CODEBIRD_X86_HASH
+
+using CompressFn = void (*)(uint32_t state[8], const uint8_t* blocks, size_t count);
+
+CompressFn compressFor(Sha256Backend backend) {
+#ifdef CODEBIRD_X86_HASH
+    if (backend == Sha256Backend::ShaNi && backendSupported(Sha256Backend::ShaNi)) {
+        return compressShaNi;
+    }
+#else
+    (void)backend;
+#endif
+    return compressPortable;
+}
+
+// Backend forced through CODEBIRD_SHA256, if any and if usable
+bool overrideBackend(Sha256Backend& backend) {
+    const char* env = std::getenv("CODEBIRD_SHA256");
+    if (!env) {
+        return false;
+    }
+    std::string name = env;
+    if (name == "portable") {
+        backend = Sha256Backend::Portable;
+    } else if (name == "shani") {
+        backend = Sha256Backend::ShaNi;
+    } else if (name == "avx2") {
+        backend = Sha256Backend::Avx2;
+    } else {
+        return false;
+    }
+    return backendSupported(backend);
+}
+
+} // namespace
+
+const char* backendName(Sha256Backend backend) {
+    switch (backend) {
+        case Sha256Backend::Portable: return "portable";
+        case Sha256Backend::ShaNi: return "shani";
+        case Sha256Backend::Avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool backendSupported(Sha256Backend backend) {
+#ifdef CODEBIRD_X86_HASH
+    static const bool hasShaNi = cpuHasShaNi();
+    static const bool hasAvx2 = cpuHasAvx2();
+    if (backend == Sha256Backend::ShaNi) {
+        return hasShaNi;
+    }
+    if (backend == Sha256Backend::Avx2) {
+        return hasAvx2;
+    }
+#endif
+    return backend == Sha256Backend::Portable;
+}
+
+Sha256Backend singleBackend() {
+    static const Sha256Backend chosen = [] {
+        Sha256Backend backend;
+        if (overrideBackend(backend) && backend != Sha256Backend::Avx2) {
+            return backend;
+        }
+        return backendSupported(Sha256Backend::ShaNi) ? Sha256Backend::ShaNi : Sha256Backend::Portable;
+    }();
+    return chosen;
+}
+
+Sha256Backend multiBackend() {
+    static const Sha256Backend chosen = [] {
+        Sha256Backend backend;
+        if (overrideBackend(backend)) {
+            return backend;
+        }
+        if (backendSupported(Sha256Backend::ShaNi)) {
+            return Sha256Backend::ShaNi;
+        }
+        return backendSupported(Sha256Backend::Avx2) ? Sha256Backend::Avx2 : Sha256Backend::Portable;
+    }();
+    return chosen;
+}
+
+Sha256::Sha256() : Sha256(singleBackend()) {}
+
+Sha256::Sha256(Sha256Backend backend) : compress(compressFor(backend)) {
+    std::memcpy(state, INITIAL_STATE, sizeof(state));
+}
+
+void Sha256::update(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    totalBytes += size;
+    if (buffered) {
+        size_t take = std::min(size, 64 - buffered);
+        std::memcpy(buffer + buffered, bytes, take);
+        buffered += take;
+        bytes += take;
+        size -= take;
+        if (buffered < 64) {
+            return;
+        }
+        compress(state, buffer, 1);
+        buffered = 0;
+    }
+    if (size >= 64) {
+        compress(state, bytes, size / 64);
+        bytes += size / 64 * 64;
+        size %= 64;
+    }
+    std::memcpy(buffer, bytes, size);
+    buffered = size;
+}
+
+Digest Sha256::finish() {
+    uint64_t bits = totalBytes * 8;
+    uint8_t padding[72] = {0x80};
+    size_t padLength = buffered < 56 ? 56 - buffered : 120 - buffered;
+    for (int i = 0; i < 8; ++i) {
+        padding[padLength + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    }
+    update(padding, padLength + 8);
+    return stateToDigest(state);
+}
+
+Digest sha256(std::string_view data) {
+    Sha256 hasher;
+    hasher.update(data);
+    return hasher.finish();
+}
+
+Digest sha256With(Sha256Backend backend, std::string_view data) {
+    Sha256 hasher(backend);
+    hasher.update(data);
+    return hasher.finish();
+}
+
+std::vector<Digest> sha256ManyWith(Sha256Backend backend, const std::vector<std::string_view>& inputs) {
+    std::vector<Digest> digests(inputs.size());
+#ifdef CODEBIRD_X86_HASH
+    if (backend == Sha256Backend::Avx2 && backendSupported(Sha256Backend::Avx2)) {
+        // Group messages of similar length so few lanes idle while the longest one finishes
+        std::vector<size_t> order(inputs.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+            return inputs[x].size() < inputs[y].size();
+        });
+        for (size_t start = 0; start < order.size(); start += 8) {
+            size_t count = std::min<size_t>(8, order.size() - start);
+            std::string_view group[8];
+            Digest out[8];
+            for (size_t lane = 0; lane < count; ++lane) {
+                group[lane] = inputs[order[start + lane]];
+            }
+            sha256Lanes(group, count, out);
+            for (size_t lane = 0; lane < count; ++lane) {
+                digests[order[start + lane]] = out[lane];
+            }
+        }
+        return digests;
+    }
+#endif
+    Sha256Backend single = backend == Sha256Backend::Avx2 ? Sha256Backend::Portable : backend;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        digests[i] = sha256With(single, inputs[i]);
+    }
+    return digests;
+}
+
+std::vector<Digest> sha256Many(const std::vector<std::string_view>& inputs) {
+    return sha256ManyWith(multiBackend(), inputs);
+}
+
+std::string toHex(const uint8_t* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 15];
+    }
+    return hex;
+}
+
+} // namespace hashing
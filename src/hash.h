@@ -0,0 +1,66 @@
+#ifndef CODEBIRD_HASH_H
+#define CODEBIRD_HASH_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SHA-256 with runtime-dispatched backends. The single-buffer backends
+// (portable, SHA-NI) share one incremental context; the AVX2 backend hashes
+// eight independent messages at once and is only used through sha256Many.
+namespace hashing {
+
+using Digest = std::array<uint8_t, 32>;
+
+enum class Sha256Backend { Portable, ShaNi, Avx2 };
+
+const char* backendName(Sha256Backend backend);
+
+// True if the CPU (as reported by CPUID) and the build support the backend
+bool backendSupported(Sha256Backend backend);
+
+// Backend used for single messages: SHA-NI when available, otherwise portable.
+// CODEBIRD_SHA256=portable|shani overrides the choice.
+Sha256Backend singleBackend();
+
+// Backend used by sha256Many: SHA-NI, then AVX2 lanes, then portable.
+// CODEBIRD_SHA256=portable|shani|avx2 overrides the choice.
+Sha256Backend multiBackend();
+
+// Incremental SHA-256; the block function is picked once per context
+class Sha256 {
+private:
+    uint32_t state[8];
+    uint8_t buffer[64];
+    size_t buffered = 0;
+    uint64_t totalBytes = 0;
+    void (*compress)(uint32_t state[8], const uint8_t* blocks, size_t count);
+
+public:
+    Sha256();
+    explicit Sha256(Sha256Backend backend);
+
+    void update(const void* data, size_t size);
+    void update(std::string_view data) { update(data.data(), data.size()); }
+    Digest finish();
+};
+
+Digest sha256(std::string_view data);
+Digest sha256With(Sha256Backend backend, std::string_view data);
+
+// Hashes many independent messages, in parallel lanes when the backend allows
+std::vector<Digest> sha256Many(const std::vector<std::string_view>& inputs);
+std::vector<Digest> sha256ManyWith(Sha256Backend backend, const std::vector<std::string_view>& inputs);
+
+std::string toHex(const uint8_t* data, size_t size);
+
+inline std::string toHex(const Digest& digest) {
+    return toHex(digest.data(), digest.size());
+}
+
+} // namespace hashing
+
+#endif // CODEBIRD_HASH_H
@@ -0,0 +1,291 @@
+#ifndef CODEBIRD_IGNORE_H
+#define CODEBIRD_IGNORE_H
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Whether text matches a glob: '*' and '?' match within one path component,
+// "[...]" a character class ("[!...]" or "[^...]" negated), and "**" any
+// number of whole components ("**/" may also match nothing).
+inline bool globMatch(std::string_view pattern, std::string_view text) {
+    size_t p = 0, t = 0;
+    while (p < pattern.size()) {
+        char c = pattern[p];
+        if (c == '*' && p + 1 < pattern.size() && pattern[p + 1] == '*') {
+            std::string_view rest = pattern.substr(p + 2);
+            if (rest.empty()) {
+                return true;
+            }
+            if (rest[0] == '/') {
+                // "**/" continues at the start of any component from here on
+                rest.remove_prefix(1);
+                for (size_t i = t; i <= text.size(); ++i) {
+                    if ((i == t || text[i - 1] == '/') && globMatch(rest, text.substr(i))) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            for (size_t i = t; i <= text.size(); ++i) {
+                if (globMatch(rest, text.substr(i))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (c == '*') {
+            std::string_view rest = pattern.substr(p + 1);
+            for (size_t i = t; i <= text.size(); ++i) {
+                if (globMatch(rest, text.substr(i))) {
+                    return true;
+                }
+                if (i < text.size() && text[i] == '/') {
+                    break;
+                }
+            }
+            return false;
+        }
+        if (t >= text.size()) {
+            return false;
+        }
+        if (c == '?') {
+            if (text[t] == '/') {
+                return false;
+            }
+        } else if (c == '[' && pattern.find(']', p + 2) != std::string_view::npos) {
+            size_t end = pattern.find(']', p + 2);
+            size_t i = p + 1;
+            bool negated = pattern[i] == '!' || pattern[i] == '^';
+            if (negated) {
+                i++;
+            }
+            bool found = false;
+            for (; i < end; ++i) {
+                if (i + 2 < end && pattern[i + 1] == '-') {
+                    found = found || (text[t] >= pattern[i] && text[t] <= pattern[i + 2]);
+                    i += 2;
+                } else {
+                    found = found || text[t] == pattern[i];
+                }
+            }
+            if (found == negated || text[t] == '/') {
+                return false;
+            }
+            p = end;
+        } else {
+            if (c == '\\' && p + 1 < pattern.size()) {
+                c = pattern[++p];
+            }
+            if (text[t] != c) {
+                return false;
+            }
+        }
+        p++;
+        t++;
+    }
+    return t == text.size();
+}
+
+// The rules of .cbirdignore, in gitignore syntax: one pattern per line, '#'
+// comments, '!' to re-include, a trailing '/' for directories only. A
+// pattern without any other '/' matches a name at any depth; one with a '/'
+// matches the path from the worktree root.
+//
+// Rules are compiled once into lookup structures by shape, so a path costs a
+// few hash lookups rather than a test against every rule:
+//  - plain names ("build", "Thumbs.db") in a hash table;
+//  - "*suffix" patterns ("*.o", "*~") in hash tables keyed by the suffix, one
+//    per suffix length;
+//  - rooted patterns in a trie of their leading literal components, each
+//    node holding the rules whose remaining pattern applies below it;
+//  - other name patterns ("*.py[co]", "core.*") as globs, bucketed by their
+//    first character, or their last if they start with a wildcard, so only
+//    globs that could match a name's first or last character are tried.
+// As in git the last matching rule decides, so each lookup keeps the highest
+// rule number it finds.
+class IgnoreRules {
+private:
+    struct Rule {
+        bool negated = false;
+        bool directoryOnly = false;
+    };
+    struct TrieNode {
+        std::unordered_map<std::string, std::unique_ptr<TrieNode>> children;
+        std::vector<std::pair<size_t, std::string>> rules; // Rule, pattern for the rest of the path ("" = here)
+    };
+
+    std::vector<Rule> rules;
+    std::unordered_map<std::string, std::vector<size_t>> names;
+    std::map<size_t, std::unordered_map<std::string, std::vector<size_t>>> suffixes; // By suffix length
+    using GlobList = std::vector<std::pair<size_t, std::string>>; // Rule, pattern
+    std::array<GlobList, 256> globsByFirst;
+    std::array<GlobList, 256> globsByLast;
+    GlobList otherGlobs; // Starting and ending with a wildcard
+    TrieNode root;
+
+    static bool hasWildcard(std::string_view text) {
+        return text.find_first_of("*?[\\") != std::string_view::npos;
+    }
+
+    void consider(size_t rule, bool isDirectory, long& best) const {
+        if ((!rules[rule].directoryOnly || isDirectory) && static_cast<long>(rule) > best) {
+            best = static_cast<long>(rule);
+        }
+    }
+
+    void considerGlobs(const GlobList& globs, std::string_view name, bool isDirectory, long& best) const {
+        for (const auto& [rule, pattern] : globs) {
+            if (static_cast<long>(rule) > best && globMatch(pattern, name)) {
+                consider(rule, isDirectory, best);
+            }
+        }
+    }
+
+    void considerAll(const std::vector<size_t>& candidates, bool isDirectory, long& best) const {
+        for (size_t rule : candidates) {
+            consider(rule, isDirectory, best);
+        }
+    }
+
+public:
+    // Adds the rules of an ignore file; false if it cannot be read
+    bool load(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        if (!in) {
+            return false;
+        }
+        for (std::string line; std::getline(in, line);) {
+            add(line);
+        }
+        return true;
+    }
+
+    // Adds one line of an ignore file
+    void add(std::string line) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        while (!line.empty() && line.back() == ' ' && (line.size() < 2 || line[line.size() - 2] != '\\')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            return;
+        }
+        Rule rule;
+        if (line[0] == '!') {
+            rule.negated = true;
+            line.erase(0, 1);
+        } else if (line[0] == '\\' && line.size() > 1 && (line[1] == '!' || line[1] == '#')) {
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.directoryOnly = true;
+            line.pop_back();
+        }
+        if (line.empty()) {
+            return;
+        }
+        size_t number = rules.size();
+        rules.push_back(rule);
+
+        if (line.find('/') == std::string::npos) {
+            if (!hasWildcard(line)) {
+                names[line].push_back(number);
+            } else if (line[0] == '*' && !hasWildcard(line.substr(1))) {
+                std::string suffix = line.substr(1);
+                suffixes[suffix.size()][suffix].push_back(number);
+            } else if (!hasWildcard(line.substr(0, 1))) {
+                globsByFirst[static_cast<unsigned char>(line.front())].push_back({number, line});
+            } else if (!hasWildcard(line.substr(line.size() - 1)) && line.back() != ']' && line[line.size() - 2] != '\\') {
+                globsByLast[static_cast<unsigned char>(line.back())].push_back({number, line});
+            } else {
+                otherGlobs.push_back({number, line});
+            }
+            return;
+        }
+        if (line[0] == '/') {
+            line.erase(0, 1);
+        }
+        TrieNode* node = &root;
+        size_t start = 0;
+        while (start < line.size()) {
+            size_t end = line.find('/', start);
+            std::string component = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            if (hasWildcard(component)) {
+                break;
+            }
+            std::unique_ptr<TrieNode>& child = node->children[component];
+            if (!child) {
+                child = std::make_unique<TrieNode>();
+            }
+            node = child.get();
+            start = end == std::string::npos ? line.size() : end + 1;
+        }
+        node->rules.push_back({number, line.substr(start)});
+    }
+
+    bool empty() const { return rules.empty(); }
+
+    // Whether a path relative to the worktree root is ignored by the rules
+    // themselves; the caller checks (or has pruned) its parent directories
+    bool ignored(std::string_view path, bool isDirectory) const {
+        if (rules.empty()) {
+            return false;
+        }
+        long best = -1;
+        size_t slash = path.rfind('/');
+        std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+
+        auto exact = names.find(std::string(name));
+        if (exact != names.end()) {
+            considerAll(exact->second, isDirectory, best);
+        }
+        for (const auto& [length, table] : suffixes) {
+            if (length > name.size()) {
+                break;
+            }
+            auto found = table.find(std::string(name.substr(name.size() - length)));
+            if (found != table.end()) {
+                considerAll(found->second, isDirectory, best);
+            }
+        }
+        if (!name.empty()) {
+            considerGlobs(globsByFirst[static_cast<unsigned char>(name.front())], name, isDirectory, best);
+            considerGlobs(globsByLast[static_cast<unsigned char>(name.back())], name, isDirectory, best);
+        }
+        considerGlobs(otherGlobs, name, isDirectory, best);
+
+        // Down the trie one component at a time; at each node its rules are
+        // tried against what is left of the path
+        const TrieNode* node = &root;
+        size_t start = 0;
+        while (node) {
+            std::string_view rest = start <= path.size() ? path.substr(start) : std::string_view();
+            for (const auto& [rule, pattern] : node->rules) {
+                bool matches = pattern.empty() ? rest.empty() : !rest.empty() && globMatch(pattern, rest);
+                if (matches) {
+                    consider(rule, isDirectory, best);
+                }
+            }
+            if (rest.empty() || node->children.empty()) {
+                break;
+            }
+            size_t end = path.find('/', start);
+            std::string component(path.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+            auto child = node->children.find(component);
+            node = child == node->children.end() ? nullptr : child->second.get();
+            start = end == std::string_view::npos ? path.size() : end + 1;
+        }
+        return best >= 0 && !rules[best].negated;
+    }
+};
+
+#endif // CODEBIRD_IGNORE_H
@@ -0,0 +1,160 @@
+#ifndef CODEBIRD_MESSAGE_INDEX_H
+#define CODEBIRD_MESSAGE_INDEX_H
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "posting_index.h"
+
+// Commit messages are indexed by token: a lowercased run of letters, digits
+// and underscores. The index (objects/info/message-index) is a PostingIndex
+// from each token to the commits whose message contains it.
+
+// Lowercased tokens of a text, each once, in order of appearance
+inline std::vector<std::string> tokenizeMessage(const std::string& text) {
+    std::vector<std::string> tokens;
+    std::string token;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (std::isalnum(c) || c == '_') {
+            token += static_cast<char>(std::tolower(c));
+        } else if (!token.empty()) {
+            if (std::find(tokens.begin(), tokens.end(), token) == tokens.end()) {
+                tokens.push_back(token);
+            }
+            token.clear();
+        }
+    }
+    return tokens;
+}
+
+// A log --grep query: terms separated by spaces must all occur, "OR" separates
+// alternatives, and a term starting with '-' must not occur. A term matches a
+// whole token, or for terms such as "a.txt" that span several tokens, the
+// exact text anywhere in the message (case-insensitively).
+class MessageQuery {
+private:
+    struct Term {
+        std::string text; // Lowercased
+        std::vector<std::string> tokens;
+        bool negated = false;
+    };
+    std::vector<std::vector<Term>> alternatives;
+
+    static std::string lowercase(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+        return text;
+    }
+
+    static bool occurs(const Term& term, const std::vector<std::string>& tokens, const std::string& lowered) {
+        if (term.tokens.size() != 1) {
+            return lowered.find(term.text) != std::string::npos;
+        }
+        return std::find(tokens.begin(), tokens.end(), term.tokens.front()) != tokens.end();
+    }
+
+    static void intersect(std::vector<uint32_t>& into, const std::vector<uint32_t>& other) {
+        std::vector<uint32_t> result;
+        std::set_intersection(into.begin(), into.end(), other.begin(), other.end(), std::back_inserter(result));
+        into = std::move(result);
+    }
+
+public:
+    // False if the query has no terms
+    bool parse(const std::string& query) {
+        alternatives.assign(1, {});
+        std::stringstream ss(query);
+        for (std::string word; ss >> word;) {
+            if (word == "OR") {
+                alternatives.emplace_back();
+                continue;
+            }
+            Term term;
+            term.negated = word.size() > 1 && word[0] == '-';
+            term.text = lowercase(term.negated ? word.substr(1) : word);
+            term.tokens = tokenizeMessage(term.text);
+            if (!term.tokens.empty()) {
+                alternatives.back().push_back(std::move(term));
+            }
+        }
+        alternatives.erase(std::remove_if(alternatives.begin(), alternatives.end(),
+                                          [](const auto& terms) { return terms.empty(); }),
+                           alternatives.end());
+        return !alternatives.empty();
+    }
+
+    // Whether a message satisfies the query
+    bool matches(const std::string& message) const {
+        std::vector<std::string> tokens = tokenizeMessage(message);
+        std::string lowered = lowercase(message);
+        for (const auto& terms : alternatives) {
+            bool all = true;
+            for (const auto& term : terms) {
+                all = all && occurs(term, tokens, lowered) != term.negated;
+            }
+            if (all) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Per indexed commit number, whether it may match: the posting lists of
+    // an alternative's terms are intersected and those of its single-token
+    // negated terms subtracted. Candidates still need matches() when the
+    // query has terms spanning several tokens.
+    std::vector<bool> candidates(const PostingIndex& index) const {
+        std::vector<bool> result(index.size(), false);
+        for (const auto& terms : alternatives) {
+            std::vector<uint32_t> selected;
+            bool restricted = false;
+            for (const auto& term : terms) {
+                for (const auto& token : term.tokens) {
+                    if (term.negated) {
+                        continue;
+                    }
+                    std::vector<uint32_t> list = index.postings(token);
+                    if (restricted) {
+                        intersect(selected, list);
+                    } else {
+                        selected = std::move(list);
+                        restricted = true;
+                    }
+                }
+            }
+            std::vector<bool> chosen(index.size(), !restricted);
+            for (uint32_t number : selected) {
+                chosen[number] = true;
+            }
+            for (const auto& term : terms) {
+                if (term.negated && term.tokens.size() == 1) {
+                    for (uint32_t number : index.postings(term.tokens.front())) {
+                        chosen[number] = false;
+                    }
+                }
+            }
+            for (size_t i = 0; i < result.size(); ++i) {
+                result[i] = result[i] || chosen[i];
+            }
+        }
+        return result;
+    }
+
+    // Whether candidates() is exact, so matching commits need not be read to check them
+    bool exact() const {
+        for (const auto& terms : alternatives) {
+            for (const auto& term : terms) {
+                if (term.tokens.size() != 1) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+#endif // CODEBIRD_MESSAGE_INDEX_H
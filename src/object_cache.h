@@ -0,0 +1,131 @@
+#ifndef CODEBIRD_OBJECT_CACHE_H
+#define CODEBIRD_OBJECT_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Hit/miss/eviction counters of a cache
+struct CacheCounters {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t bytes = 0;
+};
+
+// Thread-safe LRU cache bounded by a byte budget. Keys are spread over
+// independently locked shards so concurrent readers rarely contend; each
+// shard evicts its least recently used entries once it exceeds its share
+// of the budget.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedLruCache {
+private:
+    struct Entry {
+        Key key;
+        Value value;
+        size_t charge;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru; // Most recently used at the front
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+        size_t used = 0;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> shardBudget;
+    Hash hasher;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+
+    Shard& shardFor(const Key& key) {
+        return *shards[hasher(key) % shards.size()];
+    }
+
+    // Drops entries from the back of the shard until it fits its budget
+    void evict(Shard& shard) {
+        while (shard.used > shardBudget.load(std::memory_order_relaxed) && !shard.lru.empty()) {
+            Entry& victim = shard.lru.back();
+            shard.used -= victim.charge;
+            shard.index.erase(victim.key);
+            shard.lru.pop_back();
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    ShardedLruCache(size_t budgetBytes, size_t shardCount = 16)
+        : shardBudget(budgetBytes / (shardCount ? shardCount : 1)) {
+        for (size_t i = 0; i < (shardCount ? shardCount : 1); ++i) {
+            shards.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    // Copies the cached value into out and marks it most recently used
+    bool get(const Key& key, Value& out) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        out = it->second->value;
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Inserts or replaces an entry; entries larger than a shard's budget are not cached
+    void put(const Key& key, Value value, size_t charge) {
+        if (charge > shardBudget.load(std::memory_order_relaxed)) {
+            return;
+        }
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.used -= it->second->charge;
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+        shard.lru.push_front({key, std::move(value), charge});
+        shard.index[key] = shard.lru.begin();
+        shard.used += charge;
+        evict(shard);
+    }
+
+    // Changes the total byte budget, evicting immediately if needed
+    void setBudget(size_t budgetBytes) {
+        shardBudget.store(budgetBytes / shards.size(), std::memory_order_relaxed);
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            evict(*shard);
+        }
+    }
+
+    size_t budget() const {
+        return shardBudget.load(std::memory_order_relaxed) * shards.size();
+    }
+
+    CacheCounters counters() {
+        CacheCounters result;
+        result.hits = hits.load(std::memory_order_relaxed);
+        result.misses = misses.load(std::memory_order_relaxed);
+        result.evictions = evictions.load(std::memory_order_relaxed);
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            result.bytes += shard->used;
+        }
+        return result;
+    }
+};
+
+#endif // CODEBIRD_OBJECT_CACHE_H
@@ -0,0 +1,114 @@
+#ifndef CODEBIRD_OBJECT_READER_H
+#define CODEBIRD_OBJECT_READER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "commit.h"
+#include "object_cache.h"
+#include "object_store.h"
+#include "trace.h"
+
+// Default cache budgets; overridden by objectcachebytes / payloadcachebytes in .cbird/config
+constexpr size_t DEFAULT_OBJECT_CACHE_BYTES = 64u << 20;
+constexpr size_t DEFAULT_PAYLOAD_CACHE_BYTES = 16u << 20;
+
+// An object's raw payload as kept in the payload cache
+struct RawObject {
+    ObjectType type;
+    std::string payload;
+};
+
+// A parsed commit or tree as kept in the object cache
+struct ParsedObject {
+    ObjectType type;
+    Commit commit;
+    std::vector<TreeEntry> entries;
+};
+
+// Cached read access to the object store. Parsed commits and trees live in
+// one LRU cache and raw payloads (blob contents) in another, each with its
+// own byte budget, so repeated history walks and diffs do not re-read and
+// re-parse the same objects.
+class ObjectReader {
+private:
+    const ObjectStore& store;
+    ShardedLruCache<std::string, std::shared_ptr<const ParsedObject>> parsedCache;
+    ShardedLruCache<std::string, std::shared_ptr<const RawObject>> payloadCache;
+
+    // Rough memory footprint of a parsed object, used as its cache charge
+    static size_t chargeFor(const ParsedObject& object, size_t payloadSize) {
+        return sizeof(ParsedObject) + payloadSize + object.entries.size() * sizeof(TreeEntry);
+    }
+
+    std::shared_ptr<const ParsedObject> readParsed(const std::string& hash, ObjectType expected) {
+        std::shared_ptr<const ParsedObject> cached;
+        if (parsedCache.get(hash, cached)) {
+            return cached->type == expected ? cached : nullptr;
+        }
+
+        ObjectType type;
+        std::string payload;
+        if (!store.read(hash, type, payload) || type != expected) {
+            return nullptr;
+        }
+        TRACE_SCOPE("object.parse", "io");
+        auto parsed = std::make_shared<ParsedObject>();
+        parsed->type = type;
+        bool ok = type == ObjectType::Commit ? Commit::parse(hash, payload, parsed->commit)
+                                             : parseTree(payload, parsed->entries);
+        if (!ok) {
+            return nullptr;
+        }
+        parsedCache.put(hash, parsed, chargeFor(*parsed, payload.size()));
+        return parsed;
+    }
+
+public:
+    ObjectReader(const ObjectStore& store,
+                 size_t objectCacheBytes = DEFAULT_OBJECT_CACHE_BYTES,
+                 size_t payloadCacheBytes = DEFAULT_PAYLOAD_CACHE_BYTES)
+        : store(store), parsedCache(objectCacheBytes), payloadCache(payloadCacheBytes) {}
+
+    void setBudgets(size_t objectCacheBytes, size_t payloadCacheBytes) {
+        parsedCache.setBudget(objectCacheBytes);
+        payloadCache.setBudget(payloadCacheBytes);
+    }
+
+    // The commit with the given hash, or null if it is missing
+    std::shared_ptr<const Commit> readCommit(const std::string& hash) {
+        std::shared_ptr<const ParsedObject> object = readParsed(hash, ObjectType::Commit);
+        return object ? std::shared_ptr<const Commit>(object, &object->commit) : nullptr;
+    }
+
+    // The entries of the tree with the given hash, or null if it is missing
+    std::shared_ptr<const std::vector<TreeEntry>> readTree(const std::string& hash) {
+        std::shared_ptr<const ParsedObject> object = readParsed(hash, ObjectType::Tree);
+        return object ? std::shared_ptr<const std::vector<TreeEntry>>(object, &object->entries) : nullptr;
+    }
+
+    // Raw payload of an object of any type, or null if it is missing
+    std::shared_ptr<const RawObject> readRaw(const std::string& hash) {
+        std::shared_ptr<const RawObject> cached;
+        if (payloadCache.get(hash, cached)) {
+            return cached;
+        }
+        auto raw = std::make_shared<RawObject>();
+        if (!store.read(hash, raw->type, raw->payload)) {
+            return nullptr;
+        }
+        payloadCache.put(hash, raw, sizeof(RawObject) + raw->payload.size());
+        return raw;
+    }
+
+    CacheCounters objectCacheCounters() {
+        return parsedCache.counters();
+    }
+
+    CacheCounters payloadCacheCounters() {
+        return payloadCache.counters();
+    }
+};
+
+#endif // CODEBIRD_OBJECT_READER_H
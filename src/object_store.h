@@ -0,0 +1,363 @@
+#ifndef CODEBIRD_OBJECT_STORE_H
+#define CODEBIRD_OBJECT_STORE_H
+
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "blake3.h"
+#include "file_util.h"
+#include "hash.h"
+#include "object_types.h"
+#include "pack.h"
+#include "trace.h"
+
+// Content-addressed storage of loose objects under <repo>/objects/xx/yyyy.
+// Each file holds a "<type> <size>\0" header followed by the payload.
+// Objects not found loose are looked up in the packs under objects/pack.
+class ObjectStore {
+public:
+    using PackList = std::vector<std::shared_ptr<const PackFile>>;
+
+private:
+    std::filesystem::path objectsDir;
+    HashAlgorithm algorithm;
+    bool durable = false; // fsync every object as it is written
+    mutable std::mutex packMutex;
+    mutable std::shared_ptr<const PackList> packList; // Loaded on first use
+    mutable std::mutex looseMutex;
+    mutable std::map<std::string, std::vector<std::string>> looseListings; // Fan-out directory -> sorted hashes
+    std::function<bool(const std::string&)> missingHandler; // Tries to obtain an object read() did not find
+
+    // Sorted hashes of the loose objects in one fan-out directory (objects/xx),
+    // listed once; the caller holds looseMutex
+    const std::vector<std::string>& looseIn(const std::string& fanout) const {
+        auto it = looseListings.find(fanout);
+        if (it == looseListings.end()) {
+            std::vector<std::string> hashes;
+            std::error_code ec;
+            for (const auto& entry : std::filesystem::directory_iterator(objectsDir / fanout, ec)) {
+                std::string name = entry.path().filename().string();
+                if (name.find('.') == std::string::npos) {
+                    hashes.push_back(fanout + name);
+                }
+            }
+            std::sort(hashes.begin(), hashes.end());
+            it = looseListings.emplace(fanout, std::move(hashes)).first;
+        }
+        return it->second;
+    }
+
+    // Opens the packs in the pack directory, reusing those already in loaded
+    std::shared_ptr<const PackList> scanPacks(const PackList* loaded) const {
+        auto list = std::make_shared<PackList>();
+        std::vector<std::filesystem::path> indexes;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(packDir(), ec)) {
+            if (entry.path().extension() == ".idx") {
+                indexes.push_back(entry.path());
+            }
+        }
+        std::sort(indexes.begin(), indexes.end());
+        for (const auto& index : indexes) {
+            std::filesystem::path packPath = index;
+            packPath.replace_extension(".pack");
+            std::shared_ptr<const PackFile> pack;
+            if (loaded) {
+                for (const auto& existing : *loaded) {
+                    if (existing->path() == packPath) {
+                        pack = existing;
+                    }
+                }
+            }
+            if (!pack) {
+                pack = PackFile::open(index);
+            }
+            if (pack) {
+                list->push_back(std::move(pack));
+            }
+        }
+        return list;
+    }
+
+    bool readPacked(const std::string& hash, ObjectType& type, std::string& payload) const {
+        for (const auto& pack : *packs()) {
+            uint32_t position;
+            uint64_t offset;
+            if (pack->find(hash, position, offset)) {
+                return pack->read(offset, type, payload);
+            }
+        }
+        return false;
+    }
+
+public:
+    ObjectStore(const std::filesystem::path& repoDir, HashAlgorithm algorithm = HashAlgorithm::Sha256)
+        : objectsDir(repoDir / "objects"), algorithm(algorithm) {}
+
+    HashAlgorithm hashAlgorithm() const {
+        return algorithm;
+    }
+
+    void setHashAlgorithm(HashAlgorithm newAlgorithm) {
+        algorithm = newAlgorithm;
+    }
+
+    void setDurable(bool enabled) {
+        durable = enabled;
+    }
+
+    static std::string objectHeader(ObjectType type, size_t size) {
+        std::string header = std::string(objectTypeName(type)) + " " + std::to_string(size);
+        header += '\0';
+        return header;
+    }
+
+    // Hash of an object as stored: header plus payload. BLAKE3 hashes large
+    // payloads as a tree across all cores.
+    static std::string hashObject(HashAlgorithm algorithm, ObjectType type, const std::string& payload) {
+        TRACE_SCOPE("object.hash", "hash");
+        std::string header = objectHeader(type, payload.size());
+        if (algorithm == HashAlgorithm::Blake3) {
+            return hashing::toHex(blake3::hash(header, payload));
+        }
+        hashing::Sha256 hasher;
+        hasher.update(header);
+        hasher.update(payload);
+        return hashing::toHex(hasher.finish());
+    }
+
+    std::string hashObject(ObjectType type, const std::string& payload) const {
+        return hashObject(algorithm, type, payload);
+    }
+
+    // Hashes a batch of objects of one type, in parallel SIMD lanes when available
+    std::vector<std::string> hashObjects(ObjectType type, const std::vector<std::string>& payloads) const {
+        TRACE_SCOPE("object.hashMany", "hash");
+        if (algorithm == HashAlgorithm::Blake3) {
+            std::vector<std::string> hashes;
+            hashes.reserve(payloads.size());
+            for (const auto& payload : payloads) {
+                hashes.push_back(hashObject(type, payload));
+            }
+            return hashes;
+        }
+        std::vector<std::string> messages;
+        messages.reserve(payloads.size());
+        for (const auto& payload : payloads) {
+            messages.push_back(objectHeader(type, payload.size()) + payload);
+        }
+        std::vector<std::string_view> views(messages.begin(), messages.end());
+        std::vector<std::string> hashes;
+        hashes.reserve(payloads.size());
+        for (const auto& digest : hashing::sha256Many(views)) {
+            hashes.push_back(hashing::toHex(digest));
+        }
+        return hashes;
+    }
+
+    std::filesystem::path loosePath(const std::string& hash) const {
+        return objectsDir / hash.substr(0, 2) / hash.substr(2);
+    }
+
+    std::filesystem::path packDir() const {
+        return objectsDir / "pack";
+    }
+
+    // The packs present on disk, loaded on first use. The list is immutable:
+    // a caller holding it keeps a consistent set of mapped packs while other
+    // threads or processes add packs.
+    std::shared_ptr<const PackList> packs() const {
+        std::lock_guard<std::mutex> lock(packMutex);
+        if (!packList) {
+            packList = scanPacks(nullptr);
+        }
+        return packList;
+    }
+
+    // Picks up packs written since the list was loaded, such as by a repack
+    // that then removed the loose copies; false if the list did not change
+    bool refreshPacks() const {
+        std::lock_guard<std::mutex> lock(packMutex);
+        std::shared_ptr<const PackList> scanned = scanPacks(packList.get());
+        if (packList && scanned->size() == packList->size() &&
+            std::equal(scanned->begin(), scanned->end(), packList->begin())) {
+            return false;
+        }
+        packList = scanned;
+        return true;
+    }
+
+    // Forgets the loaded packs and loose listings so the next lookup sees the disk
+    void reloadPacks() {
+        {
+            std::lock_guard<std::mutex> lock(packMutex);
+            packList.reset();
+        }
+        std::lock_guard<std::mutex> lock(looseMutex);
+        looseListings.clear();
+    }
+
+    bool existsLoose(const std::string& hash) const {
+        return hash.size() > 2 && std::filesystem::exists(loosePath(hash));
+    }
+
+    bool existsPacked(const std::string& hash) const {
+        for (const auto& pack : *packs()) {
+            if (pack->contains(hash)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool exists(const std::string& hash) const {
+        return existsLoose(hash) || existsPacked(hash) || (refreshPacks() && existsPacked(hash));
+    }
+
+    // Hashes of the objects starting with a hex prefix of at least two digits,
+    // at most limit of them. Packs are searched through their fan-out tables and
+    // loose objects through the one directory the prefix selects.
+    std::vector<std::string> matchPrefix(const std::string& prefix, size_t limit = 2) const {
+        std::vector<std::string> matches;
+        if (prefix.size() < 2 || prefix.find_first_not_of("0123456789abcdef") != std::string::npos) {
+            return matches;
+        }
+        {
+            std::lock_guard<std::mutex> lock(looseMutex);
+            const std::vector<std::string>& loose = looseIn(prefix.substr(0, 2));
+            for (auto it = std::lower_bound(loose.begin(), loose.end(), prefix);
+                 it != loose.end() && matches.size() < limit && it->compare(0, prefix.size(), prefix) == 0; ++it) {
+                matches.push_back(*it);
+            }
+        }
+        for (const auto& pack : *packs()) {
+            std::vector<std::string> packed;
+            pack->matchPrefix(prefix, packed, limit);
+            for (auto& hash : packed) {
+                if (matches.size() < limit && std::find(matches.begin(), matches.end(), hash) == matches.end()) {
+                    matches.push_back(std::move(hash));
+                }
+            }
+        }
+        return matches;
+    }
+
+    // Shortest prefix of hash, at least minLength digits, that no other object shares
+    std::string abbreviate(const std::string& hash, size_t minLength = 7) const {
+        if (hash.size() <= minLength) {
+            return hash;
+        }
+        size_t shared = 0;
+        auto common = [&hash](const std::string& other) {
+            size_t n = 0;
+            while (n < hash.size() && n < other.size() && hash[n] == other[n]) {
+                n++;
+            }
+            return n;
+        };
+        {
+            std::lock_guard<std::mutex> lock(looseMutex);
+            const std::vector<std::string>& loose = looseIn(hash.substr(0, 2));
+            auto it = std::lower_bound(loose.begin(), loose.end(), hash);
+            if (it != loose.begin()) {
+                shared = std::max(shared, common(*std::prev(it)));
+            }
+            if (it != loose.end() && *it == hash) {
+                ++it;
+            }
+            if (it != loose.end()) {
+                shared = std::max(shared, common(*it));
+            }
+        }
+        for (const auto& pack : *packs()) {
+            shared = std::max(shared, pack->commonPrefix(hash));
+        }
+        return hash.substr(0, std::max(minLength, std::min(hash.size(), shared + 1)));
+    }
+
+    // Stores an object and returns its hash. created is set when the object
+    // was not already present; bytes receives the size written to disk.
+    std::string write(ObjectType type, const std::string& payload, bool* created = nullptr, uint64_t* bytes = nullptr) {
+        return writeHashed(type, payload, hashObject(type, payload), created, bytes);
+    }
+
+    // Same as write() for a payload whose hash is already known
+    std::string writeHashed(ObjectType type, const std::string& payload, const std::string& hash,
+                            bool* created = nullptr, uint64_t* bytes = nullptr) {
+        if (created) {
+            *created = false;
+        }
+        // Not rescanning the packs here: a loose duplicate of a just-packed object is harmless
+        if (existsLoose(hash) || existsPacked(hash)) {
+            return hash;
+        }
+
+        TRACE_SCOPE("object.write", "io");
+        std::filesystem::path path = loosePath(hash);
+        std::filesystem::create_directories(path.parent_path());
+        std::string data = objectHeader(type, payload.size()) + payload;
+        if (!writeFileAtomic(path, data, durable)) {
+            return "";
+        }
+        {
+            std::lock_guard<std::mutex> lock(looseMutex);
+            auto listing = looseListings.find(hash.substr(0, 2));
+            if (listing != looseListings.end()) {
+                auto at = std::lower_bound(listing->second.begin(), listing->second.end(), hash);
+                listing->second.insert(at, hash);
+            }
+        }
+        if (created) {
+            *created = true;
+        }
+        if (bytes) {
+            *bytes = data.size();
+        }
+        return hash;
+    }
+
+    // Called with the hash of an object read() does not find; if it returns
+    // true (having stored the object, as a partial clone fetching from its
+    // promisor does), the read is tried again
+    void setMissingHandler(std::function<bool(const std::string&)> handler) {
+        missingHandler = std::move(handler);
+    }
+
+    // Reads an object; returns false if it is missing or malformed
+    bool read(const std::string& hash, ObjectType& type, std::string& payload) const {
+        return readLocal(hash, type, payload) ||
+               (missingHandler && missingHandler(hash) && readLocal(hash, type, payload));
+    }
+
+    // Reads an object present in this store, without asking the missing handler
+    bool readLocal(const std::string& hash, ObjectType& type, std::string& payload) const {
+        if (hash.size() <= 2) {
+            return false;
+        }
+        TRACE_SCOPE("object.read", "io");
+        std::string data;
+        if (!readFile(loosePath(hash), data)) {
+            // A repack may have moved the object into a pack this store has not seen yet
+            return readPacked(hash, type, payload) || (refreshPacks() && readPacked(hash, type, payload));
+        }
+        size_t space = data.find(' ');
+        size_t nul = data.find('\0');
+        if (space == std::string::npos || nul == std::string::npos || space > nul) {
+            return false;
+        }
+        if (!parseObjectType(data.substr(0, space), type)) {
+            return false;
+        }
+        payload = data.substr(nul + 1);
+        return true;
+    }
+};
+
+#endif // CODEBIRD_OBJECT_STORE_H
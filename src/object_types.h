@@ -0,0 +1,95 @@
+#ifndef CODEBIRD_OBJECT_TYPES_H
+#define CODEBIRD_OBJECT_TYPES_H
+
+#include <string>
+#include <vector>
+
+// Kinds of objects kept in the object store
+enum class ObjectType { Blob, Tree, Commit };
+
+inline const char* objectTypeName(ObjectType type) {
+    switch (type) {
+        case ObjectType::Blob: return "blob";
+        case ObjectType::Tree: return "tree";
+        case ObjectType::Commit: return "commit";
+    }
+    return "unknown";
+}
+
+inline bool parseObjectType(const std::string& name, ObjectType& type) {
+    if (name == "blob") {
+        type = ObjectType::Blob;
+    } else if (name == "tree") {
+        type = ObjectType::Tree;
+    } else if (name == "commit") {
+        type = ObjectType::Commit;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Hash function naming the objects of a repository (its object format)
+enum class HashAlgorithm { Sha256, Blake3 };
+
+inline const char* hashAlgorithmName(HashAlgorithm algorithm) {
+    return algorithm == HashAlgorithm::Blake3 ? "blake3" : "sha256";
+}
+
+inline bool parseHashAlgorithm(const std::string& name, HashAlgorithm& algorithm) {
+    if (name == "sha256") {
+        algorithm = HashAlgorithm::Sha256;
+    } else if (name == "blake3") {
+        algorithm = HashAlgorithm::Blake3;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// One entry of a tree object: a file (blob) or a subdirectory (tree)
+struct TreeEntry {
+    ObjectType type;
+    std::string hash;
+    std::string name;
+};
+
+// Tree payload is one "<type> <hash> <name>" line per entry, sorted by name
+inline std::string serializeTree(const std::vector<TreeEntry>& entries) {
+    std::string payload;
+    for (const auto& entry : entries) {
+        payload += objectTypeName(entry.type);
+        payload += ' ';
+        payload += entry.hash;
+        payload += ' ';
+        payload += entry.name;
+        payload += '\n';
+    }
+    return payload;
+}
+
+inline bool parseTree(const std::string& payload, std::vector<TreeEntry>& entries) {
+    size_t pos = 0;
+    while (pos < payload.size()) {
+        size_t end = payload.find('\n', pos);
+        if (end == std::string::npos) {
+            return false;
+        }
+        size_t typeEnd = payload.find(' ', pos);
+        size_t hashEnd = typeEnd == std::string::npos ? std::string::npos : payload.find(' ', typeEnd + 1);
+        if (hashEnd == std::string::npos || hashEnd > end) {
+            return false;
+        }
+        TreeEntry entry;
+        if (!parseObjectType(payload.substr(pos, typeEnd - pos), entry.type)) {
+            return false;
+        }
+        entry.hash = payload.substr(typeEnd + 1, hashEnd - typeEnd - 1);
+        entry.name = payload.substr(hashEnd + 1, end - hashEnd - 1);
+        entries.push_back(std::move(entry));
+        pos = end + 1;
+    }
+    return true;
+}
+
+#endif // CODEBIRD_OBJECT_TYPES_H
@@ -0,0 +1,70 @@
+#ifndef CODEBIRD_OUTPUT_H
+#define CODEBIRD_OUTPUT_H
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Output collected into large chunks and handed to a stream (std::cout by
+// default, so redirecting its buffer redirects this too) a chunk at a time,
+// for commands that stream many lines (std::endl would flush every one of
+// them). When the reading end of a pipe goes away, as with `codebird log |
+// head`, the write fails with EPIPE instead of killing the process; ok() then
+// turns false so the producer can stop its work early.
+class BufferedOutput {
+private:
+    static constexpr size_t CAPACITY = 64 << 10;
+
+    std::ostream& out;
+    std::string buffer;
+    bool failed = false;
+
+public:
+    explicit BufferedOutput(std::ostream& out = std::cout) : out(out) {
+        std::signal(SIGPIPE, SIG_IGN);
+        buffer.reserve(CAPACITY);
+    }
+
+    ~BufferedOutput() {
+        flush();
+    }
+
+    BufferedOutput(const BufferedOutput&) = delete;
+    BufferedOutput& operator=(const BufferedOutput&) = delete;
+
+    // False once a write has failed; everything after that is discarded
+    bool ok() const { return !failed; }
+
+    bool flush() {
+        if (!failed && !buffer.empty()) {
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            out.flush();
+            failed = !out;
+        }
+        buffer.clear();
+        return !failed;
+    }
+
+    BufferedOutput& operator<<(std::string_view text) {
+        if (!failed) {
+            buffer.append(text);
+            if (buffer.size() >= CAPACITY) {
+                flush();
+            }
+        }
+        return *this;
+    }
+
+    BufferedOutput& operator<<(char c) {
+        return *this << std::string_view(&c, 1);
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    BufferedOutput& operator<<(T value) {
+        return *this << std::string_view(std::to_string(value));
+    }
+};
+
+#endif // CODEBIRD_OUTPUT_H
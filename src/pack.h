@@ -0,0 +1,455 @@
+#ifndef CODEBIRD_PACK_H
+#define CODEBIRD_PACK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ewah.h"
+#include "file_util.h"
+#include "object_types.h"
+
+// Packs store many objects in one file under .cbird/objects/pack/:
+//   pack-<id>.pack    "CBPK" v1 count, then per object: type byte, varint size, payload
+//   pack-<id>.idx     "CBIX" v1 count, 256-entry fan-out, sorted 32-byte hashes,
+//                     pack position of each hash (u32), offset of each hash (u64)
+//   pack-<id>.bitmap  reachability bitmaps over pack positions (see BitmapIndex)
+// All integers are little-endian.
+
+inline void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>(value >> (8 * i));
+    }
+}
+
+inline void putU64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out += static_cast<char>(value >> (8 * i));
+    }
+}
+
+inline uint32_t getU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= uint32_t(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+inline uint64_t getU64(const char* data) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= uint64_t(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+inline void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+inline bool getVarint(std::string_view data, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(data[pos++]);
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 64-digit hex hash to 32 raw bytes; false if the text is not a full hash
+inline bool hexToBinary(const std::string& hex, std::string& binary) {
+    if (hex.size() != 64) {
+        return false;
+    }
+    binary.resize(32);
+    for (size_t i = 0; i < 32; ++i) {
+        int value = 0;
+        for (int j = 0; j < 2; ++j) {
+            char c = hex[2 * i + j];
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+            if (digit < 0) {
+                return false;
+            }
+            value = value * 16 + digit;
+        }
+        binary[i] = static_cast<char>(value);
+    }
+    return true;
+}
+
+inline std::string binaryToHex(const char* binary) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(64, '0');
+    for (size_t i = 0; i < 32; ++i) {
+        uint8_t byte = static_cast<uint8_t>(binary[i]);
+        hex[2 * i] = digits[byte >> 4];
+        hex[2 * i + 1] = digits[byte & 15];
+    }
+    return hex;
+}
+
+// A pack and its index, both memory-mapped; lookups use the fan-out table then binary search
+class PackFile {
+private:
+    static constexpr size_t HEADER = 12;
+    static constexpr size_t FANOUT = 256 * 4;
+
+    std::filesystem::path packPath;
+    MappedFile index;
+    MappedFile pack;
+    uint32_t count = 0;
+
+    const char* hashAt(uint32_t sorted) const {
+        return index.data() + HEADER + FANOUT + size_t(sorted) * 32;
+    }
+
+    // Range of sorted positions whose first byte is that of the given hex prefix
+    void bucket(const std::string& hexPrefix, uint32_t& low, uint32_t& high) const {
+        std::string binary;
+        if (hexPrefix.size() < 2 || !hexToBinary(hexPrefix.substr(0, 2) + std::string(62, '0'), binary)) {
+            low = 0;
+            high = count;
+            return;
+        }
+        uint8_t first = static_cast<uint8_t>(binary[0]);
+        low = first ? getU32(index.data() + HEADER + (first - 1) * 4) : 0;
+        high = getU32(index.data() + HEADER + first * 4);
+    }
+
+public:
+    // Maps pack-<id>.idx and its .pack; null if either is unusable
+    static std::unique_ptr<PackFile> open(const std::filesystem::path& idxPath) {
+        auto result = std::make_unique<PackFile>();
+        MappedFile& index = result->index;
+        if (!index.open(idxPath) || index.size() < HEADER + FANOUT ||
+            index.view().substr(0, 4) != "CBIX" || getU32(index.data() + 4) != 1) {
+            return nullptr;
+        }
+        result->count = getU32(index.data() + 8);
+        if (index.size() < HEADER + FANOUT + size_t(result->count) * (32 + 4 + 8)) {
+            return nullptr;
+        }
+        result->packPath = idxPath;
+        result->packPath.replace_extension(".pack");
+        if (!result->pack.open(result->packPath) || result->pack.size() < HEADER) {
+            return nullptr;
+        }
+        return result;
+    }
+
+    const std::filesystem::path& path() const { return packPath; }
+    uint32_t objectCount() const { return count; }
+    uint64_t sizeInBytes() const { return pack.size(); }
+
+    // Position (order in the pack) and byte offset of an object
+    bool find(const std::string& hexHash, uint32_t& position, uint64_t& offset) const {
+        std::string binary;
+        if (!hexToBinary(hexHash, binary)) {
+            return false;
+        }
+        uint32_t low, high;
+        bucket(hexHash, low, high);
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            int cmp = std::memcmp(hashAt(mid), binary.data(), 32);
+            if (cmp == 0) {
+                const char* positions = index.data() + HEADER + FANOUT + size_t(count) * 32;
+                const char* offsets = positions + size_t(count) * 4;
+                position = getU32(positions + size_t(mid) * 4);
+                offset = getU64(offsets + size_t(mid) * 8);
+                return true;
+            }
+            if (cmp < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return false;
+    }
+
+    bool contains(const std::string& hexHash) const {
+        uint32_t position;
+        uint64_t offset;
+        return find(hexHash, position, offset);
+    }
+
+    // First sorted position whose hash is not less than the hex prefix
+    uint32_t lowerBound(const std::string& hexPrefix) const {
+        uint32_t low, high;
+        bucket(hexPrefix, low, high);
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            if (binaryToHex(hashAt(mid)).compare(0, hexPrefix.size(), hexPrefix) < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    // Appends the hashes starting with hexPrefix, stopping once out holds limit entries
+    void matchPrefix(const std::string& hexPrefix, std::vector<std::string>& out, size_t limit) const {
+        for (uint32_t i = lowerBound(hexPrefix); i < count && out.size() < limit; ++i) {
+            std::string hex = binaryToHex(hashAt(i));
+            if (hex.compare(0, hexPrefix.size(), hexPrefix) != 0) {
+                break;
+            }
+            out.push_back(std::move(hex));
+        }
+    }
+
+    // Longest prefix the hash shares with any other hash in the pack (its sorted neighbours)
+    size_t commonPrefix(const std::string& hexHash) const {
+        size_t longest = 0;
+        uint32_t at = lowerBound(hexHash);
+        for (uint32_t i : {at - 1, at, at + 1}) {
+            if (i >= count) {
+                continue;
+            }
+            std::string hex = binaryToHex(hashAt(i));
+            if (hex == hexHash) {
+                continue;
+            }
+            size_t shared = 0;
+            while (shared < hex.size() && shared < hexHash.size() && hex[shared] == hexHash[shared]) {
+                shared++;
+            }
+            longest = std::max(longest, shared);
+        }
+        return longest;
+    }
+
+    // Hashes ordered by pack position
+    std::vector<std::string> hashesInPackOrder() const {
+        std::vector<std::string> hashes(count);
+        const char* positions = index.data() + HEADER + FANOUT + size_t(count) * 32;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t position = getU32(positions + size_t(i) * 4);
+            if (position < count) {
+                hashes[position] = binaryToHex(hashAt(i));
+            }
+        }
+        return hashes;
+    }
+
+    // Hashes of the objects at the given pack positions, in the order given
+    std::vector<std::string> hashesAt(const std::vector<uint32_t>& wanted) const {
+        std::vector<uint32_t> sortedAt(count, count);
+        const char* positions = index.data() + HEADER + FANOUT + size_t(count) * 32;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t position = getU32(positions + size_t(i) * 4);
+            if (position < count) {
+                sortedAt[position] = i;
+            }
+        }
+        std::vector<std::string> hashes;
+        hashes.reserve(wanted.size());
+        for (uint32_t position : wanted) {
+            if (position < count && sortedAt[position] < count) {
+                hashes.push_back(binaryToHex(hashAt(sortedAt[position])));
+            }
+        }
+        return hashes;
+    }
+
+    bool read(uint64_t offset, ObjectType& type, std::string& payload) const {
+        if (offset >= pack.size() || static_cast<uint8_t>(pack.data()[offset]) > static_cast<uint8_t>(ObjectType::Commit)) {
+            return false;
+        }
+        type = static_cast<ObjectType>(pack.data()[offset]);
+        size_t headerEnd = std::min<size_t>(pack.size(), offset + 11);
+        std::string header(pack.data() + offset, headerEnd - offset);
+        size_t pos = 1;
+        uint64_t size;
+        if (!getVarint(header, pos, size) || size > pack.size() - offset - pos) {
+            return false;
+        }
+        payload.assign(pack.data() + offset + pos, size);
+        return true;
+    }
+};
+
+// Streams objects into a new pack, then writes its sorted index
+class PackWriter {
+private:
+    std::filesystem::path tmpPack;
+    std::ofstream out;
+    uint64_t offset = 0;
+    std::vector<std::pair<std::string, uint64_t>> entries; // Binary hash and offset, in pack order
+
+public:
+    bool begin(const std::filesystem::path& packDir) {
+        std::filesystem::create_directories(packDir);
+        tmpPack = packDir / "tmp-pack.pack";
+        out.open(tmpPack, std::ios::binary | std::ios::trunc);
+        std::string header = "CBPK";
+        putU32(header, 1);
+        putU32(header, 0); // Object count, patched in finish()
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        offset = header.size();
+        return out.is_open();
+    }
+
+    void add(const std::string& hexHash, ObjectType type, const std::string& payload) {
+        std::string binary;
+        hexToBinary(hexHash, binary);
+        entries.push_back({binary, offset});
+        std::string header(1, static_cast<char>(type));
+        putVarint(header, payload.size());
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        offset += header.size() + payload.size();
+    }
+
+    size_t objectCount() const { return entries.size(); }
+
+    // Writes the index and renames both files to pack-<id>; returns the pack path or "" on failure
+    std::filesystem::path finish(const std::string& packId) {
+        std::string count;
+        putU32(count, static_cast<uint32_t>(entries.size()));
+        out.seekp(8);
+        out.write(count.data(), 4);
+        out.close();
+        if (!out) {
+            return "";
+        }
+
+        std::vector<uint32_t> order(entries.size());
+        for (uint32_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return entries[a].first < entries[b].first;
+        });
+
+        std::string index = "CBIX";
+        putU32(index, 1);
+        putU32(index, static_cast<uint32_t>(entries.size()));
+        uint32_t fanout[256] = {};
+        for (const auto& entry : entries) {
+            fanout[static_cast<uint8_t>(entry.first[0])]++;
+        }
+        uint32_t running = 0;
+        for (int i = 0; i < 256; ++i) {
+            running += fanout[i];
+            putU32(index, running);
+        }
+        for (uint32_t i : order) {
+            index += entries[i].first;
+        }
+        for (uint32_t i : order) {
+            putU32(index, i);
+        }
+        for (uint32_t i : order) {
+            putU64(index, entries[i].second);
+        }
+
+        std::filesystem::path packDir = tmpPack.parent_path();
+        std::filesystem::path packPath = packDir / ("pack-" + packId + ".pack");
+        std::filesystem::path idxPath = packDir / ("pack-" + packId + ".idx");
+        std::error_code ec;
+        std::filesystem::rename(tmpPack, packPath, ec);
+        if (ec || !writeFileAtomic(idxPath, index)) {
+            return "";
+        }
+        return packPath;
+    }
+};
+
+// Reachability bitmaps of selected commits over pack positions, plus one
+// bitmap per object type. File: "CBBM" v1 objectCount, commit/tree/blob type
+// bitmaps, entry count, then per entry a 32-byte commit hash and its bitmap.
+class BitmapIndex {
+private:
+    std::unordered_map<std::string, EwahBitmap> commits; // Commit hash -> reachable positions
+    EwahBitmap typeBitmaps[3];
+    uint32_t objects = 0;
+
+public:
+    bool load(const std::filesystem::path& path) {
+        std::string data;
+        if (!readFile(path, data) || data.size() < 12 || data.compare(0, 4, "CBBM") != 0 ||
+            getU32(data.data() + 4) != 1) {
+            return false;
+        }
+        objects = getU32(data.data() + 8);
+        size_t pos = 12;
+        for (auto& bitmap : typeBitmaps) {
+            if (!EwahBitmap::parse(data, pos, bitmap)) {
+                return false;
+            }
+        }
+        if (pos + 4 > data.size()) {
+            return false;
+        }
+        uint32_t entries = getU32(data.data() + pos);
+        pos += 4;
+        for (uint32_t i = 0; i < entries; ++i) {
+            if (pos + 32 > data.size()) {
+                return false;
+            }
+            std::string hash = binaryToHex(data.data() + pos);
+            pos += 32;
+            if (!EwahBitmap::parse(data, pos, commits[hash])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool save(const std::filesystem::path& path) const {
+        std::string data = "CBBM";
+        putU32(data, 1);
+        putU32(data, objects);
+        for (const auto& bitmap : typeBitmaps) {
+            bitmap.serialize(data);
+        }
+        putU32(data, static_cast<uint32_t>(commits.size()));
+        for (const auto& [hash, bitmap] : commits) {
+            std::string binary;
+            hexToBinary(hash, binary);
+            data += binary;
+            bitmap.serialize(data);
+        }
+        return writeFileAtomic(path, data);
+    }
+
+    const EwahBitmap* forCommit(const std::string& hash) const {
+        auto it = commits.find(hash);
+        return it == commits.end() ? nullptr : &it->second;
+    }
+
+    void setCommit(const std::string& hash, EwahBitmap bitmap) {
+        commits[hash] = std::move(bitmap);
+    }
+
+    const EwahBitmap& ofType(ObjectType type) const {
+        return typeBitmaps[static_cast<int>(type)];
+    }
+
+    void setType(ObjectType type, EwahBitmap bitmap) {
+        typeBitmaps[static_cast<int>(type)] = std::move(bitmap);
+    }
+
+    void setObjectCount(uint32_t count) { objects = count; }
+    size_t size() const { return commits.size(); }
+};
+
+#endif // CODEBIRD_PACK_H
@@ -0,0 +1,309 @@
+#ifndef CODEBIRD_POSTING_INDEX_H
+#define CODEBIRD_POSTING_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "file_util.h"
+#include "pack.h"
+
+// Persistent inverted index from keys (message tokens, file paths) to the
+// posting lists of the commits they belong to. Commits are numbered in the
+// order they were indexed.
+//
+// The index is a segment file plus a journal. Indexing a commit appends one
+// "<hash>\t<key>\t<key>..." line to the journal (<name>.log); once the
+// journal reaches FOLD_BYTES its commits are folded into a new segment, so
+// commits never wait for a rebuild. Readers use the segment and whatever the
+// journal holds; a commit found in both is counted once.
+//
+// Segment (<name>): "CBMI" v1, commit count, key count (u32), then the
+// offsets (u64) of the key names and of the postings; the commit hashes
+// (32 bytes each) by number; the commit numbers sorted by hash (u32); per
+// key, sorted by name, its name offset and length (u32) and its postings
+// offset (u64); the names; and the postings, each a varint count followed by
+// varint deltas of increasing commit numbers.
+class PostingIndex {
+public:
+    static constexpr uint32_t NONE = 0xffffffff;
+
+private:
+    static constexpr size_t HEADER = 32;
+    static constexpr size_t KEY_RECORD = 16;
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uintmax_t FOLD_BYTES = 128 << 10;
+
+    std::filesystem::path segmentPath;
+    std::filesystem::path journalPath;
+    MappedFile segment;
+    uint32_t segmentCommits = 0;
+    uint32_t keyCount = 0;
+    uint64_t namesOffset = 0;
+    uint64_t postingsOffset = 0;
+
+    // Commits from the journal, numbered after the segment's
+    std::vector<std::string> journalHashes;
+    std::unordered_map<std::string, uint32_t> journalIndex;
+    std::unordered_map<std::string, std::vector<uint32_t>> journalPostings;
+
+    const char* hashesStart() const { return segment.data() + HEADER; }
+    const char* sortedStart() const { return hashesStart() + size_t(segmentCommits) * 32; }
+    const char* keysStart() const { return sortedStart() + size_t(segmentCommits) * 4; }
+
+    std::string_view keyName(uint32_t i) const {
+        const char* record = keysStart() + size_t(i) * KEY_RECORD;
+        return {segment.data() + namesOffset + getU32(record), getU32(record + 4)};
+    }
+
+    // Commit numbers listed for a key in the segment
+    std::vector<uint32_t> segmentPostings(const std::string& key) const {
+        std::vector<uint32_t> result;
+        uint32_t low = 0, high = keyCount;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            std::string_view name = keyName(mid);
+            if (name == key) {
+                std::string_view data = segment.view();
+                size_t pos = postingsOffset + getU64(keysStart() + size_t(mid) * KEY_RECORD + 8);
+                uint64_t count = 0, delta = 0, current = 0;
+                getVarint(data, pos, count);
+                for (uint64_t i = 0; i < count && getVarint(data, pos, delta); ++i) {
+                    current += delta;
+                    result.push_back(static_cast<uint32_t>(current));
+                }
+                return result;
+            }
+            if (name < key) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return result;
+    }
+
+    bool loadSegment() {
+        segmentCommits = keyCount = 0;
+        MappedFile mapped;
+        if (!mapped.open(segmentPath) || mapped.size() < HEADER || mapped.view().substr(0, 4) != "CBMI" ||
+            getU32(mapped.data() + 4) != VERSION) {
+            segment.close();
+            return false;
+        }
+        uint32_t commits = getU32(mapped.data() + 8);
+        uint32_t keys = getU32(mapped.data() + 12);
+        uint64_t names = getU64(mapped.data() + 16);
+        uint64_t postings = getU64(mapped.data() + 24);
+        uint64_t tables = HEADER + uint64_t(commits) * 36 + uint64_t(keys) * KEY_RECORD;
+        if (tables > names || names > postings || postings > mapped.size()) {
+            segment.close();
+            return false;
+        }
+        segment = std::move(mapped);
+        segmentCommits = commits;
+        keyCount = keys;
+        namesOffset = names;
+        postingsOffset = postings;
+        return true;
+    }
+
+    void loadJournal() {
+        journalHashes.clear();
+        journalIndex.clear();
+        journalPostings.clear();
+        std::ifstream in(journalPath);
+        for (std::string line; std::getline(in, line);) {
+            std::stringstream ss(line);
+            std::string hash;
+            if (!std::getline(ss, hash, '\t') || hash.size() != 64 || find(hash) != NONE) {
+                continue;
+            }
+            uint32_t number = segmentCommits + static_cast<uint32_t>(journalHashes.size());
+            journalHashes.push_back(hash);
+            journalIndex[hash] = number;
+            for (std::string key; std::getline(ss, key, '\t');) {
+                if (!key.empty()) {
+                    journalPostings[key].push_back(number);
+                }
+            }
+        }
+    }
+
+public:
+    PostingIndex(const std::filesystem::path& dir, const std::string& name)
+        : segmentPath(dir / name), journalPath(dir / (name + ".log")) {}
+
+    // Reads the segment and the journal; an index that does not exist yet is empty
+    void load() {
+        loadSegment();
+        loadJournal();
+    }
+
+    // Number of indexed commits
+    uint32_t size() const {
+        return segmentCommits + static_cast<uint32_t>(journalHashes.size());
+    }
+
+    // Number of an indexed commit, or NONE if it has not been indexed
+    uint32_t find(const std::string& hash) const {
+        std::string binary;
+        if (segmentCommits && hexToBinary(hash, binary)) {
+            uint32_t low = 0, high = segmentCommits;
+            while (low < high) {
+                uint32_t mid = low + (high - low) / 2;
+                uint32_t number = getU32(sortedStart() + size_t(mid) * 4);
+                int cmp = std::memcmp(hashesStart() + size_t(number) * 32, binary.data(), 32);
+                if (cmp == 0) {
+                    return number;
+                }
+                if (cmp < 0) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+        }
+        auto it = journalIndex.find(hash);
+        return it == journalIndex.end() ? NONE : it->second;
+    }
+
+    std::string hashAt(uint32_t number) const {
+        return number < segmentCommits ? binaryToHex(hashesStart() + size_t(number) * 32)
+                                       : journalHashes[number - segmentCommits];
+    }
+
+    // Sorted numbers of the indexed commits listed under key
+    std::vector<uint32_t> postings(const std::string& key) const {
+        std::vector<uint32_t> result = segmentPostings(key);
+        auto it = journalPostings.find(key);
+        if (it != journalPostings.end()) {
+            result.insert(result.end(), it->second.begin(), it->second.end());
+        }
+        return result;
+    }
+
+    using Entry = std::pair<std::string, std::vector<std::string>>; // Commit hash, keys
+
+    // Indexes commits with one append to the journal, and folds the journal
+    // into the segment once it is long enough. Keys must not hold tabs or newlines.
+    bool add(const std::vector<Entry>& commits) {
+        std::string lines;
+        for (const auto& [hash, keys] : commits) {
+            lines += hash;
+            for (const auto& key : keys) {
+                lines += "\t" + key;
+            }
+            lines += "\n";
+        }
+        if (lines.empty()) {
+            return true;
+        }
+        int fd = ::open(journalPath.c_str(), O_CREAT | O_WRONLY | O_APPEND, 0644);
+        if (fd < 0) {
+            std::filesystem::create_directories(journalPath.parent_path());
+            fd = ::open(journalPath.c_str(), O_CREAT | O_WRONLY | O_APPEND, 0644);
+        }
+        if (fd < 0) {
+            return false;
+        }
+        flock(fd, LOCK_SH);
+        bool ok = ::write(fd, lines.data(), lines.size()) == static_cast<ssize_t>(lines.size());
+        flock(fd, LOCK_UN);
+        ::close(fd);
+        std::error_code ec;
+        if (ok && std::filesystem::file_size(journalPath, ec) >= FOLD_BYTES && !ec) {
+            fold();
+        }
+        return ok;
+    }
+
+    // Writes a segment holding everything indexed so far and empties the
+    // journal, holding an exclusive lock on the journal while doing so
+    bool fold() {
+        int fd = ::open(journalPath.c_str(), O_RDWR);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = false;
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            load();
+            if (!journalHashes.empty()) {
+                ok = writeSegment() && ::ftruncate(fd, 0) == 0;
+                load();
+            }
+            flock(fd, LOCK_UN);
+        }
+        ::close(fd);
+        return ok;
+    }
+
+private:
+    bool writeSegment() {
+        uint32_t commits = size();
+        std::map<std::string, std::vector<uint32_t>> keys;
+        for (uint32_t i = 0; i < keyCount; ++i) {
+            std::string name(keyName(i));
+            keys[name] = segmentPostings(name);
+        }
+        for (const auto& [key, numbers] : journalPostings) {
+            auto& list = keys[key];
+            list.insert(list.end(), numbers.begin(), numbers.end());
+        }
+
+        std::vector<std::string> binaries(commits);
+        std::vector<uint32_t> sorted(commits);
+        for (uint32_t i = 0; i < commits; ++i) {
+            hexToBinary(hashAt(i), binaries[i]);
+            sorted[i] = i;
+        }
+        std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) { return binaries[a] < binaries[b]; });
+
+        std::string table, names, postings;
+        for (const auto& [key, numbers] : keys) {
+            putU32(table, static_cast<uint32_t>(names.size()));
+            putU32(table, static_cast<uint32_t>(key.size()));
+            putU64(table, postings.size());
+            names += key;
+            putVarint(postings, numbers.size());
+            uint32_t previous = 0;
+            for (uint32_t number : numbers) {
+                putVarint(postings, number - previous);
+                previous = number;
+            }
+        }
+
+        std::string out = "CBMI";
+        putU32(out, VERSION);
+        putU32(out, commits);
+        putU32(out, static_cast<uint32_t>(keys.size()));
+        uint64_t namesAt = HEADER + uint64_t(commits) * 36 + table.size();
+        putU64(out, namesAt);
+        putU64(out, namesAt + names.size());
+        for (const auto& binary : binaries) {
+            out += binary;
+        }
+        for (uint32_t number : sorted) {
+            putU32(out, number);
+        }
+        out += table;
+        out += names;
+        out += postings;
+        return writeFileAtomic(segmentPath, out);
+    }
+};
+
+#endif // CODEBIRD_POSTING_INDEX_H
@@ -0,0 +1,115 @@
+#ifndef CODEBIRD_PROMISOR_H
+#define CODEBIRD_PROMISOR_H
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "object_store.h"
+#include "sync.h"
+
+// Object requests from a partial clone to the repository that promised its
+// missing blobs (the "objects" service of sync.h). The client sends a batch
+// of "want <hash>" lines ended by "done"; the server reads the whole batch,
+// then answers each want in order with the object, or "missing <hash>". A
+// connection carries any number of batches.
+
+// Answers batches on a channel until the client goes away
+inline void serveObjects(const ObjectStore& store, Channel& channel) {
+    std::vector<std::string> wants;
+    for (std::string line; channel.readLine(line);) {
+        if (line.compare(0, 5, "want ") == 0) {
+            wants.push_back(line.substr(5));
+            continue;
+        }
+        if (line != "done") {
+            return;
+        }
+        for (const auto& hash : wants) {
+            ObjectType type;
+            std::string payload;
+            if (!store.read(hash, type, payload)) {
+                channel.write("missing " + hash + "\n");
+                continue;
+            }
+            sendObject(channel, hash, type, payload);
+        }
+        wants.clear();
+        if (!channel.flush()) {
+            return;
+        }
+    }
+}
+
+// Where a partial clone fetches missing objects from: a repository directory
+// read directly, or "unix:<path>" for a server listening on a Unix socket
+// (connected on first use).
+class PromisorRemote {
+public:
+    using FoundFn = std::function<void(const std::string& hash, ObjectType type, const std::string& payload)>;
+
+private:
+    std::string location;
+    std::unique_ptr<ObjectStore> store;
+    std::unique_ptr<Channel> channel;
+
+public:
+    explicit PromisorRemote(std::string location) : location(std::move(location)) {
+        if (this->location.compare(0, 5, "unix:") != 0) {
+            store = std::make_unique<ObjectStore>(std::filesystem::path(this->location) / ".cbird");
+        }
+    }
+
+    const std::string& where() const { return location; }
+
+    // Requests a batch of objects, calling found for each one the remote has;
+    // false if the remote cannot be reached
+    bool fetch(const std::vector<std::string>& hashes, const FoundFn& found) {
+        if (store) {
+            if (!std::filesystem::exists(std::filesystem::path(location) / ".cbird")) {
+                return false;
+            }
+            for (const auto& hash : hashes) {
+                ObjectType type;
+                std::string payload;
+                if (store->read(hash, type, payload)) {
+                    found(hash, type, payload);
+                }
+            }
+            return true;
+        }
+        if (!channel || !channel->ok()) {
+            std::string error;
+            channel = connectRemote(location, "objects", error);
+            if (!channel) {
+                return false;
+            }
+        }
+        for (const auto& hash : hashes) {
+            channel->write("want " + hash + "\n");
+        }
+        channel->write("done\n");
+        channel->flush();
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            std::string line;
+            if (!channel->readLine(line)) {
+                return false;
+            }
+            if (line.compare(0, 8, "missing ") == 0) {
+                continue;
+            }
+            std::string hash;
+            ObjectType type;
+            std::string payload;
+            if (!receiveObject(*channel, line, hash, type, payload)) {
+                return false;
+            }
+            found(hash, type, payload);
+        }
+        return true;
+    }
+};
+
+#endif // CODEBIRD_PROMISOR_H
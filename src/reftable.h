@@ -0,0 +1,629 @@
+#ifndef CODEBIRD_REFTABLE_H
+#define CODEBIRD_REFTABLE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "file_util.h"
+#include "pack.h"
+
+// A ref (or the deletion of one) as stored in a ref table
+struct RefRecord {
+    std::string name;
+    std::string value; // Commit hash, "" for a branch without commits
+    bool deleted = false;
+};
+
+// One immutable, memory-mapped table of refs sorted by name. Records are
+// grouped into blocks of about BLOCK_SIZE bytes; within a block each record
+// stores only the suffix it does not share with the previous name, except at
+// restart points (every RESTART_INTERVAL records) which hold the full name.
+// Lookups binary-search the blocks by their first name, then the restart
+// points, then scan at most RESTART_INTERVAL records.
+//
+// File: "CBRT" v1, min and max update index (u64), blocks, an index of u64
+// block offsets, and a footer of index offset (u64), block count (u32), "CBRT".
+// Record: varint shared, varint suffix length, suffix, kind byte (0 deletion,
+// 1 value), varint value length, value. Block trailer: u32 restart offsets
+// (from the block start) and their u32 count.
+class RefTable {
+public:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    static constexpr size_t RESTART_INTERVAL = 16;
+
+private:
+    static constexpr size_t HEADER = 24;
+    static constexpr size_t FOOTER = 16;
+
+    std::filesystem::path filePath;
+    MappedFile file;
+    uint64_t minUpdate = 0;
+    uint64_t maxUpdate = 0;
+    uint64_t indexOffset = 0;
+    uint32_t blocks = 0;
+
+    uint64_t blockStart(uint32_t block) const {
+        return getU64(file.data() + indexOffset + size_t(block) * 8);
+    }
+
+    // Byte range of a block's records and the position of its restart table
+    void blockLayout(uint32_t block, size_t& start, size_t& recordsEnd, size_t& restarts, uint32_t& restartCount) const {
+        start = blockStart(block);
+        size_t end = block + 1 < blocks ? blockStart(block + 1) : indexOffset;
+        restartCount = getU32(file.data() + end - 4);
+        restarts = end - 4 - size_t(restartCount) * 4;
+        recordsEnd = restarts;
+    }
+
+    // Decodes the record at pos, whose name extends key; advances pos
+    bool decode(size_t& pos, size_t end, std::string& key, RefRecord& record) const {
+        std::string_view data = file.view().substr(0, end);
+        uint64_t shared, suffix, valueLength;
+        if (!readVarint(data, pos, shared) || !readVarint(data, pos, suffix) || shared > key.size() ||
+            suffix > end - pos) {
+            return false;
+        }
+        key.resize(shared);
+        key.append(data.data() + pos, suffix);
+        pos += suffix;
+        if (pos >= end) {
+            return false;
+        }
+        record.deleted = data[pos++] == 0;
+        if (!readVarint(data, pos, valueLength) || valueLength > end - pos) {
+            return false;
+        }
+        record.name = key;
+        record.value.assign(data.data() + pos, valueLength);
+        pos += valueLength;
+        return true;
+    }
+
+    static bool readVarint(std::string_view data, size_t& pos, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(data[pos++]);
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Full name of the record at a restart point (or block start)
+    std::string nameAt(size_t pos, size_t end) const {
+        std::string key;
+        RefRecord record;
+        return decode(pos, end, key, record) ? key : std::string();
+    }
+
+public:
+    // Walks the records of a table in name order
+    class Cursor {
+    private:
+        const RefTable* table = nullptr;
+        uint32_t block = 0;
+        size_t pos = 0;
+        size_t recordsEnd = 0;
+        std::string key;
+        RefRecord current;
+        bool valid = false;
+
+        void enterBlock(uint32_t index) {
+            block = index;
+            key.clear();
+            if (block >= table->blocks) {
+                valid = false;
+                return;
+            }
+            size_t restarts;
+            uint32_t restartCount;
+            table->blockLayout(block, pos, recordsEnd, restarts, restartCount);
+        }
+
+    public:
+        Cursor() = default;
+        Cursor(const RefTable* table, uint32_t block, size_t pos) : table(table) {
+            enterBlock(block);
+            if (pos) {
+                this->pos = pos;
+            }
+            next();
+        }
+
+        bool ok() const { return valid; }
+        const RefRecord& record() const { return current; }
+
+        void next() {
+            valid = false;
+            if (!table) {
+                return;
+            }
+            while (block < table->blocks) {
+                if (pos < recordsEnd) {
+                    valid = table->decode(pos, recordsEnd, key, current);
+                    return;
+                }
+                enterBlock(block + 1);
+            }
+        }
+    };
+
+    static std::shared_ptr<RefTable> open(const std::filesystem::path& path) {
+        auto table = std::make_shared<RefTable>();
+        table->filePath = path;
+        MappedFile& file = table->file;
+        if (!file.open(path) || file.size() < HEADER + FOOTER || file.view().substr(0, 4) != "CBRT" ||
+            getU32(file.data() + 4) != 1 || file.view().substr(file.size() - 4) != "CBRT") {
+            return nullptr;
+        }
+        table->minUpdate = getU64(file.data() + 8);
+        table->maxUpdate = getU64(file.data() + 16);
+        table->indexOffset = getU64(file.data() + file.size() - FOOTER);
+        table->blocks = getU32(file.data() + file.size() - 8);
+        if (table->indexOffset + size_t(table->blocks) * 8 != file.size() - FOOTER) {
+            return nullptr;
+        }
+        return table;
+    }
+
+    const std::filesystem::path& path() const { return filePath; }
+    uint64_t minUpdateIndex() const { return minUpdate; }
+    uint64_t maxUpdateIndex() const { return maxUpdate; }
+    size_t sizeInBytes() const { return file.size(); }
+
+    // Cursor at the first record whose name is not less than name
+    Cursor seek(const std::string& name) const {
+        if (blocks == 0) {
+            return Cursor();
+        }
+        // Last block whose first name is <= name
+        uint32_t low = 0, high = blocks;
+        while (high - low > 1) {
+            uint32_t mid = low + (high - low) / 2;
+            size_t start, recordsEnd, restarts;
+            uint32_t restartCount;
+            blockLayout(mid, start, recordsEnd, restarts, restartCount);
+            if (nameAt(start, recordsEnd) <= name) {
+                low = mid;
+            } else {
+                high = mid;
+            }
+        }
+
+        // Last restart point in that block whose name is <= name
+        size_t start, recordsEnd, restarts;
+        uint32_t restartCount;
+        blockLayout(low, start, recordsEnd, restarts, restartCount);
+        uint32_t left = 0, right = restartCount;
+        while (right - left > 1) {
+            uint32_t mid = left + (right - left) / 2;
+            size_t offset = start + getU32(file.data() + restarts + size_t(mid) * 4);
+            if (nameAt(offset, recordsEnd) <= name) {
+                left = mid;
+            } else {
+                right = mid;
+            }
+        }
+        size_t offset = restartCount ? start + getU32(file.data() + restarts + size_t(left) * 4) : start;
+        Cursor cursor(this, low, offset);
+        while (cursor.ok() && cursor.record().name < name) {
+            cursor.next();
+        }
+        return cursor;
+    }
+
+    // The record for name, if this table has one (a value or a deletion)
+    bool lookup(const std::string& name, RefRecord& record) const {
+        Cursor cursor = seek(name);
+        if (!cursor.ok() || cursor.record().name != name) {
+            return false;
+        }
+        record = cursor.record();
+        return true;
+    }
+
+    // Encodes records, which must be sorted by name, into a table file image
+    static std::string build(const std::vector<RefRecord>& records, uint64_t minUpdate, uint64_t maxUpdate) {
+        std::string out = "CBRT";
+        putU32(out, 1);
+        putU64(out, minUpdate);
+        putU64(out, maxUpdate);
+
+        std::vector<uint64_t> blockOffsets;
+        std::vector<uint32_t> restarts;
+        size_t blockBegin = 0;
+        size_t inBlock = 0;
+        std::string previous;
+        auto finishBlock = [&]() {
+            for (uint32_t restart : restarts) {
+                putU32(out, restart);
+            }
+            putU32(out, static_cast<uint32_t>(restarts.size()));
+            restarts.clear();
+            inBlock = 0;
+        };
+        for (const auto& record : records) {
+            size_t estimate = record.name.size() + record.value.size() + 16 + restarts.size() * 4 + 8;
+            if (inBlock > 0 && out.size() - blockBegin + estimate > BLOCK_SIZE) {
+                finishBlock();
+            }
+            if (inBlock == 0) {
+                blockBegin = out.size();
+                blockOffsets.push_back(blockBegin);
+            }
+            size_t shared = 0;
+            if (inBlock % RESTART_INTERVAL == 0) {
+                restarts.push_back(static_cast<uint32_t>(out.size() - blockBegin));
+            } else {
+                while (shared < previous.size() && shared < record.name.size() && previous[shared] == record.name[shared]) {
+                    shared++;
+                }
+            }
+            putVarint(out, shared);
+            putVarint(out, record.name.size() - shared);
+            out.append(record.name, shared, std::string::npos);
+            out += static_cast<char>(record.deleted ? 0 : 1);
+            putVarint(out, record.deleted ? 0 : record.value.size());
+            if (!record.deleted) {
+                out += record.value;
+            }
+            previous = record.name;
+            inBlock++;
+        }
+        if (inBlock > 0) {
+            finishBlock();
+        }
+
+        uint64_t indexOffset = out.size();
+        for (uint64_t offset : blockOffsets) {
+            putU64(out, offset);
+        }
+        putU64(out, indexOffset);
+        putU32(out, static_cast<uint32_t>(blockOffsets.size()));
+        out += "CBRT";
+        return out;
+    }
+};
+
+// Outcome of a ref transaction
+enum class RefUpdateStatus {
+    Ok,
+    Stale,  // A ref no longer had its expected old value; nothing was changed
+    Failed, // The lock could not be taken or a file could not be written
+};
+
+// An immutable view of the ref tables at one generation (the update index of
+// the newest table). Readers pin a snapshot and look refs up in it without
+// taking any lock while writers publish newer ones; its tables stay mapped
+// after a compaction removes their files, so the view never changes under them.
+class RefSnapshot {
+public:
+    using Tables = std::vector<std::shared_ptr<const RefTable>>; // Oldest first
+
+private:
+    Tables stack;
+    std::string listText; // The tables.list content it was opened from
+
+public:
+    RefSnapshot() = default;
+    RefSnapshot(Tables tables, std::string list) : stack(std::move(tables)), listText(std::move(list)) {}
+
+    const Tables& tables() const { return stack; }
+    const std::string& list() const { return listText; }
+
+    uint64_t generation() const {
+        return stack.empty() ? 0 : stack.back()->maxUpdateIndex();
+    }
+
+    // Value of a ref; false if it does not exist
+    bool lookup(const std::string& name, std::string& value) const {
+        RefRecord record;
+        for (auto table = stack.rbegin(); table != stack.rend(); ++table) {
+            if ((*table)->lookup(name, record)) {
+                value = record.value;
+                return !record.deleted;
+            }
+        }
+        return false;
+    }
+
+    // Calls fn(name, value) for each ref starting with prefix, in name order,
+    // until fn returns false
+    void forEach(const std::string& prefix, const std::function<bool(const std::string&, const std::string&)>& fn) const {
+        std::vector<RefTable::Cursor> cursors;
+        for (const auto& table : stack) {
+            cursors.push_back(table->seek(prefix));
+        }
+        while (true) {
+            const RefRecord* newest = nullptr;
+            for (auto& cursor : cursors) {
+                if (cursor.ok() && (!newest || cursor.record().name <= newest->name)) {
+                    newest = &cursor.record(); // Later cursors are newer and win ties
+                }
+            }
+            if (!newest || newest->name.compare(0, prefix.size(), prefix) != 0) {
+                return;
+            }
+            RefRecord record = *newest;
+            for (auto& cursor : cursors) {
+                if (cursor.ok() && cursor.record().name == record.name) {
+                    cursor.next();
+                }
+            }
+            if (!record.deleted && !fn(record.name, record.value)) {
+                return;
+            }
+        }
+    }
+};
+
+// The refs of a repository as a stack of ref tables listed oldest first in
+// <dir>/tables.list. Newer tables shadow older ones. Every update writes one
+// small table holding all of its changes and appends it to the list under
+// tables.list.lock, so multi-ref updates are atomic. Afterwards the newest
+// tables are merged while a table is not at least twice the size of the one
+// above it, which keeps the stack logarithmic in the number of refs.
+// Updates can carry expected old values, checked under the lock, which makes
+// them compare-and-swap transactions between concurrent processes.
+//
+// Reads go through the current RefSnapshot. Renaming tables.list publishes a
+// generation to other processes; within a process, new snapshots replace the
+// current one with an atomic pointer swap, so readers on other threads keep
+// whichever generation they pinned.
+class RefStack {
+public:
+    using Changes = std::map<std::string, std::optional<std::string>>; // Ref -> new value, nullopt deletes
+    using Expected = std::map<std::string, std::optional<std::string>>; // Ref -> old value, nullopt if absent
+    using Snapshot = std::shared_ptr<const RefSnapshot>;
+
+private:
+    std::filesystem::path dir;
+    bool durable = false; // fsync tables and the list before an update returns
+    Snapshot current = std::make_shared<RefSnapshot>(); // Accessed with std::atomic_load/atomic_store
+
+    std::filesystem::path listPath() const { return dir / "tables.list"; }
+    std::filesystem::path lockPath() const { return dir / "tables.list.lock"; }
+
+    // Makes snapshot current unless a newer generation was published meanwhile
+    void publish(Snapshot snapshot) {
+        Snapshot seen = std::atomic_load(&current);
+        while (seen->generation() <= snapshot->generation() &&
+               !std::atomic_compare_exchange_weak(&current, &seen, snapshot)) {
+        }
+    }
+
+    // Opens the tables named in list, reusing ones the base snapshot has open
+    static Snapshot openTables(const std::filesystem::path& dir, const std::string& list, const RefSnapshot& base) {
+        RefSnapshot::Tables opened;
+        std::stringstream ss(list);
+        for (std::string name; std::getline(ss, name);) {
+            if (name.empty()) {
+                continue;
+            }
+            const auto& tables = base.tables();
+            auto existing = std::find_if(tables.begin(), tables.end(), [&](const auto& table) {
+                return table->path().filename() == name;
+            });
+            std::shared_ptr<const RefTable> table = existing != tables.end() ? *existing : RefTable::open(dir / name);
+            if (!table) {
+                return nullptr;
+            }
+            opened.push_back(table);
+        }
+        return std::make_shared<RefSnapshot>(std::move(opened), list);
+    }
+
+    static std::string tableList(const RefSnapshot::Tables& tables) {
+        std::string list;
+        for (const auto& table : tables) {
+            list += table->path().filename().string() + "\n";
+        }
+        return list;
+    }
+
+    // Writes a table file and returns it opened; null on failure
+    std::shared_ptr<const RefTable> writeTable(const std::vector<RefRecord>& records, uint64_t minUpdate, uint64_t maxUpdate) {
+        static thread_local std::mt19937_64 random(std::random_device{}());
+        std::stringstream name;
+        name << std::hex << minUpdate << "-" << maxUpdate << "-" << (random() & 0xffffffff) << ".ref";
+        std::filesystem::path path = dir / name.str();
+        if (!writeFileAtomic(path, RefTable::build(records, minUpdate, maxUpdate), durable)) {
+            return nullptr;
+        }
+        return RefTable::open(path);
+    }
+
+    // Replaces tables.list with tables and publishes them; the caller holds the lock
+    bool commitList(const RefSnapshot::Tables& tables) {
+        std::string list = tableList(tables);
+        if (!writeFileAtomic(listPath(), list, durable)) {
+            return false;
+        }
+        publish(std::make_shared<RefSnapshot>(tables, list));
+        return true;
+    }
+
+    // Merges tables[from..] into one table; deletions are dropped when nothing older remains
+    bool mergeFrom(RefSnapshot::Tables& tables, size_t from) {
+        bool dropDeletions = from == 0;
+        std::vector<RefRecord> merged;
+        std::vector<RefTable::Cursor> cursors;
+        for (size_t i = from; i < tables.size(); ++i) {
+            cursors.push_back(tables[i]->seek(""));
+        }
+        while (true) {
+            const RefRecord* newest = nullptr;
+            for (auto& cursor : cursors) {
+                if (cursor.ok() && (!newest || cursor.record().name <= newest->name)) {
+                    newest = &cursor.record(); // Later cursors are newer and win ties
+                }
+            }
+            if (!newest) {
+                break;
+            }
+            RefRecord record = *newest;
+            for (auto& cursor : cursors) {
+                if (cursor.ok() && cursor.record().name == record.name) {
+                    cursor.next();
+                }
+            }
+            if (!(record.deleted && dropDeletions)) {
+                merged.push_back(std::move(record));
+            }
+        }
+
+        std::shared_ptr<const RefTable> table =
+            writeTable(merged, tables[from]->minUpdateIndex(), tables.back()->maxUpdateIndex());
+        if (!table) {
+            return false;
+        }
+        RefSnapshot::Tables replaced(tables.begin() + from, tables.end());
+        RefSnapshot::Tables compacted(tables.begin(), tables.begin() + from);
+        compacted.push_back(table);
+        if (!commitList(compacted)) {
+            return false;
+        }
+        tables = std::move(compacted);
+        // Snapshots pinned by readers keep the replaced tables mapped
+        for (const auto& old : replaced) {
+            std::error_code ec;
+            std::filesystem::remove(old->path(), ec);
+        }
+        return true;
+    }
+
+    // Keeps each table at least twice the size of the one above it
+    void compact(RefSnapshot::Tables tables) {
+        while (tables.size() >= 2 && tables[tables.size() - 2]->sizeInBytes() <= 2 * tables.back()->sizeInBytes()) {
+            size_t from = tables.size() - 2;
+            uint64_t size = tables[from]->sizeInBytes() + tables.back()->sizeInBytes();
+            while (from > 0 && tables[from - 1]->sizeInBytes() <= 2 * size) {
+                size += tables[--from]->sizeInBytes();
+            }
+            if (!mergeFrom(tables, from)) {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit RefStack(const std::filesystem::path& dir) : dir(dir) {}
+
+    // Whether the repository stores its refs in tables yet
+    bool exists() const {
+        return std::filesystem::exists(listPath());
+    }
+
+    // The current generation, pinned for as long as the caller holds it
+    Snapshot snapshot() const {
+        return std::atomic_load(&current);
+    }
+
+    // Picks up tables written by other processes; retried when a concurrent
+    // compaction removes a table between reading the list and opening it
+    bool reload() {
+        for (int attempt = 0; attempt < 5; ++attempt) {
+            Snapshot base = snapshot();
+            std::string list;
+            if (!readFile(listPath(), list)) {
+                std::atomic_store(&current, std::make_shared<const RefSnapshot>());
+                return true;
+            }
+            if (list == base->list()) {
+                return true;
+            }
+            if (Snapshot opened = openTables(dir, list, *base)) {
+                publish(opened);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool lookup(const std::string& name, std::string& value) const {
+        return snapshot()->lookup(name, value);
+    }
+
+    void forEach(const std::string& prefix, const std::function<bool(const std::string&, const std::string&)>& fn) const {
+        snapshot()->forEach(prefix, fn);
+    }
+
+    void setDurable(bool enabled) {
+        durable = enabled;
+    }
+
+    // Applies all changes atomically: either every ref changes or none does.
+    // Each ref in expected must still hold its expected value (or be absent
+    // for nullopt) when the lock is held, otherwise the update is Stale.
+    RefUpdateStatus update(const Changes& changes, const Expected& expected = {}) {
+        if (changes.empty()) {
+            return RefUpdateStatus::Ok;
+        }
+        // Writers queue on an flock of the lock file; the kernel drops it when
+        // its holder exits, so a crash mid-update never leaves the refs locked
+        std::filesystem::create_directories(dir);
+        int lock = ::open(lockPath().c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+        if (lock < 0) {
+            return RefUpdateStatus::Failed;
+        }
+        while (flock(lock, LOCK_EX) != 0) {
+            if (errno != EINTR) {
+                ::close(lock);
+                return RefUpdateStatus::Failed;
+            }
+        }
+
+        RefUpdateStatus status = reload() ? RefUpdateStatus::Ok : RefUpdateStatus::Failed;
+        Snapshot base = snapshot();
+        for (const auto& [name, old] : expected) {
+            std::string value;
+            bool present = base->lookup(name, value);
+            if (status == RefUpdateStatus::Ok && (present != old.has_value() || (present && value != *old))) {
+                status = RefUpdateStatus::Stale;
+            }
+        }
+        if (status == RefUpdateStatus::Ok) {
+            std::vector<RefRecord> records;
+            for (const auto& [name, value] : changes) {
+                records.push_back({name, value.value_or(""), !value.has_value()});
+            }
+            uint64_t updateIndex = base->generation() + 1;
+            std::shared_ptr<const RefTable> table = writeTable(records, updateIndex, updateIndex);
+            RefSnapshot::Tables tables = base->tables();
+            status = RefUpdateStatus::Failed;
+            if (table) {
+                tables.push_back(table);
+                if (commitList(tables)) {
+                    status = RefUpdateStatus::Ok;
+                    compact(tables);
+                }
+            }
+        }
+        flock(lock, LOCK_UN);
+        ::close(lock);
+        return status;
+    }
+
+    size_t tableCount() const {
+        return snapshot()->tables().size();
+    }
+};
+
+#endif // CODEBIRD_REFTABLE_H
@@ -0,0 +1,100 @@
+#ifndef CODEBIRD_SPARSE_H
+#define CODEBIRD_SPARSE_H
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "file_util.h"
+
+// Cone-mode sparse checkout (.cbird/sparse-checkout, one directory per
+// line). The worktree holds the files at the root, the files directly inside
+// each ancestor of a listed directory, and everything below a listed
+// directory. Any other directory stays out of the worktree and is kept in the
+// index as a single entry holding its tree hash.
+class SparseCone {
+public:
+    enum class Scope {
+        Outside,  // Not materialized
+        Ancestor, // Its own files are, its subdirectories only if in the cone
+        Inside,   // Materialized entirely
+    };
+
+private:
+    std::vector<std::string> dirs; // "a/b/", sorted
+    bool active = false;
+
+public:
+    // Reads the cone; without the file sparse checkout is off
+    void load(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        std::vector<std::string> listed;
+        for (std::string line; std::getline(in, line);) {
+            listed.push_back(line);
+        }
+        set(listed);
+        active = static_cast<bool>(in.is_open());
+    }
+
+    bool save(const std::filesystem::path& path) const {
+        std::string data;
+        for (const auto& dir : dirs) {
+            data += dir.substr(0, dir.size() - 1) + "\n";
+        }
+        return writeFileAtomic(path, data);
+    }
+
+    bool enabled() const { return active; }
+
+    void disable() {
+        active = false;
+        dirs.clear();
+    }
+
+    // Replaces the listed directories ("a/b", "./a/b/" alike) and turns sparse checkout on
+    void set(const std::vector<std::string>& listed) {
+        active = true;
+        dirs.clear();
+        for (const auto& entry : listed) {
+            std::string dir = std::filesystem::path(entry).lexically_normal().generic_string();
+            while (!dir.empty() && dir.back() == '/') {
+                dir.pop_back();
+            }
+            if (dir.empty() || dir == ".") {
+                continue;
+            }
+            dirs.push_back(dir + "/");
+        }
+        std::sort(dirs.begin(), dirs.end());
+        dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+    }
+
+    const std::vector<std::string>& directories() const { return dirs; }
+
+    // Scope of a directory ("" for the root, otherwise "a/b/")
+    Scope scope(const std::string& dir) const {
+        if (!active) {
+            return Scope::Inside;
+        }
+        Scope result = dir.empty() ? Scope::Ancestor : Scope::Outside;
+        for (const auto& listed : dirs) {
+            if (dir.compare(0, listed.size(), listed) == 0) {
+                return Scope::Inside;
+            }
+            if (listed.compare(0, dir.size(), dir) == 0) {
+                result = Scope::Ancestor;
+            }
+        }
+        return result;
+    }
+
+    // Whether a file is materialized
+    bool includes(const std::string& path) const {
+        size_t slash = path.rfind('/');
+        return scope(slash == std::string::npos ? "" : path.substr(0, slash + 1)) != Scope::Outside;
+    }
+};
+
+#endif // CODEBIRD_SPARSE_H
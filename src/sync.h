@@ -0,0 +1,158 @@
+#ifndef CODEBIRD_SYNC_H
+#define CODEBIRD_SYNC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "commit_graph.h"
+#include "object_types.h"
+#include "transport.h"
+
+// The conversation between two repositories over a Channel. A connection
+// opens with a line naming the service the client wants:
+//   objects       a partial clone fetching the blobs it lacks (promisor.h)
+//   upload-pack   fetch: the server sends the objects the client wants
+//   receive-pack  push: the server takes objects and moves its branches
+// Both pack services start with the server advertising its branches as
+// "<tip> refs/heads/<name>" lines ("-" for a branch without commits) ended
+// by "end".
+//
+// Fetch: the client sends a "want <hash>" line per tip it lacks and "end",
+// then negotiates in rounds: a batch of "have <hash>" lines and "end", to
+// which the server answers "ack <hash>" for each commit it has and "end".
+// The client finishes with "done" and the server streams a pack.
+//
+// Push: the client sends "update <old> <new> <ref>" lines ("-" for a branch
+// without commits) and "end", then streams a pack. The server answers each
+// update with "ok <ref>" or "ng <ref> <reason>", then "end".
+//
+// A pack is "pack <count>" followed by the objects, each "<hash> <type>
+// <size>" and its payload, or "error <message>" when the sender cannot make
+// one. It is thin: only objects the receiver lacks are in it, and it goes out
+// one object at a time through the channel's bounded buffer, so neither side
+// ever holds more than an object and the list of hashes.
+
+inline void sendObject(Channel& channel, const std::string& hash, ObjectType type, const std::string& payload) {
+    channel.write(hash + " " + objectTypeName(type) + " " + std::to_string(payload.size()) + "\n");
+    channel.write(payload);
+}
+
+// Reads the payload of an object whose header line is already read; false on a bad header or a short stream
+inline bool receiveObject(Channel& channel, const std::string& header, std::string& hash, ObjectType& type,
+                          std::string& payload) {
+    std::stringstream ss(header);
+    std::string typeName;
+    size_t size = 0;
+    return (ss >> hash >> typeName >> size) && parseObjectType(typeName, type) && channel.readExact(size, payload);
+}
+
+// Connects to the repository at location for a service: "unix:<path>" for a
+// "codebird serve --socket" server, otherwise a repository directory, served
+// by a "codebird serve --stdio" process spawned there on pipes. Null (with
+// the reason in error) if it cannot be reached.
+inline std::unique_ptr<Channel> connectRemote(const std::string& location, const std::string& service,
+                                              std::string& error) {
+    std::unique_ptr<Channel> channel;
+    if (location.compare(0, 5, "unix:") == 0) {
+        channel = Channel::connectUnix(location.substr(5), error);
+    } else if (!std::filesystem::exists(std::filesystem::path(location) / ".cbird")) {
+        error = "not a CodeBird repository";
+    } else {
+        std::error_code ec;
+        std::filesystem::path self = std::filesystem::read_symlink("/proc/self/exe", ec);
+        if (ec) {
+            error = ec.message();
+            return nullptr;
+        }
+        channel = Channel::spawn({self.string(), "serve", "remote", "--stdio"}, location, error);
+    }
+    if (channel) {
+        channel->write(service + "\n");
+        channel->flush();
+    }
+    return channel;
+}
+
+// Picks the commits a fetching client offers as haves, after git's skipping
+// negotiator. Walking back from the client's tips newest first, it offers a
+// commit and then passes over ever longer runs of its ancestors (1, 2, 4, ...
+// up to MAX_SKIP) before offering the next, so a long stretch of history the
+// server lacks costs a logarithmic number of haves. A commit the server
+// acknowledges makes it and all its ancestors common, and they are no longer
+// walked. A skip can pass the newest common commit; the server then sends
+// some objects the client already has, but never leaves one out.
+class SkippingNegotiator {
+private:
+    static constexpr uint32_t MAX_SKIP = 1024;
+
+    struct Entry {
+        int64_t time;
+        uint32_t pos;
+        uint32_t skip;      // Length of the run being passed over
+        uint32_t countdown; // Commits still to pass before the next offer
+        bool operator<(const Entry& other) const { return time < other.time; }
+    };
+
+    const CommitGraph& graph;
+    std::priority_queue<Entry> queue;
+    std::unordered_set<uint32_t> queued;
+    std::unordered_set<uint32_t> common;
+
+    void push(uint32_t pos, uint32_t skip, uint32_t countdown) {
+        if (pos != CommitGraph::NONE && !common.count(pos) && queued.insert(pos).second) {
+            queue.push({graph.time(pos), pos, skip, countdown});
+        }
+    }
+
+public:
+    explicit SkippingNegotiator(const CommitGraph& graph) : graph(graph) {}
+
+    void addTip(uint32_t pos) { push(pos, 1, 0); }
+
+    // Marks a commit the server has, and its ancestors, as common
+    void markCommon(uint32_t pos) {
+        std::vector<uint32_t> stack = {pos};
+        while (!stack.empty()) {
+            uint32_t current = stack.back();
+            stack.pop_back();
+            if (current == CommitGraph::NONE || !common.insert(current).second) {
+                continue;
+            }
+            for (uint32_t parent : graph.parents(current)) {
+                stack.push_back(parent);
+            }
+        }
+    }
+
+    // Up to limit commits to offer next; none once the walk is over
+    std::vector<uint32_t> next(size_t limit) {
+        std::vector<uint32_t> offered;
+        while (offered.size() < limit && !queue.empty()) {
+            Entry entry = queue.top();
+            queue.pop();
+            if (common.count(entry.pos)) {
+                continue;
+            }
+            if (entry.countdown == 0) {
+                offered.push_back(entry.pos);
+                entry.skip = std::min(entry.skip * 2, MAX_SKIP);
+                entry.countdown = entry.skip - 1;
+            } else {
+                entry.countdown--;
+            }
+            for (uint32_t parent : graph.parents(entry.pos)) {
+                push(parent, entry.skip, entry.countdown);
+            }
+        }
+        return offered;
+    }
+};
+
+#endif // CODEBIRD_SYNC_H
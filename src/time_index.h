@@ -0,0 +1,126 @@
+#ifndef CODEBIRD_TIME_INDEX_H
+#define CODEBIRD_TIME_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "file_util.h"
+#include "pack.h"
+
+// The first-parent history of one branch in commit time order, so "which
+// commit was the branch at at time T" is a binary search instead of a walk.
+// Times are clamped to never decrease along the history (a commit made on a
+// machine with a slow clock does not reorder the index).
+//
+// File (.cbird/objects/info/times/<branch>): "CBTI" v1, then per commit
+// oldest first its time (signed u64) and 32-byte hash. The last record is the
+// branch tip the index was built for, so a branch that moved forward only
+// needs its new commits appended; a truncated trailing record is ignored.
+class BranchTimeline {
+public:
+    using Entry = std::pair<int64_t, std::string>; // Time, commit hash (hex)
+
+private:
+    static constexpr size_t HEADER = 8;
+    static constexpr size_t RECORD = 40;
+    static constexpr uint32_t VERSION = 1;
+
+    MappedFile file;
+    size_t count = 0;
+
+    const char* record(size_t i) const {
+        return file.data() + HEADER + i * RECORD;
+    }
+
+    static void putEntry(std::string& out, int64_t time, const std::string& hash) {
+        std::string binary;
+        hexToBinary(hash, binary);
+        putU64(out, static_cast<uint64_t>(time));
+        out += binary;
+    }
+
+public:
+    bool load(const std::filesystem::path& path) {
+        count = 0;
+        if (!file.open(path) || file.size() < HEADER || file.view().substr(0, 4) != "CBTI" ||
+            getU32(file.data() + 4) != VERSION) {
+            file.close();
+            return false;
+        }
+        count = (file.size() - HEADER) / RECORD;
+        return true;
+    }
+
+    size_t size() const { return count; }
+
+    int64_t timeAt(size_t i) const {
+        return static_cast<int64_t>(getU64(record(i)));
+    }
+
+    std::string hashAt(size_t i) const {
+        return binaryToHex(record(i) + 8);
+    }
+
+    // Index of the newest commit made at or before time; size() if there is none
+    size_t lastAtOrBefore(int64_t time) const {
+        size_t low = 0, high = count;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (timeAt(mid) <= time) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low == 0 ? count : low - 1;
+    }
+
+    // Appends commits (oldest first) after the current last record, holding an
+    // exclusive lock; false if another process changed the file meanwhile
+    static bool append(const std::filesystem::path& path, const std::string& lastHash,
+                       const std::vector<Entry>& entries) {
+        int fd = ::open(path.c_str(), O_RDWR);
+        if (fd < 0) {
+            return false;
+        }
+        flock(fd, LOCK_EX);
+        BranchTimeline current;
+        bool ok = current.load(path) && current.size() > 0 && current.hashAt(current.size() - 1) == lastHash;
+        if (ok) {
+            std::string out;
+            int64_t floor = current.timeAt(current.size() - 1);
+            for (const auto& [time, hash] : entries) {
+                floor = std::max(floor, time);
+                putEntry(out, floor, hash);
+            }
+            off_t end = static_cast<off_t>(HEADER + current.size() * RECORD);
+            ok = ::pwrite(fd, out.data(), out.size(), end) == static_cast<ssize_t>(out.size());
+        }
+        flock(fd, LOCK_UN);
+        ::close(fd);
+        return ok;
+    }
+
+    // Replaces the file with the given history, oldest first
+    static bool write(const std::filesystem::path& path, const std::vector<Entry>& entries) {
+        std::string out = "CBTI";
+        putU32(out, VERSION);
+        int64_t floor = INT64_MIN;
+        for (const auto& [time, hash] : entries) {
+            floor = std::max(floor, time);
+            putEntry(out, floor, hash);
+        }
+        std::filesystem::create_directories(path.parent_path());
+        return writeFileAtomic(path, out);
+    }
+};
+
+#endif // CODEBIRD_TIME_INDEX_H
@@ -0,0 +1,167 @@
+#ifndef CODEBIRD_TRACE_H
+#define CODEBIRD_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per-phase timing in Chrome trace-event format (viewable in Perfetto or
+// chrome://tracing). Tracing is enabled with --trace=<file> or the
+// CODEBIRD_TRACE environment variable; when it is off a span costs a single
+// branch on a global flag.
+namespace trace {
+
+// Global switch checked by every span before doing any work
+inline bool enabled = false;
+
+// One completed span ("X" event in the trace-event format)
+struct Event {
+    const char* name;
+    const char* category;
+    std::string detail;
+    int64_t startUs;
+    int64_t durationUs;
+    uint64_t threadId;
+};
+
+class Tracer {
+private:
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::string outputPath;
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+    static std::string escape(const std::string& value) {
+        std::string out;
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+public:
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    // Starts collecting events; they are written to path by finish()
+    void start(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        outputPath = path;
+        events.reserve(1024);
+        origin = std::chrono::steady_clock::now();
+        enabled = true;
+    }
+
+    int64_t nowUs() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record(Event event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(std::move(event));
+    }
+
+    // Writes the collected events as trace-event JSON and stops tracing
+    void finish() {
+        if (!enabled) {
+            return;
+        }
+        enabled = false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream out(outputPath);
+        if (!out.is_open()) {
+            std::fprintf(stderr, "Error: Failed to write trace file %s\n", outputPath.c_str());
+            return;
+        }
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"codebird\"}}";
+        for (const auto& event : events) {
+            out << ",\n{\"name\":\"" << escape(event.name) << "\",\"cat\":\"" << event.category
+                << "\",\"ph\":\"X\",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs
+                << ",\"pid\":1,\"tid\":" << event.threadId;
+            if (!event.detail.empty()) {
+                out << ",\"args\":{\"detail\":\"" << escape(event.detail) << "\"}";
+            }
+            out << "}";
+        }
+        out << "\n]}\n";
+        events.clear();
+    }
+};
+
+// Scoped span: records its lifetime as one event when tracing is enabled
+class Span {
+private:
+    const char* name;
+    const char* category;
+    std::string detail;
+    int64_t startUs = -1;
+
+public:
+    Span(const char* name, const char* category) : name(name), category(category) {
+        if (enabled) {
+            startUs = Tracer::instance().nowUs();
+        }
+    }
+
+    Span(const char* name, const char* category, const std::string& spanDetail)
+        : name(name), category(category) {
+        if (enabled) {
+            detail = spanDetail;
+            startUs = Tracer::instance().nowUs();
+        }
+    }
+
+    // Detail "<count> <unit>", formatted only when tracing is on
+    Span(const char* name, const char* category, size_t count, const char* unit)
+        : name(name), category(category) {
+        if (enabled) {
+            detail = std::to_string(count) + " " + unit;
+            startUs = Tracer::instance().nowUs();
+        }
+    }
+
+    ~Span() {
+        if (startUs < 0) {
+            return;
+        }
+        Tracer& tracer = Tracer::instance();
+        uint64_t threadId = std::hash<std::thread::id>{}(std::this_thread::get_id()) % 100000;
+        tracer.record({name, category, std::move(detail), startUs, tracer.nowUs() - startUs, threadId});
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+};
+
+} // namespace trace
+
+#define CB_TRACE_CONCAT_INNER(a, b) a##b
+#define CB_TRACE_CONCAT(a, b) CB_TRACE_CONCAT_INNER(a, b)
+
+// Traces the enclosing scope: TRACE_SCOPE("name", "category"[, detail]) or
+// TRACE_SCOPE("name", "category", count, "unit"), where the detail must be a
+// string that already exists, since the arguments are evaluated either way
+#define TRACE_SCOPE(...) trace::Span CB_TRACE_CONCAT(traceSpan_, __LINE__)(__VA_ARGS__)
+
+#endif // CODEBIRD_TRACE_H
@@ -0,0 +1,234 @@
+#ifndef CODEBIRD_TRANSPORT_H
+#define CODEBIRD_TRANSPORT_H
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A buffered byte stream between two repositories over file descriptors:
+// the two ends of a Unix socket, or the pipes to a spawned process. Writes
+// collect in a bounded buffer and go out with blocking write(2) as it
+// fills, so a slow reader holds the writer back instead of letting data pile
+// up in memory. Once a read or write fails, ok() is false and further
+// operations do nothing.
+class Channel {
+private:
+    static constexpr size_t CAPACITY = 64 << 10;
+
+    int readFd;
+    int writeFd;
+    std::string input;
+    size_t inputPos = 0;
+    std::string output;
+    bool failed = false;
+    pid_t child = -1; // Process at the other end, reaped on close
+
+    // Reads more input; false at end of stream or on error
+    bool fill() {
+        if (failed) {
+            return false;
+        }
+        if (inputPos == input.size()) {
+            input.clear();
+            inputPos = 0;
+        }
+        char chunk[CAPACITY];
+        ssize_t got;
+        do {
+            got = ::read(readFd, chunk, sizeof(chunk));
+        } while (got < 0 && errno == EINTR);
+        if (got <= 0) {
+            failed = got < 0;
+            return false;
+        }
+        input.append(chunk, static_cast<size_t>(got));
+        return true;
+    }
+
+public:
+    Channel(int readFd, int writeFd) : readFd(readFd), writeFd(writeFd) {
+        std::signal(SIGPIPE, SIG_IGN);
+        output.reserve(CAPACITY);
+    }
+
+    ~Channel() {
+        flush();
+        ::close(readFd);
+        if (writeFd != readFd) {
+            ::close(writeFd);
+        }
+        if (child > 0) {
+            ::waitpid(child, nullptr, 0);
+        }
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Connects to a Unix socket; null (with the reason in error) on failure
+    static std::unique_ptr<Channel> connectUnix(const std::string& path, std::string& error) {
+        sockaddr_un address = {};
+        if (path.size() >= sizeof(address.sun_path)) {
+            error = "socket path too long";
+            return nullptr;
+        }
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            error = std::strerror(errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return nullptr;
+        }
+        return std::make_unique<Channel>(fd, fd);
+    }
+
+    // Runs a program in dir with its standard input and output connected to
+    // the channel; null (with the reason in error) if it cannot be started
+    static std::unique_ptr<Channel> spawn(const std::vector<std::string>& args, const std::filesystem::path& dir,
+                                          std::string& error) {
+        int toChild[2], fromChild[2];
+        if (::pipe(toChild) != 0) {
+            error = std::strerror(errno);
+            return nullptr;
+        }
+        if (::pipe(fromChild) != 0) {
+            error = std::strerror(errno);
+            ::close(toChild[0]);
+            ::close(toChild[1]);
+            return nullptr;
+        }
+        std::vector<char*> argv;
+        for (const auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            if (::chdir(dir.c_str()) != 0 || ::dup2(toChild[0], STDIN_FILENO) < 0 ||
+                ::dup2(fromChild[1], STDOUT_FILENO) < 0) {
+                ::_exit(127);
+            }
+            ::close(toChild[0]);
+            ::close(toChild[1]);
+            ::close(fromChild[0]);
+            ::close(fromChild[1]);
+            ::execv(argv[0], argv.data());
+            ::_exit(127);
+        }
+        ::close(toChild[0]);
+        ::close(fromChild[1]);
+        if (pid < 0) {
+            error = std::strerror(errno);
+            ::close(toChild[1]);
+            ::close(fromChild[0]);
+            return nullptr;
+        }
+        auto channel = std::make_unique<Channel>(fromChild[0], toChild[1]);
+        channel->child = pid;
+        return channel;
+    }
+
+    // A listening Unix socket at path (replacing a stale one); -1 (with the reason in error) on failure
+    static int listenUnix(const std::string& path, std::string& error) {
+        sockaddr_un address = {};
+        if (path.size() >= sizeof(address.sun_path)) {
+            error = "socket path too long";
+            return -1;
+        }
+        ::unlink(path.c_str());
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 16) != 0) {
+            error = std::strerror(errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return -1;
+        }
+        return fd;
+    }
+
+    bool ok() const { return !failed; }
+
+    bool flush() {
+        size_t done = 0;
+        while (!failed && done < output.size()) {
+            ssize_t written = ::write(writeFd, output.data() + done, output.size() - done);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                failed = true;
+                break;
+            }
+            done += static_cast<size_t>(written);
+        }
+        output.clear();
+        return !failed;
+    }
+
+    void write(std::string_view data) {
+        if (failed) {
+            return;
+        }
+        if (output.size() + data.size() > CAPACITY) {
+            flush();
+        }
+        if (data.size() >= CAPACITY) {
+            output.assign(data);
+            flush();
+        } else {
+            output.append(data);
+        }
+    }
+
+    // Reads a line without its '\n'; false at end of stream
+    bool readLine(std::string& line) {
+        line.clear();
+        while (true) {
+            size_t end = input.find('\n', inputPos);
+            if (end != std::string::npos) {
+                line.append(input, inputPos, end - inputPos);
+                inputPos = end + 1;
+                return true;
+            }
+            line.append(input, inputPos, std::string::npos);
+            inputPos = input.size();
+            if (!fill()) {
+                return false;
+            }
+        }
+    }
+
+    // Reads exactly size bytes; false if the stream ends first
+    bool readExact(size_t size, std::string& data) {
+        data.clear();
+        data.reserve(size);
+        while (data.size() < size) {
+            if (inputPos == input.size() && !fill()) {
+                return false;
+            }
+            size_t take = std::min(size - data.size(), input.size() - inputPos);
+            data.append(input, inputPos, take);
+            inputPos += take;
+        }
+        return true;
+    }
+};
+
+#endif // CODEBIRD_TRANSPORT_H
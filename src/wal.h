@@ -0,0 +1,151 @@
+#ifndef CODEBIRD_WAL_H
+#define CODEBIRD_WAL_H
+
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "file_util.h"
+
+// A ref transaction recorded in the write-ahead log
+struct WalEntry {
+    std::string id;
+    pid_t pid = 0;
+    std::string ref;
+    std::optional<std::string> oldValue; // nullopt: the ref did not exist
+    std::string newValue;
+};
+
+// Write-ahead log of ref transactions (.cbird/wal). Once a transaction's
+// objects are durable, the writer appends "begin <id> <pid> <ref> <old> <new>"
+// and syncs it, applies the ref update, then appends "end <id>". A crash
+// between the two leaves a begin without an end, which the next process to
+// open the repository resolves: the update is rolled forward if the ref
+// still holds the old value, and dropped otherwise. In the log, "-" stands
+// for a missing ref and "0" for a branch without commits. Appends hold a
+// shared flock on the log and truncation an exclusive one.
+class WriteAheadLog {
+private:
+    static constexpr uintmax_t TRUNCATE_BYTES = 64 << 10;
+
+    std::filesystem::path logPath;
+    bool durable = true;
+
+    bool append(const std::string& line, bool sync) {
+        int fd = ::open(logPath.c_str(), O_CREAT | O_WRONLY | O_APPEND, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        flock(fd, LOCK_SH);
+        bool ok = ::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size());
+        if (ok && sync && durable) {
+            ok = ::fdatasync(fd) == 0;
+        }
+        flock(fd, LOCK_UN);
+        ::close(fd);
+        return ok;
+    }
+
+    // Transactions with a begin record but no end record
+    std::map<std::string, WalEntry> unfinished() const {
+        std::map<std::string, WalEntry> open;
+        std::ifstream in(logPath);
+        for (std::string line; std::getline(in, line);) {
+            std::stringstream ss(line);
+            std::string kind;
+            WalEntry entry;
+            std::string oldText, newText;
+            ss >> kind >> entry.id;
+            if (kind == "end") {
+                open.erase(entry.id);
+            } else if (kind == "begin" && ss >> entry.pid >> entry.ref >> oldText >> newText) {
+                entry.oldValue = decode(oldText);
+                entry.newValue = decode(newText).value_or("");
+                open[entry.id] = std::move(entry);
+            }
+        }
+        return open;
+    }
+
+    static std::string encode(const std::optional<std::string>& value) {
+        return !value ? "-" : value->empty() ? "0" : *value;
+    }
+
+    static std::optional<std::string> decode(const std::string& text) {
+        if (text == "-") {
+            return std::nullopt;
+        }
+        return text == "0" ? std::string() : text;
+    }
+
+public:
+    explicit WriteAheadLog(const std::filesystem::path& path) : logPath(path) {}
+
+    void setDurable(bool enabled) {
+        durable = enabled;
+    }
+
+    // Records a transaction about to be applied; returns its id, "" on failure
+    std::string begin(const std::string& ref, const std::optional<std::string>& oldValue, const std::string& newValue) {
+        static thread_local std::mt19937_64 random(std::random_device{}());
+        std::stringstream id;
+        id << std::hex << std::chrono::steady_clock::now().time_since_epoch().count() << "." << (random() & 0xffff);
+        std::stringstream line;
+        line << "begin " << id.str() << " " << getpid() << " " << ref << " " << encode(oldValue) << " "
+             << encode(newValue) << "\n";
+        return append(line.str(), true) ? id.str() : "";
+    }
+
+    // Marks a transaction as finished, whether or not its update was applied
+    void end(const std::string& id) {
+        if (!id.empty()) {
+            append("end " + id + "\n", false);
+        }
+    }
+
+    // Transactions begun by processes that have exited without ending them
+    std::vector<WalEntry> abandoned() const {
+        std::vector<WalEntry> result;
+        for (auto& [id, entry] : unfinished()) {
+            if (::kill(entry.pid, 0) != 0 && errno == ESRCH) {
+                result.push_back(std::move(entry));
+            }
+        }
+        return result;
+    }
+
+    // Empties the log once it has grown and every transaction in it has ended
+    bool truncateIfIdle() {
+        std::error_code ec;
+        if (std::filesystem::file_size(logPath, ec) < TRUNCATE_BYTES || ec) {
+            return false;
+        }
+        int fd = ::open(logPath.c_str(), O_RDWR);
+        if (fd < 0) {
+            return false;
+        }
+        bool truncated = false;
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            if (unfinished().empty()) {
+                truncated = ::ftruncate(fd, 0) == 0;
+            }
+            flock(fd, LOCK_UN);
+        }
+        ::close(fd);
+        return truncated;
+    }
+};
+
+#endif // CODEBIRD_WAL_H